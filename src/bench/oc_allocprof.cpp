@@ -0,0 +1,482 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+// oc_allocprof: heap profile of a conversion. This executable replaces
+// malloc and its relatives, which also catches av_malloc() and operator new,
+// and accounts every call to the phase the job reports through PhaseHook.
+// The conversion runs several times in one process, heap that is still in
+// use after a run and grows from run to run is leaked. glibc only.
+
+#include "common/include/encode_parameter.h"
+#include "common/include/json_writer.h"
+#include "common/include/phase_hook.h"
+#include "common/include/process_parameter.h"
+#include "engine/include/converter.h"
+
+extern "C" {
+#include <libavutil/log.h>
+};
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#define ALLOCPROF_RUNS 3
+
+// frames decoded before the steady state is measured, the media pool and the
+// codec buffer pools fill up first
+#define ALLOCPROF_WARMUP_FRAMES 300
+
+typedef struct PhaseCounters {
+    std::atomic<int64_t> allocs{0};
+    std::atomic<int64_t> frees{0};
+    std::atomic<int64_t> bytes{0};       // allocated
+    std::atomic<int64_t> freedBytes{0};
+    std::atomic<int64_t> peak{0};        // heap in use, highest while in the phase
+} PhaseCounters;
+
+// Updated from every thread on every allocation, relaxed atomics only, the
+// hooks must neither allocate nor lock
+static PhaseCounters phase_counters[PHASE_COUNT];
+static std::atomic<int> current_phase{PHASE_IDLE};
+static std::atomic<int64_t> heap_in_use{0};
+
+static void raise_peak(std::atomic<int64_t> &peak, int64_t value) {
+    int64_t seen = peak.load(std::memory_order_relaxed);
+    while (value > seen &&
+           !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+        ;
+}
+
+#if defined(__GLIBC__)
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+void *__libc_pvalloc(size_t size);
+void __libc_free(void *ptr);
+}
+
+// sizes are the usable sizes of the blocks, so a free takes away exactly
+// what the allocation added
+static void *track_alloc(void *ptr) {
+    if (!ptr)
+        return ptr;
+    int64_t size = (int64_t)malloc_usable_size(ptr);
+    PhaseCounters &c = phase_counters[current_phase.load(std::memory_order_relaxed)];
+    c.allocs.fetch_add(1, std::memory_order_relaxed);
+    c.bytes.fetch_add(size, std::memory_order_relaxed);
+    raise_peak(c.peak, heap_in_use.fetch_add(size, std::memory_order_relaxed) + size);
+    return ptr;
+}
+
+static void track_free(void *ptr) {
+    if (!ptr)
+        return;
+    int64_t size = (int64_t)malloc_usable_size(ptr);
+    PhaseCounters &c = phase_counters[current_phase.load(std::memory_order_relaxed)];
+    c.frees.fetch_add(1, std::memory_order_relaxed);
+    c.freedBytes.fetch_add(size, std::memory_order_relaxed);
+    heap_in_use.fetch_sub(size, std::memory_order_relaxed);
+}
+
+extern "C" {
+
+void *malloc(size_t size) { return track_alloc(__libc_malloc(size)); }
+
+void *calloc(size_t nmemb, size_t size) { return track_alloc(__libc_calloc(nmemb, size)); }
+
+void *realloc(void *ptr, size_t size) {
+    void *moved;
+
+    if (!ptr)
+        return malloc(size);
+    if (!size) {
+        free(ptr);
+        return NULL;
+    }
+    track_free(ptr);
+    if (!(moved = __libc_realloc(ptr, size))) {
+        // the old block is still there
+        track_alloc(ptr);
+        return NULL;
+    }
+    return track_alloc(moved);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    return track_alloc(__libc_memalign(alignment, size));
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    void *ptr;
+
+    if (!alignment || (alignment & (alignment - 1)) || alignment % sizeof(void *))
+        return EINVAL;
+    if (!(ptr = track_alloc(__libc_memalign(alignment, size))))
+        return ENOMEM;
+    *memptr = ptr;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    return track_alloc(__libc_memalign(alignment, size));
+}
+
+void *valloc(size_t size) { return track_alloc(__libc_valloc(size)); }
+
+void *pvalloc(size_t size) { return track_alloc(__libc_pvalloc(size)); }
+
+void free(void *ptr) {
+    track_free(ptr);
+    __libc_free(ptr);
+}
+
+}
+
+#endif
+
+typedef struct PhaseReport {
+    int64_t allocs;
+    int64_t frees;
+    int64_t bytes;
+    int64_t net;   // heap in use at the end of the phase minus at its start
+    int64_t peak;
+} PhaseReport;
+
+// counters at one point of the loop phase, from the progress updates
+typedef struct LoopSample {
+    bool valid = false;
+    int64_t frames = 0;
+    int64_t allocs = 0;
+    int64_t bytes = 0;
+    int64_t heap = 0;
+} LoopSample;
+
+typedef struct RunReport {
+    bool ok;
+    PhaseReport phases[PHASE_COUNT];
+    int64_t frames;        // decoded frames, packets read when nothing is decoded
+    bool decoded;
+    int64_t peakHeap;      // highest heap in use during the run
+    int64_t heapBefore;    // heap in use before and after the converter existed
+    int64_t heapAfter;
+    // steady state, between the end of the warm-up and the last update of the
+    // loop phase, -1 when the loop was too short to sample
+    double steadyAllocsPerFrame;
+    double steadyBytesPerFrame;
+    double steadyGrowthPerFrame;  // heap in use
+} RunReport;
+
+static int64_t count_frames(const TranscodeStats &stats, bool *decoded) {
+    int64_t frames = 0;
+    int64_t packets = 0;
+
+    for (const StreamStats &s : stats.streams) {
+        frames += s.counters[COUNTER_FRAMES_DECODED];
+        packets += s.counters[COUNTER_PACKETS_READ];
+    }
+    *decoded = frames > 0;
+    return frames > 0 ? frames : packets;
+}
+
+// samples the counters while the loop phase runs, on the thread that
+// reports progress
+class LoopSampler : public ProcessObserver {
+public:
+    void on_process_update(double progress) override {}
+    void on_time_update(double timeRequired) override {}
+
+    void on_stats_update(const TranscodeStats &stats) override {
+        LoopSample sample;
+        bool decoded;
+
+        if (current_phase.load(std::memory_order_relaxed) != PHASE_LOOP)
+            return;
+        sample.valid = true;
+        sample.frames = count_frames(stats, &decoded);
+        sample.allocs = phase_counters[PHASE_LOOP].allocs.load(std::memory_order_relaxed);
+        sample.bytes = phase_counters[PHASE_LOOP].bytes.load(std::memory_order_relaxed);
+        sample.heap = heap_in_use.load(std::memory_order_relaxed);
+        if (!first.valid && sample.frames >= ALLOCPROF_WARMUP_FRAMES)
+            first = sample;
+        last = sample;
+    }
+
+    LoopSample first;
+    LoopSample last;
+};
+
+static int64_t phase_start_heap[PHASE_COUNT];
+static int64_t phase_end_heap[PHASE_COUNT];
+
+// the hook runs on the thread that changes the phase, phases are sequential
+static void on_phase(TranscodePhase phase, void *opaque) {
+    int64_t heap = heap_in_use.load(std::memory_order_relaxed);
+    int previous = current_phase.load(std::memory_order_relaxed);
+
+    phase_end_heap[previous] = heap;
+    phase_start_heap[phase] = heap;
+    raise_peak(phase_counters[phase].peak, heap);
+    current_phase.store(phase, std::memory_order_relaxed);
+}
+
+static void reset_counters() {
+    int64_t heap = heap_in_use.load(std::memory_order_relaxed);
+
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        PhaseCounters &c = phase_counters[i];
+        c.allocs = 0;
+        c.frees = 0;
+        c.bytes = 0;
+        c.freedBytes = 0;
+        c.peak = heap;
+        phase_start_heap[i] = heap;
+        phase_end_heap[i] = heap;
+    }
+}
+
+static void run_once(const std::string &input, const std::string &output,
+                     const std::string &transcoderName, const std::string &videoCodec,
+                     const std::string &audioCodec, RunReport *r) {
+    LoopSampler sampler;
+
+    memset(r, 0, sizeof(*r));
+    reset_counters();
+    r->heapBefore = heap_in_use.load(std::memory_order_relaxed);
+    {
+        ProcessParameter processParam;
+        EncodeParameter encodeParam;
+        Converter converter(&processParam, &encodeParam);
+
+        processParam.add_observer(&sampler);
+        if (!videoCodec.empty())
+            encodeParam.set_video_codec_name(videoCodec);
+        if (!audioCodec.empty())
+            encodeParam.set_audio_codec_name(audioCodec);
+        if (converter.set_transcoder(transcoderName))
+            r->ok = converter.convert_format(input, output);
+        r->frames = count_frames(converter.get_stats(), &r->decoded);
+        processParam.remove_observer(&sampler);
+    }
+    // the converter and the parameters are gone, what the job left behind
+    // is still in use
+    r->heapAfter = heap_in_use.load(std::memory_order_relaxed);
+
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        PhaseCounters &c = phase_counters[i];
+        PhaseReport &p = r->phases[i];
+        p.allocs = c.allocs;
+        p.frees = c.frees;
+        p.bytes = c.bytes;
+        p.peak = c.peak;
+        p.net = phase_end_heap[i] - phase_start_heap[i];
+        r->peakHeap = std::max(r->peakHeap, p.peak);
+    }
+    // the time outside the job is idle, it starts and ends the run
+    r->phases[PHASE_IDLE].net = r->heapAfter - r->heapBefore;
+
+    r->steadyAllocsPerFrame = -1;
+    r->steadyBytesPerFrame = -1;
+    r->steadyGrowthPerFrame = -1;
+    if (sampler.first.valid && sampler.last.frames > sampler.first.frames) {
+        double frames = (double)(sampler.last.frames - sampler.first.frames);
+        r->steadyAllocsPerFrame = (sampler.last.allocs - sampler.first.allocs) / frames;
+        r->steadyBytesPerFrame = (sampler.last.bytes - sampler.first.bytes) / frames;
+        r->steadyGrowthPerFrame = (sampler.last.heap - sampler.first.heap) / frames;
+    }
+}
+
+static void print_run(int index, const RunReport &r) {
+    const char *unit = r.decoded ? "frame" : "packet";
+
+    fprintf(stderr, "run %d: %s, %lld %ss, peak heap %.1f KiB, %lld bytes still in use\n",
+            index + 1, r.ok ? "ok" : "FAILED", (long long)r.frames, unit,
+            r.peakHeap / 1024.0, (long long)(r.heapAfter - r.heapBefore));
+    fprintf(stderr, "  %-8s %10s %10s %14s %14s %14s\n", "phase", "allocs", "frees",
+            "bytes", "net bytes", "peak heap");
+    for (int i = PHASE_OPEN; i < PHASE_COUNT; i++) {
+        const PhaseReport &p = r.phases[i];
+        fprintf(stderr, "  %-8s %10lld %10lld %14lld %14lld %14lld\n",
+                PhaseHook::Name((TranscodePhase)i), (long long)p.allocs, (long long)p.frees,
+                (long long)p.bytes, (long long)p.net, (long long)p.peak);
+    }
+    if (r.frames > 0) {
+        const PhaseReport &loop = r.phases[PHASE_LOOP];
+        fprintf(stderr, "  loop: %.2f allocs and %.0f bytes per %s\n",
+                (double)loop.allocs / r.frames, (double)loop.bytes / r.frames, unit);
+    }
+    if (r.steadyAllocsPerFrame >= 0)
+        fprintf(stderr, "  steady state: %.2f allocs, %.0f bytes, heap %+.1f bytes per %s\n",
+                r.steadyAllocsPerFrame, r.steadyBytesPerFrame, r.steadyGrowthPerFrame, unit);
+    else
+        fprintf(stderr, "  steady state: loop too short to sample\n");
+}
+
+static void write_run(JsonWriter &json, const RunReport &r) {
+    json.BeginObject()
+        .Key("ok").Bool(r.ok)
+        .Key("frames").Int(r.frames)
+        .Key("frames_decoded").Bool(r.decoded)
+        .Key("peak_heap").Int(r.peakHeap)
+        .Key("retained").Int(r.heapAfter - r.heapBefore);
+    json.Key("steady_state");
+    if (r.steadyAllocsPerFrame >= 0)
+        json.BeginObject()
+            .Key("allocs_per_frame").Double(r.steadyAllocsPerFrame)
+            .Key("bytes_per_frame").Double(r.steadyBytesPerFrame)
+            .Key("heap_growth_per_frame").Double(r.steadyGrowthPerFrame)
+            .EndObject();
+    else
+        json.Null();
+    json.Key("phases").BeginObject();
+    for (int i = PHASE_OPEN; i < PHASE_COUNT; i++) {
+        const PhaseReport &p = r.phases[i];
+        json.Key(PhaseHook::Name((TranscodePhase)i)).BeginObject()
+            .Key("allocs").Int(p.allocs)
+            .Key("frees").Int(p.frees)
+            .Key("bytes").Int(p.bytes)
+            .Key("net_bytes").Int(p.net)
+            .Key("peak_heap").Int(p.peak)
+            .EndObject();
+    }
+    json.EndObject();
+    json.EndObject();
+}
+
+static void print_usage(const char *program) {
+    std::cerr << "Usage: " << program << " [options] INPUT OUTPUT\n"
+              << "Options:\n"
+              << "  --runs N           Convert N times in one process (default "
+              << ALLOCPROF_RUNS << ")\n"
+              << "  --transcoder NAME  FFMPEG (default), FFTOOL or BMF\n"
+              << "  -v, --video-codec CODEC  Video encoder, copies the video when unset\n"
+              << "  -a, --audio-codec CODEC  Audio encoder, copies the audio when unset\n"
+              << "  --out FILE         Also write the report as JSON to FILE\n"
+              << "  --max-leak BYTES   Fail when the heap in use grows by more than BYTES\n"
+              << "                     per run after the first one\n"
+              << "  -h, --help         Show this help message\n";
+}
+
+int main(int argc, char *argv[]) {
+    std::string input;
+    std::string output;
+    std::string transcoderName = "FFMPEG";
+    std::string videoCodec;
+    std::string audioCodec;
+    std::string outFile;
+    int runs = ALLOCPROF_RUNS;
+    int64_t maxLeak = -1;
+    bool failed = false;
+    JsonWriter json;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--runs") && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+            if (runs < 1) {
+                std::cerr << "Error: Invalid run count '" << argv[i] << "'\n";
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--transcoder") && i + 1 < argc) {
+            transcoderName = argv[++i];
+        } else if ((!strcmp(argv[i], "-v") || !strcmp(argv[i], "--video-codec")) &&
+                   i + 1 < argc) {
+            videoCodec = argv[++i];
+        } else if ((!strcmp(argv[i], "-a") || !strcmp(argv[i], "--audio-codec")) &&
+                   i + 1 < argc) {
+            audioCodec = argv[++i];
+        } else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            outFile = argv[++i];
+        } else if (!strcmp(argv[i], "--max-leak") && i + 1 < argc) {
+            maxLeak = strtoll(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-' && input.empty()) {
+            input = argv[i];
+        } else if (argv[i][0] != '-' && output.empty()) {
+            output = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return strcmp(argv[i], "-h") && strcmp(argv[i], "--help") ? 1 : 0;
+        }
+    }
+    if (input.empty() || output.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+#if !defined(__GLIBC__)
+    std::cerr << "Error: oc_allocprof replaces the glibc allocator, it does not "
+                 "work with this C library\n";
+    return 1;
+#endif
+
+    av_log_set_level(AV_LOG_ERROR);
+    // the converter announces the transcoder on stdout
+    std::cout.rdbuf(std::cerr.rdbuf());
+    PhaseHook::Set(on_phase, NULL);
+
+    std::vector<RunReport> reports(runs);
+    for (int i = 0; i < runs; i++) {
+        run_once(input, output, transcoderName, videoCodec, audioCodec, &reports[i]);
+        print_run(i, reports[i]);
+        failed |= !reports[i].ok;
+    }
+    PhaseHook::Set(NULL, NULL);
+
+    // the first run fills the caches that live as long as the process
+    int64_t leak = 0;
+    if (runs > 1)
+        leak = (reports.back().heapAfter - reports.front().heapAfter) / (runs - 1);
+    fprintf(stderr, "heap growth per run after the first: %lld bytes\n", (long long)leak);
+    if (runs > 1 && maxLeak >= 0 && leak > maxLeak) {
+        fprintf(stderr, "Error: more than the allowed %lld bytes per run\n",
+                (long long)maxLeak);
+        failed = true;
+    }
+
+    if (!outFile.empty()) {
+        json.BeginObject()
+            .Key("input").String(input)
+            .Key("transcoder").String(transcoderName)
+            .Key("runs").BeginArray();
+        for (const RunReport &r : reports)
+            write_run(json, r);
+        json.EndArray()
+            .Key("leak_per_run").Int(leak)
+            .EndObject();
+
+        std::ofstream out(outFile);
+        out << json.GetString() << "\n";
+        if (!out) {
+            std::cerr << "Error: Could not write '" << outFile << "'\n";
+            return 1;
+        }
+    }
+    return failed ? 1 : 0;
+}
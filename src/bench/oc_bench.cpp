@@ -0,0 +1,577 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+
+// oc_bench: end-to-end benchmark of the conversion workloads. The inputs are
+// generated in-process from the lavfi sources testsrc2 and sine with bitexact
+// single threaded encoders, so every run converts the same bytes. Where
+// fork() is available each run happens in a child process, which gives it its
+// own CPU time and peak RSS.
+
+#include "common/include/encode_parameter.h"
+#include "common/include/json_writer.h"
+#include "common/include/process_parameter.h"
+#include "engine/include/converter.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/log.h>
+#include <libavutil/opt.h>
+};
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+#define BENCH_RUNS 3
+#define BENCH_AUDIO_RATE 48000
+
+typedef struct BenchInput {
+    const char *name;
+    int width;
+    int height;
+    int fps;
+    double duration;         // seconds, 0 for a single still frame
+    const char *videoCodec;  // encoder of the generated video
+    bool audio;              // add a sine tone in AAC
+    const char *extension;
+} BenchInput;
+
+static const BenchInput bench_inputs[] = {
+    {"h264_360p", 640, 360, 30, 10, "libx264", true, "mp4"},
+    {"h264_720p", 1280, 720, 30, 10, "libx264", true, "mp4"},
+    {"h264_1080p", 1920, 1080, 30, 5, "libx264", true, "mp4"},
+    {"mpeg4_480p", 854, 480, 25, 10, "mpeg4", true, "mkv"},
+    {"still_1080p", 1920, 1080, 1, 0, "png", false, "png"},
+};
+
+typedef struct BenchWorkload {
+    std::string name;
+    std::string input;
+    std::string extension;  // of the output
+    std::string transcoder;
+    std::function<void(EncodeParameter &)> setup;
+} BenchWorkload;
+
+// trivially copyable, the child process hands it over through a pipe
+typedef struct BenchResult {
+    bool ok;
+    double wallTime;
+    double userTime;
+    double systemTime;
+    int64_t peakRss;
+    int64_t frames;  // video frames of the output, audio packets without video
+    double mediaDuration;
+    int64_t outputSize;
+} BenchResult;
+
+// one stream of a generated input, a lavfi source feeding an encoder
+typedef struct GenStream {
+    AVFilterGraph *graph;
+    AVFilterContext *sink;
+    AVCodecContext *enc;
+    AVStream *st;
+    int64_t nextPts;  // in the encoder time base
+    bool done;
+} GenStream;
+
+static void print_usage(const char *program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "Options:\n"
+              << "  --out FILE        Write the results as JSON to FILE (default oc_bench.json)\n"
+              << "  --runs N          Runs per workload, the median is reported (default "
+              << BENCH_RUNS << ")\n"
+              << "  --filter TEXT     Only run the workloads whose name contains TEXT\n"
+              << "  --workdir DIR     Where the inputs are generated and kept\n"
+              << "  --list            Print the workloads and exit\n"
+              << "  -h, --help        Show this help message\n";
+}
+
+static std::vector<BenchWorkload> bench_workloads() {
+    std::vector<BenchWorkload> w;
+    std::vector<std::string> backends = {"FFMPEG"};
+
+#if defined(ENABLE_FFTOOL)
+    backends.push_back("FFTOOL");
+#endif
+#if defined(ENABLE_BMF)
+    backends.push_back("BMF");
+#endif
+
+    for (const std::string &backend : backends) {
+        std::string suffix = backend == "FFMPEG" ? "" : "_" + backend;
+        std::transform(suffix.begin(), suffix.end(), suffix.begin(), ::tolower);
+
+        w.push_back({"remux" + suffix, "h264_720p", "mkv", backend,
+                     [](EncodeParameter &) {}});
+        w.push_back({"x264_720p" + suffix, "h264_720p", "mp4", backend,
+                     [](EncodeParameter &p) { p.set_video_codec_name("libx264"); }});
+    }
+
+    w.push_back({"cut_copy", "h264_720p", "mp4", "FFMPEG", [](EncodeParameter &p) {
+                     p.SetStartTime(2);
+                     p.SetEndTime(6);
+                 }});
+    w.push_back({"cut_transcode", "h264_720p", "mp4", "FFMPEG", [](EncodeParameter &p) {
+                     p.set_video_codec_name("libx264");
+                     p.SetStartTime(2);
+                     p.SetEndTime(6);
+                 }});
+    w.push_back({"x264_360p", "h264_360p", "mp4", "FFMPEG",
+                 [](EncodeParameter &p) { p.set_video_codec_name("libx264"); }});
+    w.push_back({"x264_1080p", "h264_1080p", "mp4", "FFMPEG",
+                 [](EncodeParameter &p) { p.set_video_codec_name("libx264"); }});
+    w.push_back({"mpeg4_to_x264", "mpeg4_480p", "mp4", "FFMPEG",
+                 [](EncodeParameter &p) { p.set_video_codec_name("libx264"); }});
+    w.push_back({"audio_extract", "h264_720p", "m4a", "FFMPEG", [](EncodeParameter &p) {
+                     StreamRule rule;
+                     rule.type = "video";
+                     rule.action = STREAM_ACTION_DROP;
+                     p.AddStreamRule(rule);
+                 }});
+    w.push_back({"image_compress", "still_1080p", "jpg", "FFMPEG", [](EncodeParameter &p) {
+                     p.set_video_codec_name("mjpeg");
+                     p.set_qscale(5);
+                 }});
+    return w;
+}
+
+static const BenchInput *find_input(const std::string &name) {
+    for (const BenchInput &in : bench_inputs) {
+        if (name == in.name)
+            return &in;
+    }
+    return NULL;
+}
+
+static int open_gen_stream(AVFormatContext *oc, GenStream *g, const char *encoder,
+                           const char *source, const char *sinkName) {
+    const AVCodec *codec = avcodec_find_encoder_by_name(encoder);
+    AVFilterInOut *inputs = NULL;
+    AVFilterInOut *outputs = NULL;
+    int ret;
+
+    if (!codec) {
+        av_log(NULL, AV_LOG_ERROR, "Encoder %s not found\n", encoder);
+        return AVERROR_ENCODER_NOT_FOUND;
+    }
+    if (!(g->graph = avfilter_graph_alloc()) || !(inputs = avfilter_inout_alloc())) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    g->graph->nb_threads = 1;
+    if ((ret = avfilter_graph_create_filter(&g->sink, avfilter_get_by_name(sinkName), "out",
+                                            NULL, NULL, g->graph)) < 0)
+        goto end;
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = g->sink;
+    inputs->pad_idx = 0;
+    inputs->next = NULL;
+    if ((ret = avfilter_graph_parse_ptr(g->graph, source, &inputs, &outputs, NULL)) < 0 ||
+        (ret = avfilter_graph_config(g->graph, NULL)) < 0)
+        goto end;
+
+    if (!(g->enc = avcodec_alloc_context3(codec))) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    // the same bytes on every machine and every run
+    g->enc->thread_count = 1;
+    g->enc->flags |= AV_CODEC_FLAG_BITEXACT;
+    if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+        g->enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    if (codec->type == AVMEDIA_TYPE_VIDEO) {
+        AVRational rate = av_buffersink_get_frame_rate(g->sink);
+        g->enc->width = av_buffersink_get_w(g->sink);
+        g->enc->height = av_buffersink_get_h(g->sink);
+        g->enc->pix_fmt = (AVPixelFormat)av_buffersink_get_format(g->sink);
+        g->enc->time_base = av_inv_q(rate);
+        g->enc->framerate = rate;
+        // a keyframe every two seconds gives the cuts something to find
+        g->enc->gop_size = 2 * rate.num / std::max(rate.den, 1);
+        if (!strcmp(encoder, "libx264"))
+            av_opt_set(g->enc->priv_data, "preset", "veryfast", 0);
+        else if (codec->id == AV_CODEC_ID_MPEG4)
+            g->enc->bit_rate = 2000000;
+    } else {
+        g->enc->sample_rate = BENCH_AUDIO_RATE;
+        g->enc->sample_fmt = AV_SAMPLE_FMT_FLTP;
+        g->enc->bit_rate = 128000;
+        g->enc->time_base = AVRational{1, BENCH_AUDIO_RATE};
+        av_channel_layout_default(&g->enc->ch_layout, 2);
+    }
+    if ((ret = avcodec_open2(g->enc, codec, NULL)) < 0)
+        goto end;
+    if (codec->type == AVMEDIA_TYPE_AUDIO &&
+        !(codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE))
+        av_buffersink_set_frame_size(g->sink, g->enc->frame_size);
+
+    if (!(g->st = avformat_new_stream(oc, NULL))) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    g->st->time_base = g->enc->time_base;
+    ret = avcodec_parameters_from_context(g->st->codecpar, g->enc);
+
+end:
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    return ret;
+}
+
+static void close_gen_stream(GenStream *g) {
+    avfilter_graph_free(&g->graph);
+    avcodec_free_context(&g->enc);
+}
+
+// pull one frame from the source and write what the encoder returns
+static int gen_step(AVFormatContext *oc, GenStream *g, AVFrame *frame, AVPacket *pkt) {
+    int ret = av_buffersink_get_frame(g->sink, frame);
+
+    if (ret == AVERROR_EOF) {
+        g->done = true;
+        ret = avcodec_send_frame(g->enc, NULL);
+    } else if (ret >= 0) {
+        frame->pts = av_rescale_q(frame->pts, av_buffersink_get_time_base(g->sink),
+                                  g->enc->time_base);
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+        g->nextPts = frame->pts + (g->enc->codec_type == AVMEDIA_TYPE_AUDIO
+                                       ? frame->nb_samples : 1);
+        ret = avcodec_send_frame(g->enc, frame);
+        av_frame_unref(frame);
+    }
+    if (ret < 0)
+        return ret;
+
+    while ((ret = avcodec_receive_packet(g->enc, pkt)) >= 0) {
+        av_packet_rescale_ts(pkt, g->enc->time_base, g->st->time_base);
+        pkt->stream_index = g->st->index;
+        if ((ret = av_interleaved_write_frame(oc, pkt)) < 0)
+            return ret;
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+static int generate_input(const BenchInput &in, const std::string &path) {
+    AVFormatContext *oc = NULL;
+    GenStream video = {};
+    GenStream audio = {};
+    AVFrame *frame = av_frame_alloc();
+    AVPacket *pkt = av_packet_alloc();
+    const char *pixFmt = !strcmp(in.videoCodec, "png") ? "rgb24" : "yuv420p";
+    char source[256];
+    int ret;
+
+    if (!frame || !pkt) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if ((ret = avformat_alloc_output_context2(&oc, NULL, NULL, path.c_str())) < 0)
+        goto end;
+    oc->flags |= AVFMT_FLAG_BITEXACT;
+
+    if (in.duration > 0)
+        snprintf(source, sizeof(source), "testsrc2=size=%dx%d:rate=%d:duration=%g,format=%s",
+                 in.width, in.height, in.fps, in.duration, pixFmt);
+    else
+        snprintf(source, sizeof(source), "testsrc2=size=%dx%d:rate=%d,trim=end_frame=1,format=%s",
+                 in.width, in.height, in.fps, pixFmt);
+    if ((ret = open_gen_stream(oc, &video, in.videoCodec, source, "buffersink")) < 0)
+        goto end;
+    if (in.audio) {
+        snprintf(source, sizeof(source),
+                 "sine=frequency=440:sample_rate=%d:duration=%g,"
+                 "aformat=sample_fmts=fltp:channel_layouts=stereo",
+                 BENCH_AUDIO_RATE, in.duration);
+        if ((ret = open_gen_stream(oc, &audio, "aac", source, "abuffersink")) < 0)
+            goto end;
+    } else {
+        audio.done = true;
+    }
+
+    if (!(oc->oformat->flags & AVFMT_NOFILE) &&
+        (ret = avio_open(&oc->pb, path.c_str(), AVIO_FLAG_WRITE)) < 0)
+        goto end;
+    if ((ret = avformat_write_header(oc, NULL)) < 0)
+        goto end;
+
+    // interleave by always advancing the stream that is behind
+    while (!video.done || !audio.done) {
+        GenStream *g = &video;
+        if (video.done || (!audio.done && av_compare_ts(audio.nextPts, audio.enc->time_base,
+                                                        video.nextPts, video.enc->time_base) < 0))
+            g = &audio;
+        if ((ret = gen_step(oc, g, frame, pkt)) < 0)
+            goto end;
+    }
+    ret = av_write_trailer(oc);
+
+end:
+    if (ret < 0)
+        av_log(NULL, AV_LOG_ERROR, "Failed to generate %s\n", path.c_str());
+    close_gen_stream(&video);
+    close_gen_stream(&audio);
+    if (oc && !(oc->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&oc->pb);
+    avformat_free_context(oc);
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    return ret;
+}
+
+// frames and duration of an output, counted outside the timed region
+static void inspect_output(const std::string &path, BenchResult *r) {
+    AVFormatContext *fmtCtx = NULL;
+    AVPacket *pkt = av_packet_alloc();
+    std::error_code ec;
+    int idx;
+
+    r->outputSize = (int64_t)fs::file_size(path, ec);
+    if (!pkt || avformat_open_input(&fmtCtx, path.c_str(), NULL, NULL) < 0)
+        goto end;
+    if (avformat_find_stream_info(fmtCtx, NULL) < 0)
+        goto end;
+    if (fmtCtx->duration != AV_NOPTS_VALUE)
+        r->mediaDuration = fmtCtx->duration / (double)AV_TIME_BASE;
+    idx = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (idx < 0)
+        idx = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    while (idx >= 0 && av_read_frame(fmtCtx, pkt) >= 0) {
+        if (pkt->stream_index == idx)
+            r->frames++;
+        av_packet_unref(pkt);
+    }
+
+end:
+    avformat_close_input(&fmtCtx);
+    av_packet_free(&pkt);
+}
+
+static void convert(const BenchWorkload &w, const std::string &input,
+                    const std::string &output, BenchResult *r) {
+    EncodeParameter encodeParam;
+    ProcessParameter processParam;
+    Converter converter(&processParam, &encodeParam);
+    std::error_code ec;
+
+    fs::remove(output, ec);
+    w.setup(encodeParam);
+    if (!converter.set_transcoder(w.transcoder))
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+    r->ok = converter.convert_format(input, output);
+    r->wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (r->ok)
+        inspect_output(output, r);
+    fs::remove(output, ec);
+}
+
+static void run_isolated(const BenchWorkload &w, const std::string &input,
+                         const std::string &output, BenchResult *r) {
+    memset(r, 0, sizeof(*r));
+#ifndef _WIN32
+    struct rusage usage;
+    int fds[2];
+    int status;
+    ssize_t n = 0;
+    pid_t pid;
+
+    if (pipe(fds) < 0)
+        return;
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(NULL);
+    if ((pid = fork()) < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return;
+    }
+    if (pid == 0) {
+        BenchResult child;
+        memset(&child, 0, sizeof(child));
+        close(fds[0]);
+        convert(w, input, output, &child);
+        n = write(fds[1], &child, sizeof(child));
+        _exit(n == (ssize_t)sizeof(child) ? 0 : 1);
+    }
+    close(fds[1]);
+    do {
+        n = read(fds[0], r, sizeof(*r));
+    } while (n < 0 && errno == EINTR);
+    close(fds[0]);
+    // the rusage of the child covers its threads and the ffmpeg it ran
+    if (wait4(pid, &status, 0, &usage) < 0 || n != (ssize_t)sizeof(*r) ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        memset(r, 0, sizeof(*r));
+        return;
+    }
+    r->userTime = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    r->systemTime = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#ifdef __APPLE__
+    r->peakRss = usage.ru_maxrss;
+#else
+    r->peakRss = (int64_t)usage.ru_maxrss * 1024;
+#endif
+#else
+    // no fork, CPU time and peak RSS are not measured
+    convert(w, input, output, r);
+#endif
+}
+
+int main(int argc, char *argv[]) {
+    std::string outFile = "oc_bench.json";
+    std::string filter;
+    fs::path workdir = fs::temp_directory_path() / "oc_bench";
+    int runs = BENCH_RUNS;
+    bool list = false;
+    bool failed = false;
+    std::vector<BenchWorkload> workloads = bench_workloads();
+    std::error_code ec;
+    JsonWriter json;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            outFile = argv[++i];
+        } else if (!strcmp(argv[i], "--runs") && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+            if (runs < 1) {
+                std::cerr << "Error: Invalid run count '" << argv[i] << "'\n";
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (!strcmp(argv[i], "--workdir") && i + 1 < argc) {
+            workdir = argv[++i];
+        } else if (!strcmp(argv[i], "--list")) {
+            list = true;
+        } else {
+            print_usage(argv[0]);
+            return strcmp(argv[i], "-h") && strcmp(argv[i], "--help") ? 1 : 0;
+        }
+    }
+
+    if (list) {
+        for (const BenchWorkload &w : workloads)
+            std::cout << w.name << "\t" << w.input << " -> " << w.extension << "\t"
+                      << w.transcoder << "\n";
+        return 0;
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+    // the converter announces the transcoder on stdout
+    std::cout.rdbuf(std::cerr.rdbuf());
+    fs::create_directories(workdir, ec);
+
+    json.BeginObject()
+        .Key("ffmpeg").String(av_version_info())
+        .Key("runs").Int(runs);
+
+    json.Key("inputs").BeginArray();
+    for (const BenchInput &in : bench_inputs) {
+        fs::path path = workdir / (std::string(in.name) + "." + in.extension);
+        // generated once, the content never changes
+        if (!fs::exists(path) && generate_input(in, path.string()) < 0) {
+            fs::remove(path, ec);
+            return 1;
+        }
+        json.BeginObject()
+            .Key("name").String(in.name)
+            .Key("width").Int(in.width)
+            .Key("height").Int(in.height)
+            .Key("fps").Int(in.fps)
+            .Key("duration").Double(in.duration)
+            .Key("codec").String(in.videoCodec)
+            .Key("audio").Bool(in.audio)
+            .EndObject();
+    }
+    json.EndArray();
+
+    json.Key("results").BeginArray();
+    for (const BenchWorkload &w : workloads) {
+        const BenchInput *in = find_input(w.input);
+        std::vector<BenchResult> results(runs);
+
+        if (!filter.empty() && w.name.find(filter) == std::string::npos)
+            continue;
+        fs::path input = workdir / (std::string(in->name) + "." + in->extension);
+        fs::path output = workdir / ("output_" + w.name + "." + w.extension);
+
+        for (BenchResult &r : results)
+            run_isolated(w, input.string(), output.string(), &r);
+        std::sort(results.begin(), results.end(), [](const BenchResult &a, const BenchResult &b) {
+            return a.ok != b.ok ? a.ok : a.wallTime < b.wallTime;
+        });
+        const BenchResult &r = results[results.size() / 2];
+        double fps = r.wallTime > 0 ? r.frames / r.wallTime : 0;
+        double speed = r.wallTime > 0 ? r.mediaDuration / r.wallTime : 0;
+        bool ok = std::all_of(results.begin(), results.end(),
+                              [](const BenchResult &b) { return b.ok; });
+
+        failed |= !ok;
+        fprintf(stderr, "%-20s %-8s %s  %8.3fs  %8.1f fps  %6.2fx  cpu %7.3fs  rss %6lld MiB\n",
+                w.name.c_str(), w.transcoder.c_str(), ok ? "ok    " : "FAILED", r.wallTime, fps,
+                speed, r.userTime + r.systemTime, (long long)(r.peakRss >> 20));
+
+        json.BeginObject()
+            .Key("workload").String(w.name)
+            .Key("input").String(w.input)
+            .Key("transcoder").String(w.transcoder)
+            .Key("ok").Bool(ok)
+            .Key("wall_time").Double(r.wallTime)
+            .Key("fps").Double(fps)
+            .Key("speed").Double(speed)
+            .Key("frames").Int(r.frames)
+            .Key("media_duration").Double(r.mediaDuration)
+            .Key("user_time").Double(r.userTime)
+            .Key("system_time").Double(r.systemTime)
+            .Key("cpu_time").Double(r.userTime + r.systemTime)
+            .Key("peak_rss").Int(r.peakRss)
+            .Key("output_size").Int(r.outputSize)
+            .EndObject();
+    }
+    json.EndArray();
+    json.EndObject();
+
+    std::ofstream out(outFile);
+    out << json.GetString() << "\n";
+    if (!out) {
+        std::cerr << "Error: Could not write '" << outFile << "'\n";
+        return 1;
+    }
+    return failed ? 1 : 0;
+}
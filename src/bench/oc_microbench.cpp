@@ -0,0 +1,445 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+// oc_microbench: Google Benchmark microbenchmarks of the per-packet and
+// per-frame paths of TranscoderFFmpeg. Every benchmark drives a single stage
+// with synthetic packets and frames, nothing touches the disk.
+
+#include <benchmark/benchmark.h>
+
+#include "common/include/encode_parameter.h"
+#include "common/include/process_parameter.h"
+#include "transcoder/include/transcoder_ffmpeg.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/frame.h>
+#include <libavutil/log.h>
+#include <libavutil/mathematics.h>
+};
+
+#include <cstring>
+#include <utility>
+
+#define MICROBENCH_WIDTH 1280
+#define MICROBENCH_HEIGHT 720
+#define MICROBENCH_FPS 30
+#define MICROBENCH_SAMPLE_RATE 48000
+#define MICROBENCH_FRAME_SIZE 1024
+
+// a rawvideo frame this small costs the codec next to nothing, what is left
+// of encode_write_frame is the overhead around the codec calls
+#define MICROBENCH_RAW_WIDTH 64
+#define MICROBENCH_RAW_HEIGHT 64
+
+// Holds the pipeline state a stage of TranscoderFFmpeg needs: a media pool,
+// one lane with its queues and one output. The queues are drained after
+// every call, so a stage never blocks on them.
+class TranscoderFFmpegBench {
+public:
+    TranscoderFFmpegBench() : transcoder(&processParameter, &encodeParameter) {
+        transcoder.mediaPool = new MediaPool();
+        inCtx = avformat_alloc_context();
+        inStream = inCtx ? avformat_new_stream(inCtx, NULL) : NULL;
+        transcoder.lanes.push_back(TranscodeLane());
+        lane = &transcoder.lanes.back();
+        lane->in_stream = inStream;
+        lane->out_stream = inStream;
+        lane->next_key = AV_NOPTS_VALUE;
+    }
+
+    ~TranscoderFFmpegBench() {
+        // free_lanes() releases whatever is still queued, the lane frees its
+        // encoder
+        transcoder.free_lanes();
+        transcoder.lanes.clear();
+        transcoder.outputs.clear();
+        delete transcoder.mediaPool;
+        transcoder.mediaPool = NULL;
+        avformat_free_context(inCtx);
+    }
+
+    bool Valid() const { return inStream != NULL; }
+
+    int OpenFilter(AVCodecContext *dec_ctx, const char *filters_descr) {
+        inStream->codecpar->codec_type = dec_ctx->codec_type;
+        lane->filter_ctx = &filter;
+        lane->filtered = new BoundedQueue<AVFrame *>(PIPELINE_FRAME_QUEUE_SIZE);
+        return transcoder.init_filter(dec_ctx, lane->filter_ctx, filters_descr);
+    }
+
+    // the lane takes ownership of enc_ctx
+    int OpenEncoder(AVCodecContext *enc_ctx, const AVCodec *codec) {
+        OutputContext output = {NULL, "", 0, 0, 0,
+                                new BoundedQueue<MuxPacket>(PIPELINE_PACKET_QUEUE_SIZE)};
+
+        transcoder.outputs.push_back(std::move(output));
+        lane->enc_ctx.reset(enc_ctx);
+        transcoder.mediaPool->AttachEncoder(enc_ctx);
+        return avcodec_open2(enc_ctx, codec, NULL);
+    }
+
+    // encode_frame() as filter_loop() calls it, one pooled frame per call
+    int Filter(const AVFrame *src) {
+        AVFrame *frame = transcoder.mediaPool->GetFrame();
+        AVFrame *filtered = NULL;
+        int ret;
+
+        if (!frame)
+            return AVERROR(ENOMEM);
+        if ((ret = av_frame_ref(frame, src)) >= 0)
+            ret = transcoder.encode_frame(lane, frame);
+        transcoder.mediaPool->ReleaseFrame(&frame);
+        while (lane->filtered->TryPop(filtered))
+            transcoder.mediaPool->ReleaseFrame(&filtered);
+        return ret;
+    }
+
+    // encode_write_frame() as encode_loop() calls it
+    int Encode(const AVFrame *src) {
+        AVFrame *frame = transcoder.mediaPool->GetFrame();
+        MuxPacket mux_pkt;
+        int ret;
+
+        if (!frame)
+            return AVERROR(ENOMEM);
+        if ((ret = av_frame_ref(frame, src)) >= 0)
+            ret = transcoder.encode_write_frame(lane, frame);
+        transcoder.mediaPool->ReleaseFrame(&frame);
+        while (transcoder.outputs[0].muxQueue->TryPop(mux_pkt))
+            transcoder.mediaPool->ReleasePacket(&mux_pkt.pkt);
+        return ret;
+    }
+
+    ProcessParameter processParameter;
+    EncodeParameter encodeParameter;
+    TranscoderFFmpeg transcoder;
+
+private:
+    AVFormatContext *inCtx = NULL;
+    AVStream *inStream = NULL;
+    TranscodeLane *lane = NULL;
+    FilteringContext filter;
+};
+
+typedef struct FilterCase {
+    const char *name;
+    enum AVMediaType type;
+    const char *filters;
+} FilterCase;
+
+// null graphs measure the buffersrc/buffersink round trip alone
+static const FilterCase filter_cases[] = {
+    {"Filter/video/null", AVMEDIA_TYPE_VIDEO, "null"},
+    {"Filter/video/scale", AVMEDIA_TYPE_VIDEO, "scale=640:360"},
+    {"Filter/video/format", AVMEDIA_TYPE_VIDEO, "format=yuv444p"},
+    {"Filter/audio/anull", AVMEDIA_TYPE_AUDIO, "anull"},
+    {"Filter/audio/aformat", AVMEDIA_TYPE_AUDIO, "aformat=sample_fmts=s16"},
+};
+
+static AVFrame *alloc_video_frame(int width, int height) {
+    AVFrame *frame = av_frame_alloc();
+
+    if (!frame)
+        return NULL;
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    frame->sample_aspect_ratio = AVRational{1, 1};
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+    // mid grey, the content does not matter to any of the stages
+    for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; i++)
+        memset(frame->buf[i]->data, 0x80, frame->buf[i]->size);
+    return frame;
+}
+
+static AVFrame *alloc_audio_frame() {
+    AVFrame *frame = av_frame_alloc();
+
+    if (!frame)
+        return NULL;
+    frame->format = AV_SAMPLE_FMT_FLTP;
+    frame->sample_rate = MICROBENCH_SAMPLE_RATE;
+    frame->nb_samples = MICROBENCH_FRAME_SIZE;
+    av_channel_layout_default(&frame->ch_layout, 2);
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+    // silence, a float pattern could be denormal and slow the filters down
+    for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; i++)
+        memset(frame->buf[i]->data, 0, frame->buf[i]->size);
+    return frame;
+}
+
+// the decoder parameters init_filter() reads the buffer source setup from
+static AVCodecContext *alloc_decoder_params(enum AVMediaType type) {
+    AVCodecContext *ctx = avcodec_alloc_context3(NULL);
+
+    if (!ctx)
+        return NULL;
+    ctx->codec_type = type;
+    if (type == AVMEDIA_TYPE_VIDEO) {
+        ctx->width = MICROBENCH_WIDTH;
+        ctx->height = MICROBENCH_HEIGHT;
+        ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+        ctx->time_base = AVRational{1, MICROBENCH_FPS};
+        ctx->sample_aspect_ratio = AVRational{1, 1};
+    } else {
+        ctx->sample_rate = MICROBENCH_SAMPLE_RATE;
+        ctx->sample_fmt = AV_SAMPLE_FMT_FLTP;
+        ctx->time_base = AVRational{1, MICROBENCH_SAMPLE_RATE};
+        av_channel_layout_default(&ctx->ch_layout, 2);
+    }
+    return ctx;
+}
+
+static AVCodecContext *alloc_raw_encoder(const AVCodec **codec) {
+    AVCodecContext *ctx;
+
+    if (!(*codec = avcodec_find_encoder(AV_CODEC_ID_RAWVIDEO)))
+        return NULL;
+    if (!(ctx = avcodec_alloc_context3(*codec)))
+        return NULL;
+    ctx->width = MICROBENCH_RAW_WIDTH;
+    ctx->height = MICROBENCH_RAW_HEIGHT;
+    ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    ctx->time_base = AVRational{1, MICROBENCH_FPS};
+    return ctx;
+}
+
+// remux() per packet into the null muxer: stream mapping, timestamp
+// rescaling and the interleaving of av_interleaved_write_frame()
+static void BM_Remux(benchmark::State &state) {
+    TranscoderFFmpegBench bench;
+    AVFormatContext *ofmtCtx = NULL;
+    AVStream *outStream = NULL;
+    AVPacket *tmpl = av_packet_alloc();
+    AVPacket *pkt = av_packet_alloc();
+    AVRational inTimeBase = {1, 90000};
+    int size = (int)state.range(0);
+    int64_t pts = 0;
+
+    if (!tmpl || !pkt || av_new_packet(tmpl, size) < 0 ||
+        avformat_alloc_output_context2(&ofmtCtx, NULL, "null", NULL) < 0 ||
+        !(outStream = avformat_new_stream(ofmtCtx, NULL))) {
+        state.SkipWithError("Could not set up the output");
+        goto end;
+    }
+    memset(tmpl->data, 0, size);
+    tmpl->flags = AV_PKT_FLAG_KEY;
+    tmpl->duration = 90000 / MICROBENCH_FPS;
+    outStream->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    outStream->codecpar->codec_id = AV_CODEC_ID_H264;
+    outStream->codecpar->width = MICROBENCH_WIDTH;
+    outStream->codecpar->height = MICROBENCH_HEIGHT;
+    outStream->time_base = AVRational{1, 1000};
+    if (avformat_write_header(ofmtCtx, NULL) < 0) {
+        state.SkipWithError("Could not write the header");
+        goto end;
+    }
+
+    for (auto _ : state) {
+        // the muxer takes the reference, a new one is cheap
+        av_packet_ref(pkt, tmpl);
+        pkt->pts = pkt->dts = pts;
+        pts += tmpl->duration;
+        if (bench.transcoder.remux(pkt, ofmtCtx, outStream, inTimeBase) < 0) {
+            state.SkipWithError("remux failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * size);
+    av_write_trailer(ofmtCtx);
+
+end:
+    avformat_free_context(ofmtCtx);
+    av_packet_free(&tmpl);
+    av_packet_free(&pkt);
+}
+BENCHMARK(BM_Remux)->Arg(188)->Arg(4096)->Arg(65536);
+
+// the per-packet rescale of remux() and transcode_packet(), 48 kHz to
+// 44.1 kHz is not an integer ratio and takes the rounding path
+static void BM_PacketRescaleTs(benchmark::State &state) {
+    AVPacket *pkt = av_packet_alloc();
+    AVRational from = {1, 48000};
+    AVRational to = {1, 44100};
+    int64_t ts = 0;
+
+    if (!pkt) {
+        state.SkipWithError("Could not allocate the packet");
+        return;
+    }
+    for (auto _ : state) {
+        pkt->pts = pkt->dts = ts;
+        pkt->duration = MICROBENCH_FRAME_SIZE;
+        av_packet_rescale_ts(pkt, from, to);
+        benchmark::DoNotOptimize(pkt->pts);
+        ts += MICROBENCH_FRAME_SIZE;
+    }
+    state.SetItemsProcessed(state.iterations());
+    av_packet_free(&pkt);
+}
+BENCHMARK(BM_PacketRescaleTs);
+
+// the single rescale update_progress() does for every muxed packet
+static void BM_RescaleQ(benchmark::State &state) {
+    AVRational from = {1, 90000};
+    AVRational micros = {1, 1000000};
+    int64_t ts = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(av_rescale_q(ts, from, micros));
+        ts += 3003;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RescaleQ);
+
+// progress smoothing and the rate limited UI and reporter updates, called
+// once per muxed packet of the progress stream
+static void BM_SendProcessParameter(benchmark::State &state) {
+    TranscoderFFmpegBench bench;
+    int64_t total = 1000000;
+    int64_t done = 0;
+
+    for (auto _ : state) {
+        bench.transcoder.send_process_parameter(done, total);
+        done = (done + 1) % total;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SendProcessParameter);
+
+// encode_frame() per frame: push into the graph and pull from its sink
+static void BM_Filter(benchmark::State &state, const FilterCase *c) {
+    TranscoderFFmpegBench bench;
+    AVCodecContext *params = alloc_decoder_params(c->type);
+    AVFrame *src = c->type == AVMEDIA_TYPE_VIDEO
+                       ? alloc_video_frame(MICROBENCH_WIDTH, MICROBENCH_HEIGHT)
+                       : alloc_audio_frame();
+    int64_t step = c->type == AVMEDIA_TYPE_VIDEO ? 1 : MICROBENCH_FRAME_SIZE;
+    int64_t pts = 0;
+
+    if (!bench.Valid() || !params || !src || bench.OpenFilter(params, c->filters) < 0) {
+        state.SkipWithError("Could not set up the filter graph");
+        goto end;
+    }
+
+    for (auto _ : state) {
+        src->pts = pts;
+        pts += step;
+        if (bench.Filter(src) < 0) {
+            state.SkipWithError("encode_frame failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+
+end:
+    av_frame_free(&src);
+    avcodec_free_context(&params);
+}
+
+// encode_write_frame() per frame with a tiny rawvideo encoder, compare with
+// BM_EncodeBaseline for the cost outside the codec
+static void BM_EncodeWriteFrame(benchmark::State &state) {
+    TranscoderFFmpegBench bench;
+    const AVCodec *codec = NULL;
+    AVCodecContext *enc_ctx = alloc_raw_encoder(&codec);
+    AVFrame *src = alloc_video_frame(MICROBENCH_RAW_WIDTH, MICROBENCH_RAW_HEIGHT);
+    int64_t pts = 0;
+
+    if (!bench.Valid() || !enc_ctx || !src) {
+        state.SkipWithError("Could not set up the encoder");
+        avcodec_free_context(&enc_ctx);
+        goto end;
+    }
+    if (bench.OpenEncoder(enc_ctx, codec) < 0) {
+        state.SkipWithError("Could not open the encoder");
+        goto end;
+    }
+
+    for (auto _ : state) {
+        src->pts = pts++;
+        if (bench.Encode(src) < 0) {
+            state.SkipWithError("encode_write_frame failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+
+end:
+    av_frame_free(&src);
+}
+BENCHMARK(BM_EncodeWriteFrame);
+
+// the bare avcodec_send_frame()/avcodec_receive_packet() pair of
+// BM_EncodeWriteFrame
+static void BM_EncodeBaseline(benchmark::State &state) {
+    const AVCodec *codec = NULL;
+    AVCodecContext *enc_ctx = alloc_raw_encoder(&codec);
+    AVFrame *src = alloc_video_frame(MICROBENCH_RAW_WIDTH, MICROBENCH_RAW_HEIGHT);
+    AVPacket *pkt = av_packet_alloc();
+    int64_t pts = 0;
+    int ret = 0;
+
+    if (!enc_ctx || !src || !pkt || avcodec_open2(enc_ctx, codec, NULL) < 0) {
+        state.SkipWithError("Could not set up the encoder");
+        goto end;
+    }
+
+    for (auto _ : state) {
+        src->pts = pts++;
+        if ((ret = avcodec_send_frame(enc_ctx, src)) < 0)
+            break;
+        while ((ret = avcodec_receive_packet(enc_ctx, pkt)) >= 0)
+            av_packet_unref(pkt);
+        if (ret != AVERROR(EAGAIN))
+            break;
+    }
+    if (ret < 0 && ret != AVERROR(EAGAIN))
+        state.SkipWithError("encoding failed");
+    state.SetItemsProcessed(state.iterations());
+
+end:
+    av_packet_free(&pkt);
+    av_frame_free(&src);
+    avcodec_free_context(&enc_ctx);
+}
+BENCHMARK(BM_EncodeBaseline);
+
+int main(int argc, char **argv) {
+    // init_filter() logs every graph it configures
+    av_log_set_level(AV_LOG_ERROR);
+
+    for (const FilterCase &c : filter_cases)
+        benchmark::RegisterBenchmark(c.name, BM_Filter, &c);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
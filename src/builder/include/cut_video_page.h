@@ -21,6 +21,7 @@
 #include "base_page.h"
 #include "simple_video_player.h"
 #include "../../common/include/process_observer.h"
+#include <QCheckBox>
 #include <QGroupBox>
 #include <QLabel>
 #include <QLineEdit>
@@ -111,6 +112,7 @@ private:
     QPushButton *setEndButton;
     QLabel *cutDurationLabel;
     QLabel *cutDurationValueLabel;
+    QCheckBox *smartCutCheckBox;
 
     // Progress section
     QProgressBar *progressBar;
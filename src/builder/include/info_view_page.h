@@ -19,15 +19,19 @@
 #define INFO_VIEW_PAGE_H
 
 #include "base_page.h"
+#include <QCheckBox>
+#include <QElapsedTimer>
 #include <QGridLayout>
 #include <QGroupBox>
 #include <QLabel>
 #include <QLineEdit>
 #include <QPushButton>
 #include <QVBoxLayout>
+#include <atomic>
+#include <memory>
 
-class Info;
 class QuickInfo;
+struct MediaAnalysis;
 
 class InfoViewPage : public BasePage {
     Q_OBJECT
@@ -46,12 +50,18 @@ public:
 private slots:
     void OnBrowseButtonClicked();
     void OnAnalyzeButtonClicked();
+    void OnDeepAnalyzeClicked();
 
 private:
     void SetupUI();
     void AnalyzeFile(const QString &filePath);
+    void StartProbe(const QString &filePath, bool deep);
+    void CancelProbe();
     void DisplayInfo(QuickInfo *quickInfo);
+    void DisplayAnalysis(const MediaAnalysis &analysis);
     void ClearInfo();
+    void ClearAnalysis();
+    void CancelAnalysis();
     QString FormatBitrate(int64_t bitsPerSec);
     QString FormatFrequency(int64_t hertz);
 
@@ -91,8 +101,29 @@ private:
     QLabel *sampleRateLabel;
     QLabel *sampleRateValue;
 
-    // Backend
-    Info *info;
+    QGroupBox *analysisGroupBox;
+    QPushButton *deepAnalyzeButton;
+    QCheckBox *decodeCheckBox;
+    QLabel *analysisStatusLabel;
+    QLabel *avgBitRateLabel;
+    QLabel *avgBitRateValue;
+    QLabel *peakBitRateLabel;
+    QLabel *peakBitRateValue;
+    QLabel *gopLabel;
+    QLabel *gopValue;
+    QLabel *keyIntervalLabel;
+    QLabel *keyIntervalValue;
+    QLabel *bFramesLabel;
+    QLabel *bFramesValue;
+    QLabel *framesLabel;
+    QLabel *framesValue;
+
+    // Backend, raised when the probe in flight is no longer wanted
+    std::shared_ptr<std::atomic<bool>> probeCancel;
+    QElapsedTimer probeTimer;
+    std::shared_ptr<std::atomic<bool>> analysisCancel;
+    int shownVideoIdx = -1;  // streams the page shows
+    int shownAudioIdx = -1;
 };
 
 #endif // INFO_VIEW_PAGE_H
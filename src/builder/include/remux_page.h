@@ -22,6 +22,7 @@
 #include "../../common/include/process_observer.h"
 #include <QCheckBox>
 #include <QComboBox>
+#include <QElapsedTimer>
 #include <QGroupBox>
 #include <QLabel>
 #include <QLineEdit>
@@ -31,12 +32,15 @@
 #include <QThread>
 #include <QVBoxLayout>
 #include <QVector>
+#include <atomic>
+#include <memory>
 
 extern "C" {
 #include <libavformat/avformat.h>
 }
 
 class EncodeParameter;
+class MediaProbe;
 class ProcessParameter;
 
 struct StreamInfo {
@@ -81,6 +85,9 @@ private:
     void SetupUI();
     void UpdateOutputPath();
     void AnalyzeStreams(const QString &filePath);
+    void StartProbe(const QString &filePath, bool deep);
+    void CancelProbe();
+    void ShowStreams(const MediaProbe &probe);
     void ClearStreams();
     QString GetStreamTypeName(int codecType);
     QString FormatBitrate(int64_t bitsPerSec);
@@ -98,6 +105,9 @@ private:
     QWidget *streamsContainer;
     QVBoxLayout *streamsLayout;
     QVector<StreamInfo> streams;
+    // raised when the probe in flight is no longer wanted
+    std::shared_ptr<std::atomic<bool>> probeCancel;
+    QElapsedTimer probeTimer;
 
     // Settings section
     QGroupBox *settingsGroupBox;
@@ -23,6 +23,9 @@
 #include <QThread>
 #include <QMutex>
 
+#include "../../common/include/packet_index.h"
+#include "../../common/include/probe_cache.h"
+
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
@@ -62,6 +65,7 @@ private slots:
 
 private:
     void CloseVideo();
+    void LoadPacketIndex();
     bool DecodeNextFrame();
     void DisplayFrame(AVFrame *frame);
     QImage ConvertFrameToQImage(AVFrame *frame);
@@ -80,6 +84,10 @@ private:
     qint64 currentPositionMs;
     double timeBase;
 
+    // keyframe positions for seeking, built in the background on first use
+    QString videoPath;
+    PacketIndex packetIndex;
+
     // Playback state
     bool isPlaying;
     bool isLoaded;
@@ -19,6 +19,7 @@
 #include "../include/open_converter.h"
 #include "../include/shared_data.h"
 #include "../../common/include/encode_parameter.h"
+#include "../../common/include/probe_cache.h"
 #include "../../common/include/process_parameter.h"
 #include "../../engine/include/converter.h"
 #include <QFileDialog>
@@ -151,7 +152,7 @@ void CutVideoPage::SetupUI() {
     // Start time
     startTimeLabel = new QLabel(tr("Start Time:"), timeSelectionGroupBox);
     startTimeEdit = new QTimeEdit(QTime(0, 0, 0), timeSelectionGroupBox);
-    startTimeEdit->setDisplayFormat("HH:mm:ss");
+    startTimeEdit->setDisplayFormat("HH:mm:ss.zzz");
     connect(startTimeEdit, &QTimeEdit::timeChanged, this, &CutVideoPage::OnStartTimeChanged);
 
     setStartButton = new QPushButton(tr("Set from Player"), timeSelectionGroupBox);
@@ -161,7 +162,7 @@ void CutVideoPage::SetupUI() {
     // End time
     endTimeLabel = new QLabel(tr("End Time:"), timeSelectionGroupBox);
     endTimeEdit = new QTimeEdit(QTime(0, 0, 0), timeSelectionGroupBox);
-    endTimeEdit->setDisplayFormat("HH:mm:ss");
+    endTimeEdit->setDisplayFormat("HH:mm:ss.zzz");
     connect(endTimeEdit, &QTimeEdit::timeChanged, this, &CutVideoPage::OnEndTimeChanged);
 
     setEndButton = new QPushButton(tr("Set from Player"), timeSelectionGroupBox);
@@ -184,6 +185,12 @@ void CutVideoPage::SetupUI() {
     timeSelectionLayout->addWidget(cutDurationLabel, 2, 0);
     timeSelectionLayout->addWidget(cutDurationValueLabel, 2, 1, 1, 2);
 
+    // Smart cut
+    smartCutCheckBox = new QCheckBox(tr("Frame-accurate cut (smart cut)"), timeSelectionGroupBox);
+    smartCutCheckBox->setToolTip(tr("Re-encode only the frames around the cut points "
+                                    "and copy everything in between"));
+    timeSelectionLayout->addWidget(smartCutCheckBox, 3, 0, 1, 3);
+
     mainLayout->addWidget(timeSelectionGroupBox);
 
     // Progress Section
@@ -286,30 +293,21 @@ void CutVideoPage::LoadVideo(const QString &filePath) {
         return;
     }
 
-    // Get duration quickly using FFmpeg (limit analysis to avoid blocking)
-    AVFormatContext *fmtCtx = nullptr;
-    int ret = avformat_open_input(&fmtCtx, filePath.toStdString().c_str(), nullptr, nullptr);
-    if (ret >= 0) {
-        // Limit stream analysis time to avoid blocking UI
-        fmtCtx->max_analyze_duration = 5 * AV_TIME_BASE; // 5 seconds max
-        ret = avformat_find_stream_info(fmtCtx, nullptr);
-        if (ret >= 0 && fmtCtx->duration != AV_NOPTS_VALUE) {
-            // Duration is in AV_TIME_BASE units (microseconds)
-            qint64 durationMs = (fmtCtx->duration * 1000) / AV_TIME_BASE;
-            videoDuration = durationMs;
-            timelineSlider->setRange(0, durationMs);
-            endTimeDisplayLabel->setText(FormatTime(durationMs));
-
-            // Set default end time to video duration
-            endTime = durationMs;
-            int hours = (durationMs / 1000) / 3600;
-            int minutes = ((durationMs / 1000) % 3600) / 60;
-            int seconds = (durationMs / 1000) % 60;
-            endTimeEdit->setTime(QTime(hours, minutes, seconds));
-
-            UpdateDurationLabel();
-        }
-        avformat_close_input(&fmtCtx);
+    // the duration comes from the shared probe, the player reuses it too
+    std::shared_ptr<const MediaProbe> probe =
+        ProbeCache::Instance().Get(filePath.toStdString());
+    if (probe && probe->duration != AV_NOPTS_VALUE) {
+        // Duration is in AV_TIME_BASE units (microseconds)
+        qint64 durationMs = (probe->duration * 1000) / AV_TIME_BASE;
+        videoDuration = durationMs;
+        timelineSlider->setRange(0, durationMs);
+        endTimeDisplayLabel->setText(FormatTime(durationMs));
+
+        // Set default end time to video duration
+        endTime = durationMs;
+        endTimeEdit->setTime(QTime::fromMSecsSinceStartOfDay(durationMs));
+
+        UpdateDurationLabel();
     }
 
     // Load video in player (deferred to avoid blocking)
@@ -351,10 +349,7 @@ void CutVideoPage::OnVideoPlayerDurationChanged(qint64 duration) {
     // Set default end time to video duration
     if (endTime == 0) {
         endTime = duration;
-        int hours = (duration / 1000) / 3600;
-        int minutes = ((duration / 1000) % 3600) / 60;
-        int seconds = (duration / 1000) % 60;
-        endTimeEdit->setTime(QTime(hours, minutes, seconds));
+        endTimeEdit->setTime(QTime::fromMSecsSinceStartOfDay(duration));
     }
 
     UpdateDurationLabel();
@@ -374,29 +369,23 @@ void CutVideoPage::OnTimelineSliderMoved(int position) {
 }
 
 void CutVideoPage::OnStartTimeChanged(const QTime &time) {
-    startTime = (time.hour() * 3600 + time.minute() * 60 + time.second()) * 1000;
+    startTime = time.msecsSinceStartOfDay();
     UpdateDurationLabel();
 }
 
 void CutVideoPage::OnEndTimeChanged(const QTime &time) {
-    endTime = (time.hour() * 3600 + time.minute() * 60 + time.second()) * 1000;
+    endTime = time.msecsSinceStartOfDay();
     UpdateDurationLabel();
 }
 
 void CutVideoPage::OnSetStartClicked() {
     qint64 currentPos = videoPlayer->GetPosition();
-    int hours = (currentPos / 1000) / 3600;
-    int minutes = ((currentPos / 1000) % 3600) / 60;
-    int seconds = (currentPos / 1000) % 60;
-    startTimeEdit->setTime(QTime(hours, minutes, seconds));
+    startTimeEdit->setTime(QTime::fromMSecsSinceStartOfDay(currentPos));
 }
 
 void CutVideoPage::OnSetEndClicked() {
     qint64 currentPos = videoPlayer->GetPosition();
-    int hours = (currentPos / 1000) / 3600;
-    int minutes = ((currentPos / 1000) % 3600) / 60;
-    int seconds = (currentPos / 1000) % 60;
-    endTimeEdit->setTime(QTime(hours, minutes, seconds));
+    endTimeEdit->setTime(QTime::fromMSecsSinceStartOfDay(currentPos));
 }
 
 void CutVideoPage::UpdateDurationLabel() {
@@ -454,6 +443,8 @@ void CutVideoPage::OnCutClicked() {
 
     // Use copy mode for fast cutting (no re-encoding)
     // Leave video and audio codec empty to copy streams
+    // Smart cut re-encodes the partial GOPs at the cut points only
+    encodeParam->SetSmartCut(smartCutCheckBox->isChecked());
 
     // Show progress bar
     progressBar->setValue(0);
@@ -552,6 +543,9 @@ void CutVideoPage::RetranslateUi() {
     endTimeLabel->setText(tr("End Time:"));
     setEndButton->setText(tr("Set from Player"));
     cutDurationLabel->setText(tr("Cut Duration:"));
+    smartCutCheckBox->setText(tr("Frame-accurate cut (smart cut)"));
+    smartCutCheckBox->setToolTip(tr("Re-encode only the frames around the cut points "
+                                    "and copy everything in between"));
 
     // Update dynamic duration values
     UpdateDurationLabel();
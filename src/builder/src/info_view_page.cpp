@@ -19,17 +19,27 @@
 #include "../include/open_converter.h"
 #include "../include/shared_data.h"
 #include "../../common/include/info.h"
+#include "../../common/include/media_analyzer.h"
+#include <QDebug>
 #include <QFileDialog>
 #include <QHBoxLayout>
 #include <QMessageBox>
+#include <QThread>
+
+// what a probe thread hands back to the page
+struct ProbeResult {
+    QuickInfo quickInfo;
+    int ret = 0;
+    bool complete = false;
+};
 
 InfoViewPage::InfoViewPage(QWidget *parent) : BasePage(parent) {
-    info = new Info();
     SetupUI();
 }
 
 InfoViewPage::~InfoViewPage() {
-    delete info;
+    CancelProbe();
+    CancelAnalysis();
 }
 
 QString InfoViewPage::GetPageTitle() const {
@@ -141,11 +151,54 @@ void InfoViewPage::SetupUI() {
 
     mainLayout->addWidget(audioGroupBox);
 
+    // Deep Analysis Group, reads every packet on demand
+    analysisGroupBox = new QGroupBox(tr("Deep Analysis"), this);
+    QGridLayout *analysisLayout = new QGridLayout(analysisGroupBox);
+    analysisLayout->setColumnStretch(1, 1);
+
+    deepAnalyzeButton = new QPushButton(tr("Analyze Packets"), this);
+    decodeCheckBox = new QCheckBox(tr("Decode frames"), this);
+    analysisStatusLabel = new QLabel("-", this);
+    avgBitRateLabel = new QLabel(tr("Average Bit Rate:"), this);
+    avgBitRateValue = new QLabel("-", this);
+    peakBitRateLabel = new QLabel(tr("Peak Bit Rate:"), this);
+    peakBitRateValue = new QLabel("-", this);
+    gopLabel = new QLabel(tr("GOP Length:"), this);
+    gopValue = new QLabel("-", this);
+    keyIntervalLabel = new QLabel(tr("Keyframe Interval:"), this);
+    keyIntervalValue = new QLabel("-", this);
+    bFramesLabel = new QLabel(tr("B-Frames:"), this);
+    bFramesValue = new QLabel("-", this);
+    framesLabel = new QLabel(tr("Decoded Frames:"), this);
+    framesValue = new QLabel("-", this);
+
+    QHBoxLayout *analysisButtonLayout = new QHBoxLayout();
+    analysisButtonLayout->addWidget(deepAnalyzeButton);
+    analysisButtonLayout->addWidget(decodeCheckBox);
+    analysisButtonLayout->addWidget(analysisStatusLabel, 1);
+
+    analysisLayout->addLayout(analysisButtonLayout, 0, 0, 1, 2);
+    analysisLayout->addWidget(avgBitRateLabel, 1, 0);
+    analysisLayout->addWidget(avgBitRateValue, 1, 1);
+    analysisLayout->addWidget(peakBitRateLabel, 2, 0);
+    analysisLayout->addWidget(peakBitRateValue, 2, 1);
+    analysisLayout->addWidget(gopLabel, 3, 0);
+    analysisLayout->addWidget(gopValue, 3, 1);
+    analysisLayout->addWidget(keyIntervalLabel, 4, 0);
+    analysisLayout->addWidget(keyIntervalValue, 4, 1);
+    analysisLayout->addWidget(bFramesLabel, 5, 0);
+    analysisLayout->addWidget(bFramesValue, 5, 1);
+    analysisLayout->addWidget(framesLabel, 6, 0);
+    analysisLayout->addWidget(framesValue, 6, 1);
+
+    mainLayout->addWidget(analysisGroupBox);
+
     // Add stretch to push everything to the top
     mainLayout->addStretch();
 
     // Connect signals
     connect(browseButton, &QPushButton::clicked, this, &InfoViewPage::OnBrowseButtonClicked);
+    connect(deepAnalyzeButton, &QPushButton::clicked, this, &InfoViewPage::OnDeepAnalyzeClicked);
 
     setLayout(mainLayout);
 }
@@ -184,14 +237,15 @@ void InfoViewPage::AnalyzeFile(const QString &filePath) {
         return;
     }
 
-    QByteArray ba = filePath.toLocal8Bit();
-    char *src = ba.data();
-
-    // Get info by analyzing the file
-    info->send_info(src);
-
-    // Display info
-    DisplayInfo(info->get_quick_info());
+    // The header is read first so the page fills in at once, the streams
+    // are analyzed afterwards. Both run off the UI thread.
+    CancelProbe();
+    CancelAnalysis();
+    ClearInfo();
+    ClearAnalysis();
+    probeCancel = std::make_shared<std::atomic<bool>>(false);
+    probeTimer.start();
+    StartProbe(filePath, false);
 
     // Update shared input file path
     OpenConverter *mainWindow = qobject_cast<OpenConverter *>(window());
@@ -200,12 +254,161 @@ void InfoViewPage::AnalyzeFile(const QString &filePath) {
     }
 }
 
+void InfoViewPage::StartProbe(const QString &filePath, bool deep) {
+    std::shared_ptr<std::atomic<bool>> cancel = probeCancel;
+    std::shared_ptr<ProbeResult> result = std::make_shared<ProbeResult>();
+    std::string path = filePath.toLocal8Bit().toStdString();
+
+    QThread *thread = QThread::create([path, deep, cancel, result]() {
+        Info info;
+        result->ret = info.probe_info(path.c_str(), deep, cancel.get());
+        result->quickInfo = *info.get_quick_info();
+        result->complete = info.is_complete();
+    });
+    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
+    connect(thread, &QThread::finished, this, [this, filePath, deep, cancel, result]() {
+        // another file was picked meanwhile
+        if (cancel != probeCancel || *cancel) {
+            return;
+        }
+        // the full probe may still read a file whose header did not parse
+        if (result->ret < 0 && !deep) {
+            StartProbe(filePath, true);
+            return;
+        }
+
+        DisplayInfo(&result->quickInfo);
+        if (result->ret < 0) {
+            qDebug() << "Probe of" << filePath << "failed after" << probeTimer.elapsed() << "ms";
+            return;
+        }
+        qDebug() << (deep ? "Full" : "Header") << "info of" << filePath << "shown after"
+                 << probeTimer.elapsed() << "ms";
+        if (!result->complete) {
+            StartProbe(filePath, true);
+        }
+    });
+    thread->start();
+}
+
+void InfoViewPage::CancelProbe() {
+    if (probeCancel) {
+        *probeCancel = true;
+        probeCancel.reset();
+    }
+}
+
+void InfoViewPage::OnDeepAnalyzeClicked() {
+    QString filePath = filePathLineEdit->text();
+    if (filePath.isEmpty()) {
+        QMessageBox::warning(this, "Warning", "Please select a media file first.");
+        return;
+    }
+
+    CancelAnalysis();
+    ClearAnalysis();
+    analysisCancel = std::make_shared<std::atomic<bool>>(false);
+    deepAnalyzeButton->setEnabled(false);
+    analysisStatusLabel->setText(tr("Analyzing..."));
+
+    std::shared_ptr<std::atomic<bool>> cancel = analysisCancel;
+    std::shared_ptr<MediaAnalysis> analysis = std::make_shared<MediaAnalysis>();
+    std::shared_ptr<int> ret = std::make_shared<int>(0);
+    std::string path = filePath.toLocal8Bit().toStdString();
+    MediaAnalyzerOptions options;
+    options.decode = decodeCheckBox->isChecked();
+
+    QThread *thread = QThread::create([path, options, cancel, analysis, ret]() {
+        MediaAnalyzer analyzer(options);
+        *ret = analyzer.Analyze(path, analysis.get(), cancel.get());
+    });
+    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
+    connect(thread, &QThread::finished, this, [this, cancel, analysis, ret]() {
+        // another file was picked meanwhile
+        if (cancel != analysisCancel || *cancel) {
+            return;
+        }
+        deepAnalyzeButton->setEnabled(true);
+        if (*ret < 0) {
+            analysisStatusLabel->setText(tr("Analysis failed"));
+            return;
+        }
+        DisplayAnalysis(*analysis);
+    });
+    thread->start();
+}
+
+void InfoViewPage::CancelAnalysis() {
+    if (analysisCancel) {
+        *analysisCancel = true;
+        analysisCancel.reset();
+    }
+    deepAnalyzeButton->setEnabled(true);
+}
+
+void InfoViewPage::DisplayAnalysis(const MediaAnalysis &analysis) {
+    const StreamAnalysis *video = NULL;
+    const StreamAnalysis *audio = NULL;
+
+    for (const StreamAnalysis &stream : analysis.streams) {
+        if (stream.index == shownVideoIdx) {
+            video = &stream;
+        } else if (stream.index == shownAudioIdx) {
+            audio = &stream;
+        }
+    }
+    analysisStatusLabel->setText(tr("Done in %1 s").arg(analysis.elapsed, 0, 'f', 2));
+
+    // the bit rates are those of the video, or of the audio in a sound file
+    const StreamAnalysis *shown = video ? video : audio;
+    if (shown) {
+        avgBitRateValue->setText(FormatBitrate((int64_t)shown->averageBitrate));
+        peakBitRateValue->setText(FormatBitrate((int64_t)shown->peakBitRate));
+    }
+    if (!video) {
+        return;
+    }
+
+    if (video->keyframes > 0) {
+        gopValue->setText(QString("%1 / %2 / %3 frames (min / avg / max)")
+                              .arg(video->gopMin)
+                              .arg(video->gopAverage, 0, 'f', 1)
+                              .arg(video->gopMax));
+    }
+    if (video->keyframes > 1) {
+        keyIntervalValue->setText(QString("%1 s (max %2 s)")
+                                      .arg(video->keyframeInterval, 0, 'f', 2)
+                                      .arg(video->keyframeIntervalMax, 0, 'f', 2));
+    }
+    bFramesValue->setText(video->hasBFrames ? tr("Yes") : tr("No"));
+    if (video->decodedFrames > 0) {
+        framesValue->setText(QString("%1 (I %2, P %3, B %4)")
+                                 .arg(video->decodedFrames)
+                                 .arg(video->iFrames)
+                                 .arg(video->pFrames)
+                                 .arg(video->bFrames));
+    }
+}
+
+void InfoViewPage::ClearAnalysis() {
+    analysisStatusLabel->setText("-");
+    avgBitRateValue->setText("-");
+    peakBitRateValue->setText("-");
+    gopValue->setText("-");
+    keyIntervalValue->setText("-");
+    bFramesValue->setText("-");
+    framesValue->setText("-");
+}
+
 void InfoViewPage::DisplayInfo(QuickInfo *quickInfo) {
     if (!quickInfo) {
         ClearInfo();
         return;
     }
 
+    shownVideoIdx = quickInfo->videoIdx;
+    shownAudioIdx = quickInfo->audioIdx;
+
     // Video info
     if (quickInfo->videoIdx >= 0) {
         videoStreamValue->setText(QString::number(quickInfo->videoIdx));
@@ -244,6 +447,8 @@ void InfoViewPage::DisplayInfo(QuickInfo *quickInfo) {
 }
 
 void InfoViewPage::ClearInfo() {
+    shownVideoIdx = -1;
+    shownAudioIdx = -1;
     videoStreamValue->setText("-");
     widthValue->setText("-");
     heightValue->setText("-");
@@ -305,4 +510,14 @@ void InfoViewPage::RetranslateUi() {
     channelsLabel->setText(tr("Channels:"));
     sampleFmtLabel->setText(tr("Sample Format:"));
     sampleRateLabel->setText(tr("Sample Rate:"));
+
+    analysisGroupBox->setTitle(tr("Deep Analysis"));
+    deepAnalyzeButton->setText(tr("Analyze Packets"));
+    decodeCheckBox->setText(tr("Decode frames"));
+    avgBitRateLabel->setText(tr("Average Bit Rate:"));
+    peakBitRateLabel->setText(tr("Peak Bit Rate:"));
+    gopLabel->setText(tr("GOP Length:"));
+    keyIntervalLabel->setText(tr("Keyframe Interval:"));
+    bFramesLabel->setText(tr("B-Frames:"));
+    framesLabel->setText(tr("Decoded Frames:"));
 }
@@ -19,12 +19,15 @@
 #include "../include/open_converter.h"
 #include "../include/shared_data.h"
 #include "../../common/include/encode_parameter.h"
+#include "../../common/include/probe_cache.h"
 #include "../../common/include/process_parameter.h"
 #include "../../engine/include/converter.h"
+#include <QDebug>
 #include <QFileDialog>
 #include <QFileInfo>
 #include <QGridLayout>
 #include <QHBoxLayout>
+#include <QMap>
 #include <QMessageBox>
 
 extern "C" {
@@ -38,6 +41,7 @@ RemuxPage::RemuxPage(QWidget *parent) : BasePage(parent) {
 }
 
 RemuxPage::~RemuxPage() {
+    CancelProbe();
 }
 
 void RemuxPage::OnPageActivated() {
@@ -245,6 +249,14 @@ void RemuxPage::OnRemuxClicked() {
 
     // Empty codec names mean copy streams without re-encoding
     // This is the standard way to perform remuxing
+    // Unchecked streams are dropped, the checked ones are copied as they are
+    for (const StreamInfo &stream : streams) {
+        StreamRule rule;
+        rule.index = stream.index;
+        rule.action = stream.checkbox && stream.checkbox->isChecked()
+                          ? STREAM_ACTION_COPY : STREAM_ACTION_DROP;
+        encodeParam->AddStreamRule(rule);
+    }
 
     // Show progress bar
     progressBar->setValue(0);
@@ -335,38 +347,85 @@ void RemuxPage::UpdateOutputPath() {
 }
 
 void RemuxPage::AnalyzeStreams(const QString &filePath) {
+    CancelProbe();
     ClearStreams();
 
     if (filePath.isEmpty()) {
         return;
     }
 
-    AVFormatContext *formatCtx = nullptr;
-    QByteArray ba = filePath.toLocal8Bit();
+    QLabel *analyzingLabel = new QLabel(tr("Analyzing streams..."), streamsContainer);
+    analyzingLabel->setStyleSheet("color: gray; font-style: italic;");
+    streamsLayout->addWidget(analyzingLabel);
+    streamsLayout->addStretch();
+
+    // The streams listed in the header show up at once, the list is
+    // refined once the packets are analyzed. Both run off the UI thread.
+    probeCancel = std::make_shared<std::atomic<bool>>(false);
+    probeTimer.start();
+    StartProbe(filePath, false);
+}
 
-    // Open input file
-    if (avformat_open_input(&formatCtx, ba.data(), nullptr, nullptr) < 0) {
-        QLabel *errorLabel = new QLabel("Error: Could not open file", streamsContainer);
-        errorLabel->setStyleSheet("color: red;");
-        streamsLayout->addWidget(errorLabel);
-        streamsLayout->addStretch();
-        return;
+void RemuxPage::StartProbe(const QString &filePath, bool deep) {
+    std::shared_ptr<std::atomic<bool>> cancel = probeCancel;
+    // the probe is shared with the other pages and the transcoder
+    std::shared_ptr<std::shared_ptr<const MediaProbe>> result =
+        std::make_shared<std::shared_ptr<const MediaProbe>>();
+    std::string path = filePath.toStdString();
+
+    QThread *thread = QThread::create([path, deep, cancel, result]() {
+        *result = deep ? ProbeCache::Instance().Get(path, NULL, cancel.get())
+                       : ProbeCache::Instance().GetHeader(path, NULL, cancel.get());
+    });
+    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
+    connect(thread, &QThread::finished, this, [this, filePath, deep, cancel, result]() {
+        // another file was picked meanwhile
+        if (cancel != probeCancel || *cancel) {
+            return;
+        }
+        std::shared_ptr<const MediaProbe> probe = *result;
+        // streams only found in the packets need the full probe
+        if (!deep && (!probe || (!probe->complete && probe->streams.empty()))) {
+            StartProbe(filePath, true);
+            return;
+        }
+        if (!probe) {
+            ClearStreams();
+            QLabel *errorLabel = new QLabel("Error: Could not find stream information", streamsContainer);
+            errorLabel->setStyleSheet("color: red;");
+            streamsLayout->addWidget(errorLabel);
+            streamsLayout->addStretch();
+            return;
+        }
+
+        ShowStreams(*probe);
+        qDebug() << (deep ? "Full" : "Header") << "streams of" << filePath << "shown after"
+                 << probeTimer.elapsed() << "ms";
+        if (!probe->complete) {
+            StartProbe(filePath, true);
+        }
+    });
+    thread->start();
+}
+
+void RemuxPage::CancelProbe() {
+    if (probeCancel) {
+        *probeCancel = true;
+        probeCancel.reset();
     }
+}
 
-    // Retrieve stream information
-    if (avformat_find_stream_info(formatCtx, nullptr) < 0) {
-        QLabel *errorLabel = new QLabel("Error: Could not find stream information", streamsContainer);
-        errorLabel->setStyleSheet("color: red;");
-        streamsLayout->addWidget(errorLabel);
-        streamsLayout->addStretch();
-        avformat_close_input(&formatCtx);
-        return;
+void RemuxPage::ShowStreams(const MediaProbe &probe) {
+    QMap<int, bool> checked;
+    for (const StreamInfo &streamInfo : streams) {
+        checked[streamInfo.index] = streamInfo.checkbox->isChecked();
     }
+    ClearStreams();
 
     // Iterate through all streams
-    for (unsigned int i = 0; i < formatCtx->nb_streams; i++) {
-        AVStream *stream = formatCtx->streams[i];
-        AVCodecParameters *codecpar = stream->codecpar;
+    for (size_t i = 0; i < probe.streams.size(); i++) {
+        const ProbedStream &stream = probe.streams[i];
+        AVCodecParameters *codecpar = stream.codecpar;
 
         StreamInfo streamInfo;
         streamInfo.index = i;
@@ -381,8 +440,8 @@ void RemuxPage::AnalyzeStreams(const QString &filePath) {
             if (codecpar->bit_rate > 0) {
                 detailsList << FormatBitrate(codecpar->bit_rate);
             }
-            if (stream->r_frame_rate.num > 0 && stream->r_frame_rate.den > 0) {
-                double fps = (double)stream->r_frame_rate.num / stream->r_frame_rate.den;
+            if (stream.rFrameRate.num > 0 && stream.rFrameRate.den > 0) {
+                double fps = (double)stream.rFrameRate.num / stream.rFrameRate.den;
                 detailsList << QString("%1 fps").arg(fps, 0, 'f', 2);
             }
         } else if (codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
@@ -408,16 +467,14 @@ void RemuxPage::AnalyzeStreams(const QString &filePath) {
         }
 
         streamInfo.checkbox = new QCheckBox(checkboxText, streamsContainer);
-        streamInfo.checkbox->setChecked(true);  // Select all streams by default
+        // Select all streams by default, a refined probe keeps the choice
+        streamInfo.checkbox->setChecked(checked.value(streamInfo.index, true));
 
         streamsLayout->addWidget(streamInfo.checkbox);
         streams.append(streamInfo);
     }
 
     streamsLayout->addStretch();
-
-    // Close the format context
-    avformat_close_input(&formatCtx);
 }
 
 void RemuxPage::ClearStreams() {
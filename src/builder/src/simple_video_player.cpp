@@ -56,10 +56,9 @@ bool SimpleVideoPlayer::LoadVideo(const QString &filePath) {
         return false;
     }
 
-    // Retrieve stream information (limit analysis to avoid blocking)
-    // Set max_analyze_duration to reduce blocking time
-    formatCtx->max_analyze_duration = 5 * AV_TIME_BASE; // 5 seconds max
-    if (avformat_find_stream_info(formatCtx, nullptr) < 0) {
+    // Retrieve stream information, a file the pages already probed is not
+    // analyzed again
+    if (ProbeCache::Instance().FindStreamInfo(formatCtx, filePath.toStdString()) < 0) {
         qDebug() << "Failed to find stream info";
         CloseVideo();
         return false;
@@ -144,6 +143,8 @@ bool SimpleVideoPlayer::LoadVideo(const QString &filePath) {
 
     isLoaded = true;
     currentPositionMs = 0;
+    videoPath = filePath;
+    LoadPacketIndex();
 
     // Decode and display first frame in a deferred manner to avoid blocking
     QTimer::singleShot(0, this, [this]() {
@@ -153,6 +154,28 @@ bool SimpleVideoPlayer::LoadVideo(const QString &filePath) {
     return true;
 }
 
+void SimpleVideoPlayer::LoadPacketIndex() {
+    if (packetIndex.Load(videoPath.toStdString()) >= 0) {
+        return;
+    }
+
+    // Build the sidecar off the UI thread, the thread shares no state with
+    // the player and the index is mapped once it is stored
+    QString path = videoPath;
+    QThread *thread = QThread::create([path]() {
+        PacketIndex index;
+        index.Open(path.toStdString());
+    });
+    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
+    connect(thread, &QThread::finished, this, [this, path]() {
+        QMutexLocker locker(&mutex);
+        if (isLoaded && videoPath == path) {
+            packetIndex.Load(path.toStdString());
+        }
+    });
+    thread->start();
+}
+
 void SimpleVideoPlayer::Play() {
     if (!isLoaded || isPlaying) {
         return;
@@ -187,8 +210,11 @@ void SimpleVideoPlayer::Seek(qint64 positionMs) {
     AVStream *videoStream = formatCtx->streams[videoStreamIndex];
     int64_t timestamp = av_rescale_q(positionMs, AVRational{1, 1000}, videoStream->time_base);
 
-    // Seek to position (use stream index for more accurate seeking)
-    if (av_seek_frame(formatCtx, videoStreamIndex, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+    // Seek to position (use stream index for more accurate seeking), the
+    // packet index lands directly on the keyframe before the target
+    if ((!packetIndex.IsLoaded() ||
+         packetIndex.SeekToKeyframe(formatCtx, videoStreamIndex, timestamp) < 0) &&
+        av_seek_frame(formatCtx, videoStreamIndex, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
         qDebug() << "Seek failed to position:" << positionMs;
         return;
     }
@@ -309,6 +335,8 @@ void SimpleVideoPlayer::CloseVideo() {
 
     isPlaying = false;
     isLoaded = false;
+    videoPath.clear();
+    packetIndex.Close();
 
     if (swsCtx) {
         sws_freeContext(swsCtx);
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef ASYNCWRITER_H
+#define ASYNCWRITER_H
+
+extern "C" {
+#include <libavformat/avio.h>
+};
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "bounded_queue.h"
+
+#define ASYNC_WRITER_BUFFER_SIZE (4 << 20)
+#define ASYNC_WRITER_BUFFER_COUNT 4
+
+typedef struct AsyncWriterOptions {
+    int bufferSize = ASYNC_WRITER_BUFFER_SIZE;    // bytes per write buffer
+    int bufferCount = ASYNC_WRITER_BUFFER_COUNT;  // buffers in flight
+    int64_t preallocate = 0;   // expected file size in bytes, 0 to skip
+    int64_t syncInterval = 0;  // fdatasync after this many bytes, 0 never
+} AsyncWriterOptions;
+
+// Write-behind output file for the muxers. Full AVIO buffers are handed to a
+// dedicated thread that writes them at their file offset, so the encode and
+// mux threads only block on disk once every buffer is in flight. Seeks and
+// reads wait for the queued writes. The path "-" writes to stdout through a
+// non-seekable context. Platforms without pwrite get a plain avio_open2()
+// context instead.
+class AsyncWriter {
+public:
+    static int Open(AVIOContext **pb, const std::string &path,
+                    const AsyncWriterOptions &options);
+
+    // flush, wait for the writer and close, returns the first write error.
+    // Contexts that were not opened by Open() are passed to avio_closep().
+    static int Close(AVIOContext **pb);
+
+private:
+    struct Block {
+        uint8_t *data;
+        int size;
+        int64_t offset;
+    };
+
+    explicit AsyncWriter(const AsyncWriterOptions &options);
+    ~AsyncWriter();
+
+#if OC_FFMPEG_VERSION >= 70
+    static int write_packet(void *opaque, const uint8_t *buf, int size);
+#else
+    static int write_packet(void *opaque, uint8_t *buf, int size);
+#endif
+    static int read_packet(void *opaque, uint8_t *buf, int size);
+    static int64_t seek(void *opaque, int64_t offset, int whence);
+
+    int start(const std::string &path);
+    int finish();
+    int submit(const uint8_t *buf, int size);
+    void drain();
+    void writer_loop();
+
+    AsyncWriterOptions options;
+    int fd = -1;
+    bool stream = false;  // stdout, no seeking
+    std::thread writer;
+    BoundedQueue<Block *> pending;
+    BoundedQueue<Block *> idle;  // recycled buffers, bounds the memory use
+    std::mutex mutex;
+    std::condition_variable written;
+    int inFlight = 0;
+    std::atomic<int> error{0};
+    int64_t position = 0;  // where the next write lands
+    int64_t end = 0;       // size of the file once everything is written
+};
+
+#endif // ASYNCWRITER_H
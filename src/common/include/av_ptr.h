@@ -0,0 +1,52 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef AVPTR_H
+#define AVPTR_H
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+#include <libavutil/frame.h>
+};
+
+#include <memory>
+
+// Move-only owners of the FFmpeg structs, each one frees its struct with the
+// matching free function. get() hands the struct to the C API, release()
+// gives up ownership.
+
+struct AVPacketDeleter {
+    void operator()(AVPacket *pkt) const { av_packet_free(&pkt); }
+};
+
+struct AVFrameDeleter {
+    void operator()(AVFrame *frame) const { av_frame_free(&frame); }
+};
+
+struct AVCodecContextDeleter {
+    void operator()(AVCodecContext *ctx) const { avcodec_free_context(&ctx); }
+};
+
+struct AVFilterGraphDeleter {
+    void operator()(AVFilterGraph *graph) const { avfilter_graph_free(&graph); }
+};
+
+typedef std::unique_ptr<AVPacket, AVPacketDeleter> PacketPtr;
+typedef std::unique_ptr<AVFrame, AVFrameDeleter> FramePtr;
+typedef std::unique_ptr<AVCodecContext, AVCodecContextDeleter> CodecContextPtr;
+typedef std::unique_ptr<AVFilterGraph, AVFilterGraphDeleter> FilterGraphPtr;
+
+#endif // AVPTR_H
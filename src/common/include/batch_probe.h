@@ -0,0 +1,61 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+
+#ifndef BATCHPROBE_H
+#define BATCHPROBE_H
+
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "probe_cache.h"
+
+#define BATCH_PROBE_QUEUE_SIZE 1024  // paths found ahead of the workers
+
+typedef struct BatchProbeOptions {
+    int jobs = 0;  // probing threads, 0 for one per core
+} BatchProbeOptions;
+
+typedef struct BatchProbeStats {
+    int64_t files = 0;
+    int64_t failed = 0;
+    double elapsed = 0;  // in seconds
+} BatchProbeStats;
+
+// Probes files and directory trees on a pool of workers and writes one
+// JSON line per file. The trees are walked on the calling thread while the
+// workers probe what was found so far. Lines come out in completion order.
+class BatchProbe {
+public:
+    explicit BatchProbe(const BatchProbeOptions &options);
+
+    void Run(const std::vector<std::string> &paths, std::ostream &out, BatchProbeStats *stats);
+
+    // the JSON line of a file, error is the AVERROR of a failed probe
+    static std::string ToJson(const std::string &path, const MediaProbe *probe, int error);
+
+private:
+    void worker_loop(std::ostream *out, BatchProbeStats *stats);
+
+    BatchProbeOptions options;
+    BoundedQueue<std::string> queue;
+    std::mutex outMutex;  // serializes the lines and the counters
+};
+
+#endif // BATCHPROBE_H
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// Fixed capacity FIFO used to connect the stages of a processing pipeline.
+// Producers block while the queue is full, consumers block while it is empty.
+// Items are moved in and out as-is, ownership of pointers travels with them.
+template <typename T> class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity ? capacity : 1) {}
+
+    // Blocks until there is room. Returns false if the queue was closed or
+    // aborted, in which case the caller still owns the item.
+    bool Push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] {
+            return aborted || closed || items.size() < capacity;
+        });
+        if (aborted || closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Non-blocking push for producers that must never wait. Returns false
+    // if the queue is full, closed or aborted.
+    bool TryPush(T item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (aborted || closed || items.size() >= capacity) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Blocks until an item is available. Returns false once the queue is
+    // closed and drained, or as soon as it is aborted.
+    bool Pop(T &item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return aborted || closed || !items.empty(); });
+        if (aborted || items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    // Non-blocking pop, also works after Abort() so the owner can release
+    // whatever was left behind.
+    bool TryPop(T &item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    // No more items will be pushed, consumers drain what is queued.
+    void Close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+    // Wake up every waiter and make all further Push/Pop calls fail.
+    void Abort() {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborted = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+    size_t Size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+    size_t Capacity() const { return capacity; }
+
+private:
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+    bool aborted = false;
+};
+
+#endif // BOUNDEDQUEUE_H
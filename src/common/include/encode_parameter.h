@@ -20,6 +20,33 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
+
+enum StreamAction {
+    STREAM_ACTION_AUTO,      // transcode when a codec is set, copy otherwise
+    STREAM_ACTION_COPY,
+    STREAM_ACTION_TRANSCODE,
+    STREAM_ACTION_DROP
+};
+
+// Selects input streams for an action. Empty/negative fields match any
+// stream, the first rule matching a stream decides what happens to it.
+struct StreamRule {
+    int index = -1;
+    std::string type;      // "video", "audio", "subtitle", "data", "attachment"
+    std::string language;  // ISO 639-2 code from the stream metadata
+    StreamAction action = STREAM_ACTION_AUTO;
+};
+
+// Extra output of an ABR ladder job. It is encoded from the same decoded
+// frames as the main output and only differs in size and video bit rate,
+// zero keeps the source size or the default rate control.
+struct Rendition {
+    std::string outputPath;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    int64_t videoBitRate = 0;
+};
 
 class EncodeParameter {
 private:
@@ -42,6 +69,38 @@ private:
     double startTime;  // in seconds
     double endTime;    // in seconds
 
+    // re-encode only around the cut points and copy the rest of the video
+    bool smartCut;
+
+    int chunkCount;           // > 1 splits the input for parallel encoding
+    double minChunkDuration;  // in seconds
+
+    // -1 keeps the library default, 0 lets FFmpeg pick from the core count
+    int decoderThreads;
+    int encoderThreads;
+    int filterThreads;
+    std::string decoderThreadType;  // "frame", "slice" or empty for default
+    std::string encoderThreadType;
+
+    // output file I/O, zero keeps the defaults
+    int outputBufferSize;        // in bytes
+    int64_t outputSyncInterval;  // fdatasync after this many bytes
+    bool outputPreallocate;
+    int64_t inputReadahead;  // bytes prefetched ahead of the demuxer
+
+    std::string outputFormat;  // muxer name, empty guesses from the path
+    double fragmentDuration;   // in seconds, > 0 writes fragmented MP4
+
+    // HLS and DASH packaging
+    double segmentDuration;       // in seconds, 0 for the default
+    std::string playlistType;     // "vod", "event" or "live"
+    std::string segmentTemplate;  // segment file names, empty for the default
+    std::string segmentType;      // HLS segments, "mpegts" or "fmp4"
+
+    std::vector<StreamRule> streamRules;
+
+    std::vector<Rendition> renditions;
+
 public:
     EncodeParameter();
     ~EncodeParameter();
@@ -70,6 +129,50 @@ public:
 
     void SetEndTime(double t);
 
+    void SetSmartCut(bool enable);
+
+    void SetChunkCount(int n);
+
+    void SetMinChunkDuration(double t);
+
+    void SetDecoderThreads(int n);
+
+    void SetEncoderThreads(int n);
+
+    void SetFilterThreads(int n);
+
+    void SetDecoderThreadType(std::string type);
+
+    void SetEncoderThreadType(std::string type);
+
+    void SetOutputBufferSize(int size);
+
+    void SetOutputSyncInterval(int64_t bytes);
+
+    void SetOutputPreallocate(bool enable);
+
+    void SetInputReadahead(int64_t bytes);
+
+    void SetOutputFormat(std::string format);
+
+    void SetFragmentDuration(double t);
+
+    void SetSegmentDuration(double t);
+
+    void SetPlaylistType(std::string type);
+
+    void SetSegmentTemplate(std::string name);
+
+    void SetSegmentType(std::string type);
+
+    void AddStreamRule(StreamRule rule);
+
+    void ClearStreamRules();
+
+    void AddRendition(Rendition rendition);
+
+    void ClearRenditions();
+
     std::string get_video_codec_name();
 
     int get_qscale();
@@ -91,6 +194,46 @@ public:
     double GetStartTime();
 
     double GetEndTime();
+
+    bool GetSmartCut();
+
+    int GetChunkCount();
+
+    double GetMinChunkDuration();
+
+    int GetDecoderThreads();
+
+    int GetEncoderThreads();
+
+    int GetFilterThreads();
+
+    std::string GetDecoderThreadType();
+
+    std::string GetEncoderThreadType();
+
+    int GetOutputBufferSize();
+
+    int64_t GetOutputSyncInterval();
+
+    bool GetOutputPreallocate();
+
+    int64_t GetInputReadahead();
+
+    std::string GetOutputFormat();
+
+    double GetFragmentDuration();
+
+    double GetSegmentDuration();
+
+    std::string GetPlaylistType();
+
+    std::string GetSegmentTemplate();
+
+    std::string GetSegmentType();
+
+    std::vector<StreamRule> GetStreamRules();
+
+    std::vector<Rendition> GetRenditions();
 };
 
 #endif // ENCODEPARAMETER_H
@@ -27,6 +27,8 @@ extern "C" {
 #include <libavutil/pixdesc.h>
 };
 
+#include "probe_cache.h"
+
 // store some info of video and audio
 typedef struct QuickInfo {
     // video
@@ -67,14 +69,10 @@ public:
 private:
     void print_error(const char *msg, int ret);
 
-    AVFormatContext *avCtx;
-
-    const AVCodec *audioCodec;
-
-    AVCodecContext *audioCtx;
-
     QuickInfo *quickInfo;
 
+    bool complete;
+
     char errorMsg[128];
 public:
     // init quick info
@@ -83,6 +81,13 @@ public:
     QuickInfo *get_quick_info();
     // send the info to front-end
     void send_info(char *src);
+    // Fill the quick info from a header-only probe, or from the full probe
+    // when deep is set. Returns AVERROR_EXIT once cancel is raised.
+    int probe_info(const char *src, bool deep, const std::atomic<bool> *cancel);
+    // fill the quick info from a probe the caller already has
+    void fill_info(const MediaProbe &probe);
+    // whether the last probe analyzed the packets
+    bool is_complete();
 };
 
 #endif // INFO_H
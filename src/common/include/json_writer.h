@@ -0,0 +1,56 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Streaming writer of compact JSON, one value after the other. Keys and
+// commas are placed by the writer, the caller only has to nest correctly.
+// Non-finite doubles are written as null.
+class JsonWriter {
+public:
+    JsonWriter &BeginObject();
+    JsonWriter &EndObject();
+    JsonWriter &BeginArray();
+    JsonWriter &EndArray();
+
+    // name of the next value inside an object
+    JsonWriter &Key(const std::string &name);
+
+    JsonWriter &String(const std::string &value);
+    JsonWriter &Int(int64_t value);
+    JsonWriter &Double(double value);
+    JsonWriter &Bool(bool value);
+    JsonWriter &Null();
+
+    const std::string &GetString() const { return out; }
+    void Clear();
+
+private:
+    void separate();
+    void escape(const std::string &value);
+
+    std::string out;
+    std::vector<bool> empty;  // per open container, nothing written yet
+    bool afterKey = false;
+};
+
+#endif // JSONWRITER_H
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+
+#ifndef LOGSINK_H
+#define LOGSINK_H
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "bounded_queue.h"
+
+#define LOG_SINK_QUEUE_SIZE 4096
+
+// Background writer for the FFmpeg log and the progress channel. Producers
+// only render their text and queue it, the sink thread does the blocking
+// writes to the terminal or the descriptor, so a transcode never waits on a
+// slow console. When the queue is full only droppable text (verbose and
+// debug messages) is dropped, everything else waits for room so errors and
+// the last progress line always arrive.
+class LogSink {
+public:
+    static LogSink &Instance();
+
+    // Route av_log() through the sink thread. Messages above level are
+    // dropped before they are formatted. Only the first call after startup
+    // starts the thread, later calls just change the level.
+    void Start(int level);
+
+    // write out what is queued and give av_log() its default callback back
+    void Stop();
+
+    // queue text for fd, written in place when the sink is not running
+    void Write(int fd, std::string text, bool droppable = false);
+
+    // FFmpeg level names (quiet, error, warning, info, debug, ...) or a number
+    static bool ParseLevel(const std::string &name, int *level);
+
+private:
+    struct Record {
+        int fd;
+        std::string text;
+    };
+
+    LogSink() : queue(LOG_SINK_QUEUE_SIZE) {}
+
+    static void log_callback(void *avcl, int level, const char *fmt, va_list vl);
+    static void write_all(int fd, const std::string &text);
+    void sink_loop();
+
+    BoundedQueue<Record> queue;
+    std::thread sink;
+    std::atomic<bool> running{false};
+    std::atomic<bool> started{false};
+    std::atomic<int64_t> dropped{0};
+};
+
+#endif // LOGSINK_H
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef MAPPEDREADER_H
+#define MAPPEDREADER_H
+
+extern "C" {
+#include <libavformat/avformat.h>
+};
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define MAPPED_READER_BUFFER_SIZE (256 << 10)
+
+typedef struct MappedReaderOptions {
+    // bytes to prefetch ahead of the read position, 0 leaves it to the kernel
+    int64_t readahead = 0;
+} MappedReaderOptions;
+
+// Input of a local file served from a read-only memory mapping, the demuxer
+// copies straight from the page cache instead of issuing small reads. The
+// mapping is advised as sequential and prefetched as the reader advances.
+// Pipes, devices, URLs and platforms without mmap open the usual way. A file
+// is read up to its size at open, data appended later is not seen. When
+// another process truncates it, the reads past the new end fail with EIO
+// instead of raising SIGBUS.
+class MappedReader {
+public:
+    // drop-in for avformat_open_input() on a path
+    static int OpenInput(AVFormatContext **fmtCtx, const std::string &path,
+                         const MappedReaderOptions &options);
+
+    // drop-in for avformat_close_input(), also unmaps the file
+    static void CloseInput(AVFormatContext **fmtCtx);
+
+private:
+    MappedReader() = default;
+    ~MappedReader();
+
+    static int read_packet(void *opaque, uint8_t *buf, int size);
+    static int64_t seek(void *opaque, int64_t offset, int whence);
+
+    int map(const std::string &path);
+    void prefetch();
+
+    MappedReaderOptions options;
+    const uint8_t *data = NULL;
+    size_t length = 0;
+    size_t position = 0;
+    size_t prefetched = 0;  // end of the range already advised WILLNEED
+};
+
+#endif // MAPPEDREADER_H
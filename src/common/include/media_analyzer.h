@@ -0,0 +1,110 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+
+#ifndef MEDIAANALYZER_H
+#define MEDIAANALYZER_H
+
+extern "C" {
+#include <libavformat/avformat.h>
+};
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#define ANALYZER_SIZE_BUCKETS 24  // the last bucket takes 8 MiB and more
+#define ANALYZER_LUMA_BINS 32
+#define ANALYZER_QUEUE_SIZE 32    // packets queued per decoder
+
+typedef struct MediaAnalyzerOptions {
+    double bitrateWindow = 1.0;  // length of the sliding bitrate window in seconds
+    bool decode = false;         // decode the video for frame types and luma
+    bool keyframesOnly = false;  // decode the keyframes only, much faster
+    int decoderThreads = 0;      // 0 lets FFmpeg decide
+} MediaAnalyzerOptions;
+
+typedef struct StreamAnalysis {
+    int index = -1;
+    AVMediaType type = AVMEDIA_TYPE_UNKNOWN;
+    std::string codec;
+
+    int64_t packets = 0;
+    int64_t bytes = 0;
+    double duration = 0;        // seconds covered by the packets
+    double averageBitrate = 0;  // bits per second
+    double peakBitrate = 0;     // busiest window
+    // packet counts by size, bucket i holds [2^i, 2^(i+1)) bytes
+    std::vector<int64_t> sizeHistogram;
+
+    // video GOP structure, counted in decode order
+    int64_t keyframes = 0;
+    int gopMin = 0;
+    int gopMax = 0;
+    double gopAverage = 0;
+    std::map<int, int64_t> gopLengths;  // packets per GOP -> GOPs
+    double keyframeInterval = 0;        // average seconds between keyframes
+    double keyframeIntervalMax = 0;
+    int64_t reorderedPackets = 0;  // presented before an earlier decoded packet
+    bool hasBFrames = false;
+
+    // only filled when decoding
+    int64_t decodedFrames = 0;
+    int64_t iFrames = 0;
+    int64_t pFrames = 0;
+    int64_t bFrames = 0;
+    std::vector<int64_t> lumaHistogram;  // luma samples in ANALYZER_LUMA_BINS bins
+} StreamAnalysis;
+
+typedef struct MediaAnalysis {
+    std::string path;
+    std::string formatName;
+    int64_t size = 0;     // in bytes
+    double duration = 0;  // in seconds
+    double bitrate = 0;   // of the whole file
+    double elapsed = 0;   // seconds the analysis took
+    std::vector<StreamAnalysis> streams;
+} MediaAnalysis;
+
+// Deep analysis of a media file, reads every packet for the real bitrate,
+// the GOP structure and the packet sizes. Video is optionally decoded on a
+// worker thread per stream, using the decoder's own threads, while the
+// packets are still being read.
+class MediaAnalyzer {
+public:
+    explicit MediaAnalyzer(const MediaAnalyzerOptions &options);
+
+    // returns AVERROR_EXIT once cancel is raised, a read error ends the
+    // input like EOF and the result covers the packets read before it
+    int Analyze(const std::string &path, MediaAnalysis *analysis,
+                const std::atomic<bool> *cancel = NULL);
+
+    static std::string ToJson(const MediaAnalysis &analysis);
+
+private:
+    struct StreamState;
+
+    void count_packet(StreamState *state, const AVPacket *pkt);
+    void finish_stream(StreamState *state);
+    int open_decoder(StreamState *state, const AVStream *st);
+    static void decode_loop(StreamState *state);
+    static void count_frame(StreamState *state, const AVFrame *frame);
+
+    MediaAnalyzerOptions options;
+};
+
+#endif // MEDIAANALYZER_H
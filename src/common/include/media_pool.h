@@ -0,0 +1,89 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef MEDIAPOOL_H
+#define MEDIAPOOL_H
+
+#include "av_ptr.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+};
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+// requests served before this count as warm-up in the statistics
+#define MEDIA_POOL_WARMUP 256
+
+// Per-job recycler for the AVPacket/AVFrame structs that travel through the
+// transcode pipeline, plus AVBufferPool backed packet data for encoders.
+// Decoded and filtered frame data already comes from the pools inside
+// libavcodec/libavfilter, so only the structs are recycled for frames.
+// All methods may be called from any thread.
+class MediaPool {
+public:
+    MediaPool();
+    ~MediaPool();
+
+    AVPacket *GetPacket();
+    // unrefs the packet and keeps it for reuse, sets *pkt to NULL
+    void ReleasePacket(AVPacket **pkt);
+
+    AVFrame *GetFrame();
+    // unrefs the frame and keeps it for reuse, sets *frame to NULL
+    void ReleaseFrame(AVFrame **frame);
+
+    // Make the encoder allocate its output packets from a buffer pool of
+    // this object. Only codecs with AV_CODEC_CAP_DR1 support it, returns
+    // false for the others. Must be called before avcodec_open2().
+    bool AttachEncoder(AVCodecContext *enc_ctx);
+
+    // print the allocation counters through av_log()
+    void LogStats();
+
+private:
+    struct Counters {
+        int requests = 0;
+        int allocations = 0;
+        int steadyAllocations = 0; // allocations after the warm-up
+        int inUse = 0;
+        int peakInUse = 0;
+    };
+
+    struct BufferPool {
+        AVBufferPool *pool = NULL;
+        size_t size = 0;
+        int resizes = 0;
+    };
+
+    static int get_encode_buffer(AVCodecContext *ctx, AVPacket *pkt, int flags);
+    AVBufferRef *get_buffer(AVCodecContext *ctx, size_t size);
+
+    static void count_request(Counters &c, bool allocated);
+
+    std::mutex mutex;
+    std::vector<PacketPtr> freePackets;
+    std::vector<FramePtr> freeFrames;
+    std::map<AVCodecContext *, BufferPool> bufferPools;
+    Counters packets;
+    Counters frames;
+    Counters buffers;
+};
+
+#endif // MEDIAPOOL_H
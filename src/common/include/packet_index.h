@@ -0,0 +1,130 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef PACKETINDEX_H
+#define PACKETINDEX_H
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/rational.h>
+};
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define PACKET_INDEX_MAGIC "OCPKTIDX"
+#define PACKET_INDEX_VERSION 1
+
+// bytes of sidecars kept in a cache directory, the least recently used ones
+// beyond it are removed whenever a new sidecar is stored
+#define PACKET_INDEX_CACHE_LIMIT (512LL << 20)
+
+// one demuxed packet, timestamps are in the time base of its stream
+typedef struct PacketIndexEntry {
+    int64_t pts;
+    int64_t dts;
+    int64_t pos;  // byte offset in the file, -1 if unknown
+    int32_t size;
+    uint16_t streamIndex;
+    uint16_t flags;  // AV_PKT_FLAG_*
+} PacketIndexEntry;
+
+// Packet table of a media file built in a single demux pass and cached in a
+// sidecar file, keyed by path, size and modification time. The sidecar is
+// memory-mapped on load so lookups cost no parsing. An index is immutable
+// once loaded and may be shared between threads.
+class PacketIndex {
+public:
+    PacketIndex();
+    ~PacketIndex();
+
+    // load the cached index of the file, returns AVERROR(ENOENT) if there is
+    // none or it is stale
+    int Load(const std::string &mediaPath);
+
+    // load the cached index, or build it with one pass over the file and
+    // store it for the next time
+    int Open(const std::string &mediaPath);
+
+    void Close();
+
+    bool IsLoaded() const { return base != NULL; }
+
+    int GetStreamCount() const;
+    AVRational GetTimeBase(int stream) const;
+    // pts + duration of the last packet of the stream
+    int64_t GetEndPts(int stream) const;
+
+    // packets of the stream in file order
+    const PacketIndexEntry *GetEntries(int stream, size_t *count) const;
+    // keyframes of the stream sorted by pts
+    const PacketIndexEntry *GetKeyframes(int stream, size_t *count) const;
+
+    // last keyframe with pts <= ts (stream time base), NULL if there is none
+    const PacketIndexEntry *FindKeyframe(int stream, int64_t ts) const;
+
+    // keyframe times in seconds, computed as pts * av_q2d(time_base)
+    std::vector<double> GetKeyframeTimes(int stream) const;
+
+    // Position fmtCtx on the last keyframe of the stream at or before ts.
+    // Formats that can seek by byte jump to the recorded offset, the others
+    // seek to the exact keyframe timestamp so the demuxer needs no search.
+    int SeekToKeyframe(AVFormatContext *fmtCtx, int stream, int64_t ts) const;
+
+    // where the sidecar of a media file is stored
+    static std::string GetSidecarPath(const std::string &mediaPath);
+
+    // remove the least recently used sidecars of dir until they take at most
+    // limit bytes, keep is never removed
+    static void PruneCache(const std::string &dir, uint64_t limit,
+                           const std::string &keep = "");
+
+private:
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t streamCount;
+        uint64_t fileSize;
+        int64_t mtime;
+        uint64_t pathLength;  // the media path follows the header
+    };
+
+    struct StreamHeader {
+        int32_t timeBaseNum;
+        int32_t timeBaseDen;
+        int64_t endPts;
+        uint64_t entryOffset;  // in entries from the start of the table
+        uint64_t entryCount;
+        uint64_t keyOffset;
+        uint64_t keyCount;
+    };
+
+    int map_file(const std::string &sidecarPath);
+    int validate(const std::string &mediaPath);
+    static int build(const std::string &mediaPath, const std::string &sidecarPath);
+    static int file_key(const std::string &mediaPath, uint64_t *size, int64_t *mtime);
+
+    const uint8_t *base = NULL;
+    size_t length = 0;
+    const StreamHeader *streams = NULL;
+    const PacketIndexEntry *table = NULL;
+#ifdef _WIN32
+    std::vector<uint8_t> data;  // no mmap, the sidecar is read in one go
+#endif
+};
+
+#endif // PACKETINDEX_H
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PHASEHOOK_H
+#define PHASEHOOK_H
+
+#include <atomic>
+#include <cstddef>
+
+enum TranscodePhase {
+    PHASE_IDLE = 0,  // no job, or between jobs
+    PHASE_OPEN,      // open the input and the outputs
+    PHASE_PREPARE,   // plan the streams, open the codecs, write the headers
+    PHASE_LOOP,      // demux to mux until the input ends
+    PHASE_FLUSH,     // the input ended, the decoders and encoders drain
+    PHASE_TRAILER,   // write the trailers and close the output files
+    PHASE_CLOSE,     // free everything the job allocated
+    PHASE_COUNT
+};
+
+// Tells a profiling tool which phase the running job is in, so it can
+// account process wide costs like heap usage to the phases. Only the top
+// level job reports, chunk and smart cut workers run inside its loop phase.
+// With no callback set a phase change costs one relaxed load.
+class PhaseHook {
+public:
+    typedef void (*Callback)(TranscodePhase phase, void *opaque);
+
+    // NULL removes the callback, it must not be changed while a job runs
+    static void Set(Callback callback, void *opaque);
+
+    static void Enter(TranscodePhase phase) {
+        Callback cb = callback.load(std::memory_order_relaxed);
+        if (cb)
+            cb(phase, opaque);
+    }
+
+    static const char *Name(TranscodePhase phase);
+
+private:
+    static std::atomic<Callback> callback;
+    static void *opaque;
+};
+
+#endif // PHASEHOOK_H
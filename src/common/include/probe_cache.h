@@ -0,0 +1,144 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef PROBECACHE_H
+#define PROBECACHE_H
+
+extern "C" {
+#include <libavformat/avformat.h>
+};
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define PROBE_CACHE_SIZE 64
+
+typedef struct ProbeLimits {
+    int64_t probeSize = 0;        // bytes read to find the streams, 0 for the default
+    int64_t analyzeDuration = 0;  // in AV_TIME_BASE units, 0 for the default
+} ProbeLimits;
+
+// one stream as avformat_find_stream_info() left it
+typedef struct ProbedStream {
+    AVCodecParameters *codecpar;
+    AVRational timeBase;
+    AVRational avgFrameRate;
+    AVRational rFrameRate;
+    int64_t startTime;
+    int64_t duration;
+    int64_t nbFrames;
+    int disposition;
+    std::map<std::string, std::string> metadata;
+} ProbedStream;
+
+// Stream layout of a probed file. Immutable once built and shared between
+// the pages, the player and the transcoder.
+class MediaProbe {
+public:
+    MediaProbe() = default;
+    ~MediaProbe();
+    MediaProbe(const MediaProbe &) = delete;
+    MediaProbe &operator=(const MediaProbe &) = delete;
+
+    // snapshot of an opened input after avformat_find_stream_info()
+    static std::shared_ptr<MediaProbe> FromContext(const AVFormatContext *fmtCtx);
+
+    // index of the stream of the type a player would pick, -1 if none
+    int FindBestStream(AVMediaType type) const;
+
+    // Restore the probed parameters on a freshly opened input of the same
+    // file so avformat_find_stream_info() can be skipped. Returns false and
+    // leaves the context alone when its header does not match the probe.
+    bool Apply(AVFormatContext *fmtCtx) const;
+
+    std::string formatName;
+    int64_t startTime = AV_NOPTS_VALUE;
+    int64_t duration = AV_NOPTS_VALUE;  // in AV_TIME_BASE units
+    int64_t bitRate = 0;
+    bool complete = true;  // false for a header-only probe
+    std::vector<ProbedStream> streams;
+};
+
+// Process-wide cache of probed files keyed by path, size and modification
+// time. A file dropped into the GUI is probed once, every page and the
+// transcoder reuse the result until the file changes on disk. Thread-safe.
+class ProbeCache {
+public:
+    static ProbeCache &Instance();
+
+    // limits of the probes run from now on, drops the cached results
+    void SetLimits(const ProbeLimits &limits);
+    ProbeLimits GetLimits();
+
+    // the cached probe of the file, the file is opened and probed on a miss.
+    // NULL with *error set if it cannot be probed, AVERROR_EXIT once cancel
+    // is raised.
+    std::shared_ptr<const MediaProbe> Get(const std::string &path, int *error = NULL,
+                                          const std::atomic<bool> *cancel = NULL);
+
+    // What the demuxer knows from the header alone, streams it only finds
+    // in the packets are missing. Returns the cached probe when there is
+    // one, header-only results are never cached.
+    std::shared_ptr<const MediaProbe> GetHeader(const std::string &path, int *error = NULL,
+                                                const std::atomic<bool> *cancel = NULL);
+
+    // Probe the file with the configured limits, bypassing the cache. For
+    // passes that see every file once and would only evict the entries the
+    // GUI and the transcoder reuse.
+    std::shared_ptr<const MediaProbe> Probe(const std::string &path, int *error = NULL,
+                                            const std::atomic<bool> *cancel = NULL);
+
+    // the cached probe without probing, NULL on a miss or a stale entry
+    std::shared_ptr<const MediaProbe> Find(const std::string &path);
+
+    // Drop-in for avformat_find_stream_info() on an input opened from path,
+    // restores a cached probe when there is one and stores a new one
+    // otherwise. The configured limits apply.
+    int FindStreamInfo(AVFormatContext *fmtCtx, const std::string &path);
+
+    void Clear();
+
+private:
+    struct Entry {
+        uint64_t size;
+        int64_t mtime;
+        std::shared_ptr<const MediaProbe> probe;
+        std::list<std::string>::iterator age;
+    };
+
+    ProbeCache() = default;
+
+    static bool file_key(const std::string &path, std::string *key, uint64_t *size,
+                         int64_t *mtime);
+    void store(const std::string &key, uint64_t size, int64_t mtime,
+               std::shared_ptr<const MediaProbe> probe);
+    void apply_limits(AVFormatContext *fmtCtx);
+    static int open_input(AVFormatContext **fmtCtx, const std::string &path,
+                          const std::atomic<bool> *cancel);
+    static int interrupt_cb(void *opaque);
+
+    std::mutex mutex;
+    ProbeLimits limits;
+    std::map<std::string, Entry> entries;
+    std::list<std::string> ages;  // most recently used first
+};
+
+#endif // PROBECACHE_H
@@ -18,11 +18,15 @@
 #ifndef PROCESSOBSERVER_H
 #define PROCESSOBSERVER_H
 
+#include "transcode_stats.h"
+
 class ProcessObserver {
 public:
     virtual ~ProcessObserver() = default;
     virtual void on_process_update(double progress) = 0;
     virtual void on_time_update(double timeRequired) = 0;
+    // live counters of the running job, at the rate of the progress updates
+    virtual void on_stats_update(const TranscodeStats &stats) {}
 };
 
 #endif // PROCESSOBSERVER_H
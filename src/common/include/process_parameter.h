@@ -33,6 +33,7 @@ public:
     void set_time_required(double timeRequired);
     double get_time_required();
     ProcessParameter get_process_parmeter();
+    void set_stats(const TranscodeStats &stats);
 
     // Observer management
     void add_observer(ProcessObserver* observer);
@@ -45,6 +46,7 @@ private:
 
     void notify_process_update(double progress);
     void notify_time_update(double timeRequired);
+    void notify_stats_update(const TranscodeStats &stats);
 };
 
 #endif // PROCESSPARAMETER_H
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROGRESSREPORTER_H
+#define PROGRESSREPORTER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+typedef struct ProgressOptions {
+    int fd = -1;                // descriptor of the channel, -1 disables it
+    std::string format = "kv";  // "kv" for key=value lines, "json" for JSON lines
+    double interval = 0.5;      // seconds between two lines
+} ProgressOptions;
+
+typedef struct ProgressSample {
+    int64_t done = 0;
+    int64_t total = 0;
+    double percent = 0;
+    double elapsed = 0;      // seconds since the first update
+    double remaining = 0;    // estimated seconds left
+    std::string state;       // continue, end or failed
+} ProgressSample;
+
+// Machine-readable progress of the running conversion. The transcoders call
+// Update() as often as they like, a line goes out at most once per interval
+// and a last one from Finish(). Lines are written by the LogSink thread.
+class ProgressReporter {
+public:
+    static ProgressReporter &Instance();
+
+    void Configure(const ProgressOptions &options);
+    bool Enabled() const { return enabled; }
+
+    void Update(int64_t done, int64_t total, double remaining);
+    void Finish(bool ok);
+
+    // one line of the channel, newline included
+    static std::string Format(const std::string &format, const ProgressSample &sample);
+
+private:
+    ProgressReporter() = default;
+
+    void emit(ProgressSample &sample, std::chrono::steady_clock::time_point now);
+
+    std::atomic<bool> enabled{false};
+    std::mutex mutex;
+    ProgressOptions options;
+    bool running = false;  // an update was seen since the last Finish()
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point next;
+    int64_t lastDone = 0;
+    int64_t lastTotal = 0;
+};
+
+#endif // PROGRESSREPORTER_H
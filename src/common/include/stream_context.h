@@ -24,27 +24,31 @@ extern "C" {
 
 #define OC_INVALID_STREAM_IDX -1
 
+// Input or output file of a job. It owns the format context and closes it
+// together with its I/O when it goes away, moving hands the context over.
 class StreamContext {
 
 public:
     StreamContext();
     ~StreamContext();
 
+    StreamContext(StreamContext &&other) noexcept;
+    StreamContext &operator=(StreamContext &&other) noexcept;
+    StreamContext(const StreamContext &) = delete;
+    StreamContext &operator=(const StreamContext &) = delete;
+
+    // close the input, or the output writer when it is still open, and free
+    // the format context
+    void Close();
+
     AVFormatContext *fmtCtx;
     const char *filename;
 
     int videoIdx;
     AVStream *videoStream;
-    const AVCodec *videoCodec;
-    AVCodecContext *videoCodecCtx;
 
     int audioIdx;
     AVStream *audioStream;
-    const AVCodec *audioCodec;
-    AVCodecContext *audioCodecCtx;
-
-    AVPacket *pkt;
-    AVFrame *frame;
 };
 
 #endif // STREAMCONTEXT_H
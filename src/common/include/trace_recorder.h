@@ -0,0 +1,85 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// events kept per thread, later ones are counted and dropped
+#define TRACE_EVENTS_PER_CHUNK 16384
+#define TRACE_MAX_CHUNKS 64
+
+typedef struct TraceEvent {
+    const char *name;  // string literal, never copied
+    int stream;        // input stream or -1
+    int64_t start;     // TranscodeCounters::Now() nanoseconds
+    int64_t end;
+} TraceEvent;
+
+// Opt-in recorder of timed pipeline events, written out in the Chrome trace
+// format for chrome://tracing and Perfetto. Every thread appends to its own
+// buffer without locks or atomics on the hot path, a thread only takes the
+// registry lock once to register its buffer. A disabled recorder costs one
+// relaxed load per event.
+class TraceRecorder {
+public:
+    static TraceRecorder &Instance();
+
+    static bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // drop what was recorded and start recording
+    void Start();
+
+    // label of the calling thread in the trace, index -1 for none
+    void SetThreadName(const char *name, int index = -1);
+
+    void Record(const char *name, int stream, int64_t start, int64_t end);
+
+    // Stop recording and write the trace. Every recording thread must have
+    // finished. Returns 0 or a negative errno.
+    int Write(const std::string &path);
+
+private:
+    struct ThreadBuffer {
+        int tid;
+        std::string name;
+        std::vector<std::unique_ptr<TraceEvent[]>> chunks;
+        size_t count = 0;     // events in the chunks
+        int64_t dropped = 0;
+        bool exited = false;  // the thread is gone, freed after the next Write()
+    };
+
+    TraceRecorder() = default;
+
+    ThreadBuffer *thread_buffer();
+    void reset_buffers();
+
+    static std::atomic<bool> enabled;
+
+    std::mutex mutex;  // guards the registry, not the buffers
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    int nextTid = 1;
+    int64_t origin = 0;
+};
+
+#endif // TRACERECORDER_H
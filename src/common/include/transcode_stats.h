@@ -0,0 +1,120 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRANSCODESTATS_H
+#define TRANSCODESTATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// input streams with their own counters, later streams are not counted
+#define TRANSCODE_STATS_MAX_STREAMS 64
+
+enum TranscodeStage {
+    STAGE_DEMUX = 0,
+    STAGE_DECODE,
+    STAGE_FILTER,
+    STAGE_ENCODE,
+    STAGE_MUX,
+    STAGE_COUNT
+};
+
+enum StreamCounter {
+    COUNTER_PACKETS_READ = 0,
+    COUNTER_BYTES_READ,
+    COUNTER_FRAMES_DECODED,
+    COUNTER_FRAMES_FILTERED,
+    COUNTER_PACKETS_ENCODED,
+    COUNTER_PACKETS_WRITTEN,
+    COUNTER_BYTES_WRITTEN,
+    COUNTER_COUNT
+};
+
+typedef struct StreamStats {
+    int index = -1;  // input stream
+    std::string type;
+    bool copied = false;
+    int64_t counters[COUNTER_COUNT] = {};  // indexed by StreamCounter
+} StreamStats;
+
+// What a job cost and where the time went. Stage times are the seconds
+// spent inside the FFmpeg calls of the stage summed over its threads, the
+// waits on the pipeline queues are not included.
+typedef struct TranscodeStats {
+    bool ok = false;
+    double wallTime = 0;       // seconds
+    double userTime = 0;       // CPU seconds of the process during the job
+    double systemTime = 0;
+    int64_t peakRss = 0;       // bytes, high-water mark of the process
+    double mediaDuration = 0;  // seconds of media written
+    double speed = 0;          // media seconds per wall clock second
+    double stages[STAGE_COUNT] = {};
+    std::vector<StreamStats> streams;
+} TranscodeStats;
+
+// Live counters of a running job. The pipeline threads add to them without
+// locking, a snapshot can be taken from any thread at any time.
+class TranscodeCounters {
+public:
+    TranscodeCounters() { Reset(); }
+
+    // steady clock in nanoseconds, the start argument of AddBusy()
+    static int64_t Now();
+
+    // clear everything and restart the wall clock, not while a job runs
+    void Reset();
+
+    void SetStream(int index, const char *type, bool copied);
+
+    // time since the start of a call, returns the end of the call
+    int64_t AddBusy(TranscodeStage stage, int64_t since) {
+        int64_t now = Now();
+        stages[stage].fetch_add(now - since, std::memory_order_relaxed);
+        return now;
+    }
+    void Add(int index, StreamCounter counter, int64_t value) {
+        if (index >= 0 && index < TRANSCODE_STATS_MAX_STREAMS)
+            streams[index].values[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+    // position reached in the output, in microseconds
+    void SetMediaTime(int64_t time) { mediaTime.store(time, std::memory_order_relaxed); }
+
+    // stage times, stream counters, elapsed wall time and speed so far
+    void Snapshot(TranscodeStats *stats) const;
+
+    // CPU times and peak RSS of the process, left alone where unsupported
+    static void ReadResourceUsage(TranscodeStats *stats);
+
+    static const char *StageName(TranscodeStage stage);
+    static std::string ToJson(const TranscodeStats &stats);
+
+private:
+    struct Stream {
+        std::atomic<const char *> type{NULL};  // NULL until the stream is used
+        std::atomic<bool> copied{false};
+        std::atomic<int64_t> values[COUNTER_COUNT];
+    };
+
+    std::atomic<int64_t> start{0};
+    std::atomic<int64_t> mediaTime{0};
+    std::atomic<int64_t> stages[STAGE_COUNT];
+    Stream streams[TRANSCODE_STATS_MAX_STREAMS];
+};
+
+#endif // TRANSCODESTATS_H
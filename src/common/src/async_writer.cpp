@@ -0,0 +1,317 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "../include/async_writer.h"
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+};
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <set>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// contexts handed out by Open(), Close() tells them from avio_open2() ones
+static std::mutex registry_mutex;
+static std::set<AVIOContext *> registry;
+
+AsyncWriter::AsyncWriter(const AsyncWriterOptions &options)
+    : options(options), pending(options.bufferCount), idle(options.bufferCount) {}
+
+AsyncWriter::~AsyncWriter() {
+    Block *block;
+    while (idle.TryPop(block)) {
+        av_free(block->data);
+        delete block;
+    }
+    while (pending.TryPop(block)) {
+        av_free(block->data);
+        delete block;
+    }
+}
+
+int AsyncWriter::Open(AVIOContext **pb, const std::string &path,
+                      const AsyncWriterOptions &options) {
+#ifdef _WIN32
+    return avio_open2(pb, path == "-" ? "pipe:1" : path.c_str(), AVIO_FLAG_WRITE,
+                      NULL, NULL);
+#else
+    AsyncWriterOptions opts = options;
+    AsyncWriter *w = NULL;
+    uint8_t *buffer = NULL;
+    int ret;
+
+    // only local files benefit, protocols keep their own I/O
+    if (path.find("://") != std::string::npos && path.compare(0, 7, "file://") != 0)
+        return avio_open2(pb, path.c_str(), AVIO_FLAG_WRITE, NULL, NULL);
+
+    opts.bufferSize = std::max(opts.bufferSize, 4096);
+    opts.bufferCount = std::max(opts.bufferCount, 2);
+    w = new AsyncWriter(opts);
+    if ((ret = w->start(path.compare(0, 7, "file://") == 0 ? path.substr(7) : path)) < 0)
+        goto fail;
+
+    buffer = (uint8_t *)av_malloc(opts.bufferSize);
+    if (!buffer) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    *pb = avio_alloc_context(buffer, opts.bufferSize, 1, w,
+                             w->stream ? NULL : read_packet, write_packet,
+                             w->stream ? NULL : seek);
+    if (!*pb) {
+        av_free(buffer);
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    (*pb)->seekable = w->stream ? 0 : AVIO_SEEKABLE_NORMAL;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.insert(*pb);
+    }
+    return 0;
+
+fail:
+    w->finish();
+    delete w;
+    return ret;
+#endif
+}
+
+int AsyncWriter::Close(AVIOContext **pb) {
+    AsyncWriter *w;
+    int ret;
+
+    if (!pb || !*pb)
+        return 0;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        if (!registry.erase(*pb))
+            return avio_closep(pb);
+    }
+
+    w = (AsyncWriter *)(*pb)->opaque;
+    avio_flush(*pb);
+    ret = w->finish();
+    if (ret >= 0 && (*pb)->error < 0)
+        ret = (*pb)->error;
+    av_freep(&(*pb)->buffer);
+    avio_context_free(pb);
+    delete w;
+    if (ret < 0)
+        av_log(NULL, AV_LOG_ERROR, "Failed to write output file\n");
+    return ret;
+}
+
+#ifndef _WIN32
+int AsyncWriter::start(const std::string &path) {
+    Block *block;
+
+    if (path == "-") {
+        // stdout, written in order and never sought
+        stream = true;
+        options.preallocate = 0;
+        options.syncInterval = 0;
+        fd = dup(STDOUT_FILENO);
+    } else {
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    }
+    if (fd < 0)
+        return AVERROR(errno);
+
+#ifdef __linux__
+    // reserve the extents up front so the file does not fragment while it
+    // grows, KEEP_SIZE leaves the visible size alone if the estimate is off
+    if (options.preallocate > 0 &&
+        fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, options.preallocate) < 0)
+        av_log(NULL, AV_LOG_DEBUG, "Output preallocation unsupported, errno %d\n", errno);
+#endif
+
+    for (int i = 0; i < options.bufferCount; i++) {
+        block = new Block();
+        block->data = (uint8_t *)av_malloc(options.bufferSize);
+        if (!block->data) {
+            delete block;
+            return AVERROR(ENOMEM);
+        }
+        idle.Push(block);
+    }
+
+    writer = std::thread(&AsyncWriter::writer_loop, this);
+    return 0;
+}
+
+int AsyncWriter::finish() {
+    pending.Close();
+    if (writer.joinable())
+        writer.join();
+    if (fd < 0)
+        return error;
+
+    // give the unused preallocated extents back
+    if (options.preallocate > end && ftruncate(fd, end) < 0 && !error)
+        error = AVERROR(errno);
+    if (options.syncInterval > 0) {
+#ifdef __APPLE__
+        if (fsync(fd) < 0 && !error)
+#else
+        if (fdatasync(fd) < 0 && !error)
+#endif
+            error = AVERROR(errno);
+    }
+    if (close(fd) < 0 && !error)
+        error = AVERROR(errno);
+    fd = -1;
+    return error;
+}
+
+void AsyncWriter::writer_loop() {
+    int64_t unsynced = 0;
+    Block *block;
+
+    while (pending.Pop(block)) {
+        const uint8_t *data = block->data;
+        int64_t offset = block->offset;
+        int left = block->size;
+
+        while (left > 0 && !error) {
+            ssize_t n = stream ? write(fd, data, left) : pwrite(fd, data, left, offset);
+            if (n < 0) {
+                if (errno != EINTR)
+                    error = AVERROR(errno);
+                continue;
+            }
+            data += n;
+            offset += n;
+            left -= n;
+        }
+
+        unsynced += block->size;
+        if (options.syncInterval > 0 && unsynced >= options.syncInterval && !error) {
+#ifdef __APPLE__
+            if (fsync(fd) < 0)
+#else
+            if (fdatasync(fd) < 0)
+#endif
+                error = AVERROR(errno);
+            unsynced = 0;
+        }
+
+        idle.Push(block);
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight--;
+        written.notify_all();
+    }
+}
+
+int AsyncWriter::submit(const uint8_t *buf, int size) {
+    Block *block;
+
+    while (size > 0) {
+        if (error)
+            return error;
+        // waits for the writer once every buffer is queued
+        if (!idle.Pop(block))
+            return AVERROR(EIO);
+        block->size = std::min(size, options.bufferSize);
+        block->offset = position;
+        memcpy(block->data, buf, block->size);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            inFlight++;
+        }
+        pending.Push(block);
+
+        position += block->size;
+        end = std::max(end, position);
+        buf += block->size;
+        size -= block->size;
+    }
+    return 0;
+}
+
+void AsyncWriter::drain() {
+    std::unique_lock<std::mutex> lock(mutex);
+    written.wait(lock, [this] { return inFlight == 0; });
+}
+
+#if OC_FFMPEG_VERSION >= 70
+int AsyncWriter::write_packet(void *opaque, const uint8_t *buf, int size) {
+#else
+int AsyncWriter::write_packet(void *opaque, uint8_t *buf, int size) {
+#endif
+    AsyncWriter *w = (AsyncWriter *)opaque;
+    int ret = w->submit(buf, size);
+    return ret < 0 ? ret : size;
+}
+
+int AsyncWriter::read_packet(void *opaque, uint8_t *buf, int size) {
+    AsyncWriter *w = (AsyncWriter *)opaque;
+    ssize_t n;
+
+    // muxers that read back what they wrote need it on disk first
+    w->drain();
+    if (w->error)
+        return w->error;
+    do {
+        n = pread(w->fd, buf, size, w->position);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        return AVERROR(errno);
+    if (n == 0)
+        return AVERROR_EOF;
+    w->position += n;
+    return (int)n;
+}
+
+int64_t AsyncWriter::seek(void *opaque, int64_t offset, int whence) {
+    AsyncWriter *w = (AsyncWriter *)opaque;
+
+    // header rewrites and trailers are rare, keep the file consistent for
+    // anything that reopens it by name
+    w->drain();
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return w->end;
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        offset += w->position;
+        break;
+    case SEEK_END:
+        offset += w->end;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (offset < 0)
+        return AVERROR(EINVAL);
+    w->position = offset;
+    return offset;
+}
+#else
+int AsyncWriter::start(const std::string &path) { return AVERROR(ENOSYS); }
+
+int AsyncWriter::finish() { return 0; }
+#endif
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+
+#include "../include/batch_probe.h"
+#include "../include/info.h"
+#include "../include/json_writer.h"
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+};
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+BatchProbe::BatchProbe(const BatchProbeOptions &options)
+    : options(options), queue(BATCH_PROBE_QUEUE_SIZE) {
+    if (this->options.jobs <= 0)
+        this->options.jobs = std::max(1u, std::thread::hardware_concurrency());
+}
+
+static void write_rational(JsonWriter &json, const char *key, AVRational q) {
+    if (q.num > 0 && q.den > 0)
+        json.Key(key).Double(av_q2d(q));
+}
+
+std::string BatchProbe::ToJson(const std::string &path, const MediaProbe *probe, int error) {
+    JsonWriter json;
+    char buf[128];
+
+    json.BeginObject();
+    json.Key("path").String(path);
+    if (!probe) {
+        av_strerror(error, buf, sizeof(buf));
+        json.Key("error").String(buf);
+        json.EndObject();
+        return json.GetString();
+    }
+
+    json.Key("format").String(probe->formatName);
+    if (probe->duration != AV_NOPTS_VALUE)
+        json.Key("duration").Double(probe->duration / (double)AV_TIME_BASE);
+    if (probe->bitRate > 0)
+        json.Key("bitrate").Int(probe->bitRate);
+
+    // the streams a player picks, as the info page shows them
+    Info info;
+    info.fill_info(*probe);
+    QuickInfo *quickInfo = info.get_quick_info();
+    if (quickInfo->videoIdx >= 0) {
+        json.Key("video").BeginObject();
+        json.Key("index").Int(quickInfo->videoIdx);
+        json.Key("codec").String(quickInfo->videoCodec);
+        json.Key("width").Int(quickInfo->width);
+        json.Key("height").Int(quickInfo->height);
+        json.Key("color_space").String(quickInfo->colorSpace);
+        json.Key("bitrate").Int(quickInfo->videoBitRate);
+        json.Key("frame_rate").Double(quickInfo->frameRate);
+        json.EndObject();
+    }
+    if (quickInfo->audioIdx >= 0) {
+        json.Key("audio").BeginObject();
+        json.Key("index").Int(quickInfo->audioIdx);
+        json.Key("codec").String(quickInfo->audioCodec);
+        json.Key("bitrate").Int(quickInfo->audioBitRate);
+        json.Key("channels").Int(quickInfo->channels);
+        json.Key("sample_fmt").String(quickInfo->sampleFmt);
+        json.Key("sample_rate").Int(quickInfo->sampleRate);
+        json.EndObject();
+    }
+
+    json.Key("streams").BeginArray();
+    for (size_t i = 0; i < probe->streams.size(); i++) {
+        const ProbedStream &s = probe->streams[i];
+        const AVCodecParameters *par = s.codecpar;
+        const char *type = av_get_media_type_string(par->codec_type);
+        const char *profile = avcodec_profile_name(par->codec_id, par->profile);
+
+        json.BeginObject();
+        json.Key("index").Int((int64_t)i);
+        json.Key("type").String(type ? type : "unknown");
+        json.Key("codec").String(avcodec_get_name(par->codec_id));
+        if (profile)
+            json.Key("profile").String(profile);
+        if (par->bit_rate > 0)
+            json.Key("bitrate").Int(par->bit_rate);
+        if (s.duration != AV_NOPTS_VALUE)
+            json.Key("duration").Double(s.duration * av_q2d(s.timeBase));
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+            const char *pixFmt = av_get_pix_fmt_name((AVPixelFormat)par->format);
+            json.Key("width").Int(par->width);
+            json.Key("height").Int(par->height);
+            if (pixFmt)
+                json.Key("pix_fmt").String(pixFmt);
+            write_rational(json, "frame_rate", s.avgFrameRate);
+            if (s.nbFrames > 0)
+                json.Key("frames").Int(s.nbFrames);
+        } else if (par->codec_type == AVMEDIA_TYPE_AUDIO) {
+            const char *sampleFmt = av_get_sample_fmt_name((AVSampleFormat)par->format);
+            json.Key("sample_rate").Int(par->sample_rate);
+            json.Key("channels").Int(par->ch_layout.nb_channels);
+            if (av_channel_layout_describe(&par->ch_layout, buf, sizeof(buf)) > 0)
+                json.Key("channel_layout").String(buf);
+            if (sampleFmt)
+                json.Key("sample_fmt").String(sampleFmt);
+        }
+        for (const char *tag : {"language", "title"}) {
+            auto it = s.metadata.find(tag);
+            if (it != s.metadata.end())
+                json.Key(tag).String(it->second);
+        }
+        json.Key("default").Bool(s.disposition & AV_DISPOSITION_DEFAULT);
+        json.EndObject();
+    }
+    json.EndArray();
+    json.EndObject();
+    return json.GetString();
+}
+
+void BatchProbe::worker_loop(std::ostream *out, BatchProbeStats *stats) {
+    std::string path;
+
+    while (queue.Pop(path)) {
+        int error = 0;
+        // every file is seen once, caching would only evict the entries of
+        // the GUI and the transcoder
+        std::shared_ptr<const MediaProbe> probe = ProbeCache::Instance().Probe(path, &error);
+        std::string line = ToJson(path, probe.get(), error);
+
+        std::lock_guard<std::mutex> lock(outMutex);
+        *out << line << '\n';
+        stats->files++;
+        if (!probe)
+            stats->failed++;
+    }
+}
+
+void BatchProbe::Run(const std::vector<std::string> &paths, std::ostream &out,
+                    BatchProbeStats *stats) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    std::error_code ec;
+    std::error_code entry_ec;
+
+    *stats = BatchProbeStats();
+    for (int i = 0; i < options.jobs; i++)
+        workers.emplace_back(&BatchProbe::worker_loop, this, &out, stats);
+
+    // the workers start on the first files while the trees are still walked
+    for (const std::string &path : paths) {
+        if (!std::filesystem::is_directory(path, ec)) {
+            queue.Push(path);
+            continue;
+        }
+        std::filesystem::recursive_directory_iterator it(
+            path, std::filesystem::directory_options::skip_permission_denied, ec);
+        for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+            // an unreadable entry or a dangling link is skipped, only a
+            // failed step ends the walk
+            if (it->is_regular_file(entry_ec))
+                queue.Push(it->path().string());
+        }
+        if (ec)
+            av_log(NULL, AV_LOG_WARNING, "Could not walk %s: %s\n", path.c_str(),
+                   ec.message().c_str());
+        ec.clear();
+    }
+    queue.Close();
+
+    for (std::thread &worker : workers)
+        worker.join();
+    out.flush();
+    stats->elapsed =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
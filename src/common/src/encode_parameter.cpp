@@ -34,6 +34,30 @@ EncodeParameter::EncodeParameter() {
     startTime = -1.0;
     endTime = -1.0;
 
+    smartCut = false;
+
+    chunkCount = 1;
+    minChunkDuration = 10.0;
+
+    decoderThreads = -1;
+    encoderThreads = -1;
+    filterThreads = -1;
+    decoderThreadType = "";
+    encoderThreadType = "";
+
+    outputBufferSize = 0;
+    outputSyncInterval = 0;
+    outputPreallocate = true;
+    inputReadahead = 0;
+
+    outputFormat = "";
+    fragmentDuration = 0.0;
+
+    segmentDuration = 0.0;
+    playlistType = "";
+    segmentTemplate = "";
+    segmentType = "";
+
     available = false;
 }
 
@@ -131,4 +155,178 @@ double EncodeParameter::GetStartTime() { return startTime; }
 
 double EncodeParameter::GetEndTime() { return endTime; }
 
+void EncodeParameter::SetSmartCut(bool enable) {
+    smartCut = enable;
+    available = true;
+}
+
+bool EncodeParameter::GetSmartCut() { return smartCut; }
+
+void EncodeParameter::SetChunkCount(int n) {
+    if (n < 1) {
+        return;
+    }
+    chunkCount = n;
+    available = true;
+}
+
+void EncodeParameter::SetMinChunkDuration(double t) {
+    if (t <= 0.0) {
+        return;
+    }
+    minChunkDuration = t;
+    available = true;
+}
+
+int EncodeParameter::GetChunkCount() { return chunkCount; }
+
+double EncodeParameter::GetMinChunkDuration() { return minChunkDuration; }
+
+void EncodeParameter::SetDecoderThreads(int n) {
+    if (n < 0) {
+        return;
+    }
+    decoderThreads = n;
+    available = true;
+}
+
+void EncodeParameter::SetEncoderThreads(int n) {
+    if (n < 0) {
+        return;
+    }
+    encoderThreads = n;
+    available = true;
+}
+
+void EncodeParameter::SetFilterThreads(int n) {
+    if (n < 0) {
+        return;
+    }
+    filterThreads = n;
+    available = true;
+}
+
+void EncodeParameter::SetDecoderThreadType(std::string type) {
+    decoderThreadType = type;
+    available = true;
+}
+
+void EncodeParameter::SetEncoderThreadType(std::string type) {
+    encoderThreadType = type;
+    available = true;
+}
+
+int EncodeParameter::GetDecoderThreads() { return decoderThreads; }
+
+int EncodeParameter::GetEncoderThreads() { return encoderThreads; }
+
+int EncodeParameter::GetFilterThreads() { return filterThreads; }
+
+std::string EncodeParameter::GetDecoderThreadType() { return decoderThreadType; }
+
+std::string EncodeParameter::GetEncoderThreadType() { return encoderThreadType; }
+
+void EncodeParameter::SetOutputBufferSize(int size) {
+    if (size < 0) {
+        return;
+    }
+    outputBufferSize = size;
+    available = true;
+}
+
+void EncodeParameter::SetOutputSyncInterval(int64_t bytes) {
+    if (bytes < 0) {
+        return;
+    }
+    outputSyncInterval = bytes;
+    available = true;
+}
+
+void EncodeParameter::SetOutputPreallocate(bool enable) {
+    outputPreallocate = enable;
+    available = true;
+}
+
+int EncodeParameter::GetOutputBufferSize() { return outputBufferSize; }
+
+int64_t EncodeParameter::GetOutputSyncInterval() { return outputSyncInterval; }
+
+bool EncodeParameter::GetOutputPreallocate() { return outputPreallocate; }
+
+void EncodeParameter::SetInputReadahead(int64_t bytes) {
+    if (bytes < 0) {
+        return;
+    }
+    inputReadahead = bytes;
+    available = true;
+}
+
+int64_t EncodeParameter::GetInputReadahead() { return inputReadahead; }
+
+void EncodeParameter::SetOutputFormat(std::string format) {
+    outputFormat = format;
+    available = true;
+}
+
+void EncodeParameter::SetFragmentDuration(double t) {
+    if (t < 0.0) {
+        return;
+    }
+    fragmentDuration = t;
+    available = true;
+}
+
+std::string EncodeParameter::GetOutputFormat() { return outputFormat; }
+
+double EncodeParameter::GetFragmentDuration() { return fragmentDuration; }
+
+void EncodeParameter::SetSegmentDuration(double t) {
+    if (t < 0.0) {
+        return;
+    }
+    segmentDuration = t;
+    available = true;
+}
+
+void EncodeParameter::SetPlaylistType(std::string type) {
+    playlistType = type;
+    available = true;
+}
+
+void EncodeParameter::SetSegmentTemplate(std::string name) {
+    segmentTemplate = name;
+    available = true;
+}
+
+void EncodeParameter::SetSegmentType(std::string type) {
+    segmentType = type;
+    available = true;
+}
+
+double EncodeParameter::GetSegmentDuration() { return segmentDuration; }
+
+std::string EncodeParameter::GetPlaylistType() { return playlistType; }
+
+std::string EncodeParameter::GetSegmentTemplate() { return segmentTemplate; }
+
+std::string EncodeParameter::GetSegmentType() { return segmentType; }
+
+void EncodeParameter::AddStreamRule(StreamRule rule) {
+    streamRules.push_back(rule);
+    available = true;
+}
+
+void EncodeParameter::ClearStreamRules() { streamRules.clear(); }
+
+std::vector<StreamRule> EncodeParameter::GetStreamRules() { return streamRules; }
+
+void EncodeParameter::AddRendition(Rendition rendition) {
+    renditions.push_back(rendition);
+    available = true;
+}
+
+void EncodeParameter::ClearRenditions() { renditions.clear(); }
+
+std::vector<Rendition> EncodeParameter::GetRenditions() { return renditions; }
+
 EncodeParameter::~EncodeParameter() {}
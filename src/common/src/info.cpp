@@ -16,9 +16,7 @@
 #include "../include/info.h"
 
 Info::Info() {
-    avCtx = NULL;
-    audioCodec = NULL;
-    audioCtx = NULL;
+    complete = false;
     quickInfo = new QuickInfo();
     init();
 }
@@ -51,80 +49,69 @@ void Info::print_error(const char *msg, int ret) {
 
 QuickInfo *Info::get_quick_info() { return quickInfo; }
 
-void Info::send_info(char *src) {
+bool Info::is_complete() { return complete; }
+
+void Info::send_info(char *src) { probe_info(src, true, NULL); }
+
+int Info::probe_info(const char *src, bool deep, const std::atomic<bool> *cancel) {
     init();
     int ret = 0;
-    av_log_set_level(AV_LOG_DEBUG);
-    ret = avformat_open_input(&avCtx, src, NULL, NULL);
-    if (ret < 0) {
-        print_error("open failed", ret);
-        goto end;
+    // every page asking about the same file shares one probe
+    std::shared_ptr<const MediaProbe> probe =
+        deep ? ProbeCache::Instance().Get(src, &ret, cancel)
+             : ProbeCache::Instance().GetHeader(src, &ret, cancel);
+    if (!probe) {
+        if (ret != AVERROR_EXIT)
+            print_error("probe failed", ret);
+        return ret;
+    }
+    fill_info(*probe);
+
+    if (quickInfo->videoIdx < 0) {
+        av_log(NULL, AV_LOG_ERROR, "There is no video stream!\n");
     }
-    ret = avformat_find_stream_info(avCtx, NULL);
-    if (ret < 0) {
-        print_error("find stream info failed", ret);
+    if (quickInfo->audioIdx < 0) {
+        av_log(NULL, AV_LOG_ERROR, "There is no audio stream!\n");
     }
+    return 0;
+}
+
+void Info::fill_info(const MediaProbe &probe) {
+    const ProbedStream *video = NULL;
+    const ProbedStream *audio = NULL;
+
+    init();
+    complete = probe.complete;
     // find the video and audio stream from container
-    quickInfo->videoIdx =
-        av_find_best_stream(avCtx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
-    quickInfo->audioIdx =
-        av_find_best_stream(avCtx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    quickInfo->videoIdx = probe.FindBestStream(AVMEDIA_TYPE_VIDEO);
+    quickInfo->audioIdx = probe.FindBestStream(AVMEDIA_TYPE_AUDIO);
 
     if (quickInfo->videoIdx >= 0) {
-        quickInfo->height =
-            avCtx->streams[quickInfo->videoIdx]->codecpar->height;
-        quickInfo->width = avCtx->streams[quickInfo->videoIdx]->codecpar->width;
+        video = &probe.streams[quickInfo->videoIdx];
+        quickInfo->height = video->codecpar->height;
+        quickInfo->width = video->codecpar->width;
 
-        if (avCtx->streams[quickInfo->videoIdx]->codecpar->color_space != AVCOL_SPC_UNSPECIFIED) {
-            quickInfo->colorSpace = av_color_space_name(
-                avCtx->streams[quickInfo->videoIdx]->codecpar->color_space);
+        if (video->codecpar->color_space != AVCOL_SPC_UNSPECIFIED) {
+            quickInfo->colorSpace = av_color_space_name(video->codecpar->color_space);
         }
-        if (avCtx->streams[quickInfo->videoIdx]->codecpar->codec_id != AV_CODEC_ID_NONE)
-            quickInfo->videoCodec = avcodec_get_name(
-                avCtx->streams[quickInfo->videoIdx]->codecpar->codec_id);
-        quickInfo->videoBitRate =
-            avCtx->streams[quickInfo->videoIdx]->codecpar->bit_rate;
-        quickInfo->frameRate =
-            avCtx->streams[quickInfo->videoIdx]->r_frame_rate.num /
-            avCtx->streams[quickInfo->videoIdx]->r_frame_rate.den;
-
-    } else {
-        av_log(avCtx, AV_LOG_ERROR, "There is no video stream!\n");
-        // goto end;
-    }
-
-    if (quickInfo->audioIdx < 0) {
-        av_log(avCtx, AV_LOG_ERROR, "There is no audio stream!\n");
-        goto end;
+        if (video->codecpar->codec_id != AV_CODEC_ID_NONE)
+            quickInfo->videoCodec = avcodec_get_name(video->codecpar->codec_id);
+        quickInfo->videoBitRate = video->codecpar->bit_rate;
+        // a header-only probe may not know the rate yet
+        if (video->rFrameRate.num > 0 && video->rFrameRate.den > 0)
+            quickInfo->frameRate = av_q2d(video->rFrameRate);
     }
 
-    audioCtx = avcodec_alloc_context3(NULL);
-    if (!audioCtx) {
-        av_log(audioCtx, AV_LOG_ERROR,
-               "Could not allocate audio codec context\n");
-        goto end;
+    if (quickInfo->audioIdx >= 0) {
+        audio = &probe.streams[quickInfo->audioIdx];
+        quickInfo->audioCodec = avcodec_get_name(audio->codecpar->codec_id);
+        quickInfo->audioBitRate = audio->codecpar->bit_rate;
+        quickInfo->channels = audio->codecpar->ch_layout.nb_channels;
+        if (audio->codecpar->format != AV_SAMPLE_FMT_NONE)
+            quickInfo->sampleFmt =
+                av_get_sample_fmt_name((AVSampleFormat)audio->codecpar->format);
+        quickInfo->sampleRate = audio->codecpar->sample_rate;
     }
-    // Open the audio codec
-    if (avcodec_parameters_to_context(
-            audioCtx, avCtx->streams[quickInfo->audioIdx]->codecpar) < 0) {
-        av_log(avCtx, AV_LOG_ERROR, "Failed to initialize codec context\n");
-        goto end;
-    }
-
-    quickInfo->audioCodec = avcodec_get_name(
-        avCtx->streams[quickInfo->audioIdx]->codecpar->codec_id);
-    quickInfo->audioBitRate =
-        avCtx->streams[quickInfo->audioIdx]->codecpar->bit_rate;
-    quickInfo->channels =
-        avCtx->streams[quickInfo->audioIdx]->codecpar->ch_layout.nb_channels;
-    quickInfo->sampleFmt = av_get_sample_fmt_name(audioCtx->sample_fmt);
-    quickInfo->sampleRate =
-        avCtx->streams[quickInfo->audioIdx]->codecpar->sample_rate;
-
-end:
-    avformat_close_input(&avCtx);
-
-    avcodec_free_context(&audioCtx);
 }
 
 Info::~Info() {
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../include/json_writer.h"
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+void JsonWriter::separate() {
+    // a value right after its key needs no comma
+    if (afterKey) {
+        afterKey = false;
+        return;
+    }
+    if (!empty.empty()) {
+        if (!empty.back())
+            out += ',';
+        empty.back() = false;
+    }
+}
+
+void JsonWriter::escape(const std::string &value) {
+    char buf[8];
+
+    out += '"';
+    for (unsigned char c : value) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (c < 0x20) {
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            } else {
+                out += (char)c;
+            }
+        }
+    }
+    out += '"';
+}
+
+JsonWriter &JsonWriter::BeginObject() {
+    separate();
+    out += '{';
+    empty.push_back(true);
+    return *this;
+}
+
+JsonWriter &JsonWriter::EndObject() {
+    out += '}';
+    empty.pop_back();
+    return *this;
+}
+
+JsonWriter &JsonWriter::BeginArray() {
+    separate();
+    out += '[';
+    empty.push_back(true);
+    return *this;
+}
+
+JsonWriter &JsonWriter::EndArray() {
+    out += ']';
+    empty.pop_back();
+    return *this;
+}
+
+JsonWriter &JsonWriter::Key(const std::string &name) {
+    separate();
+    escape(name);
+    out += ':';
+    afterKey = true;
+    return *this;
+}
+
+JsonWriter &JsonWriter::String(const std::string &value) {
+    separate();
+    escape(value);
+    return *this;
+}
+
+JsonWriter &JsonWriter::Int(int64_t value) {
+    char buf[32];
+    separate();
+    snprintf(buf, sizeof(buf), "%" PRId64, value);
+    out += buf;
+    return *this;
+}
+
+JsonWriter &JsonWriter::Double(double value) {
+    char buf[32];
+    separate();
+    if (!std::isfinite(value)) {
+        out += "null";
+        return *this;
+    }
+    // shortest form that reads back to the same value
+    snprintf(buf, sizeof(buf), "%.17g", value);
+    for (int precision = 6; precision < 17; precision++) {
+        char shorter[32];
+        snprintf(shorter, sizeof(shorter), "%.*g", precision, value);
+        if (strtod(shorter, NULL) == value) {
+            snprintf(buf, sizeof(buf), "%s", shorter);
+            break;
+        }
+    }
+    out += buf;
+    return *this;
+}
+
+JsonWriter &JsonWriter::Bool(bool value) {
+    separate();
+    out += value ? "true" : "false";
+    return *this;
+}
+
+JsonWriter &JsonWriter::Null() {
+    separate();
+    out += "null";
+    return *this;
+}
+
+void JsonWriter::Clear() {
+    out.clear();
+    empty.clear();
+    afterKey = false;
+}
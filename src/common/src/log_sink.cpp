@@ -0,0 +1,139 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+
+#include "../include/log_sink.h"
+
+extern "C" {
+#include <libavutil/log.h>
+};
+
+#include <cerrno>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+typedef struct LogLevelName {
+    const char *name;
+    int level;
+} LogLevelName;
+
+static const LogLevelName log_levels[] = {
+    {"quiet", AV_LOG_QUIET},     {"panic", AV_LOG_PANIC},
+    {"fatal", AV_LOG_FATAL},     {"error", AV_LOG_ERROR},
+    {"warning", AV_LOG_WARNING}, {"info", AV_LOG_INFO},
+    {"verbose", AV_LOG_VERBOSE}, {"debug", AV_LOG_DEBUG},
+    {"trace", AV_LOG_TRACE},
+};
+
+LogSink &LogSink::Instance() {
+    static LogSink sink;
+    return sink;
+}
+
+void LogSink::Start(int level) {
+    av_log_set_level(level);
+    if (started.exchange(true))
+        return;
+    running = true;
+    sink = std::thread(&LogSink::sink_loop, this);
+    av_log_set_callback(log_callback);
+}
+
+void LogSink::Stop() {
+    if (!running.exchange(false))
+        return;
+    av_log_set_callback(av_log_default_callback);
+    queue.Close();
+    if (sink.joinable())
+        sink.join();
+    if (dropped > 0)
+        write_all(2, std::to_string(dropped.load()) + " log lines dropped\n");
+}
+
+void LogSink::Write(int fd, std::string text, bool droppable) {
+    if (!running) {
+        write_all(fd, text);
+        return;
+    }
+    if (droppable) {
+        if (!queue.TryPush({fd, std::move(text)}))
+            dropped++;
+        return;
+    }
+    // the queue only refuses once it is closed, the sink has stopped
+    if (!queue.Push({fd, text}))
+        write_all(fd, text);
+}
+
+bool LogSink::ParseLevel(const std::string &name, int *level) {
+    char *end = NULL;
+    long value;
+
+    for (const LogLevelName &l : log_levels) {
+        if (name == l.name) {
+            *level = l.level;
+            return true;
+        }
+    }
+    value = strtol(name.c_str(), &end, 10);
+    if (name.empty() || *end || value < AV_LOG_QUIET || value > AV_LOG_TRACE)
+        return false;
+    *level = (int)value;
+    return true;
+}
+
+void LogSink::log_callback(void *avcl, int level, const char *fmt, va_list vl) {
+    // the prefix state follows the lines of each thread like the default callback
+    static thread_local int print_prefix = 1;
+    char line[1024];
+
+    if (level > av_log_get_level())
+        return;
+    // the arguments do not outlive the call, the text is rendered here
+    av_log_format_line2(avcl, level, fmt, vl, line, sizeof(line), &print_prefix);
+    Instance().Write(2, line, level > AV_LOG_INFO);
+}
+
+void LogSink::write_all(int fd, const std::string &text) {
+    const char *data = text.data();
+    size_t left = text.size();
+
+    while (left > 0) {
+#ifdef _WIN32
+        int n = _write(fd, data, (unsigned int)left);
+#else
+        ssize_t n = write(fd, data, left);
+#endif
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        data += n;
+        left -= n;
+    }
+}
+
+void LogSink::sink_loop() {
+    Record record;
+
+    while (queue.Pop(record))
+        write_all(record.fd, record.text);
+}
@@ -0,0 +1,274 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "../include/mapped_reader.h"
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+};
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <set>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// contexts handed out by OpenInput(), CloseInput() leaves any other custom
+// I/O to its owner
+static std::mutex registry_mutex;
+static std::set<AVIOContext *> registry;
+
+#ifndef _WIN32
+// A page of the mapping past the end of a file that was truncated by another
+// process raises SIGBUS. The copy out of the mapping arms a jump for its
+// thread, any other SIGBUS goes to the handler that was installed before.
+static std::once_flag bus_handler_once;
+static struct sigaction previous_bus_action;
+static thread_local sigjmp_buf *bus_jump = NULL;
+
+static void bus_handler(int sig, siginfo_t *info, void *context) {
+    if (bus_jump)
+        siglongjmp(*bus_jump, 1);
+    if (previous_bus_action.sa_flags & SA_SIGINFO) {
+        previous_bus_action.sa_sigaction(sig, info, context);
+    } else if (previous_bus_action.sa_handler != SIG_IGN &&
+               previous_bus_action.sa_handler != SIG_DFL) {
+        previous_bus_action.sa_handler(sig);
+    } else {
+        // the faulting access runs again and gets the default action
+        sigaction(SIGBUS, &previous_bus_action, NULL);
+    }
+}
+
+static void install_bus_handler() {
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = bus_handler;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGBUS, &action, &previous_bus_action);
+}
+
+// memcpy from the mapping, false if the pages are gone
+static bool copy_mapped(uint8_t *dst, const uint8_t *src, size_t n) {
+    sigjmp_buf jump;
+
+    if (sigsetjmp(jump, 1)) {
+        bus_jump = NULL;
+        return false;
+    }
+    // keep the compiler from moving the copy out of the armed range
+    bus_jump = &jump;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    memcpy(dst, src, n);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    bus_jump = NULL;
+    return true;
+}
+#endif
+
+MappedReader::~MappedReader() {
+#ifndef _WIN32
+    if (data)
+        munmap((void *)data, length);
+#endif
+}
+
+int MappedReader::OpenInput(AVFormatContext **fmtCtx, const std::string &path,
+                            const MappedReaderOptions &options) {
+    MappedReader *r = new MappedReader();
+    AVIOContext *pb = NULL;
+    uint8_t *buffer = NULL;
+    int ret;
+
+    r->options = options;
+    if (r->map(path) < 0)
+        goto fallback;
+
+    buffer = (uint8_t *)av_malloc(MAPPED_READER_BUFFER_SIZE);
+    if (!buffer)
+        goto fallback;
+    pb = avio_alloc_context(buffer, MAPPED_READER_BUFFER_SIZE, 0, r, read_packet,
+                            NULL, seek);
+    if (!pb) {
+        av_free(buffer);
+        goto fallback;
+    }
+    pb->seekable = AVIO_SEEKABLE_NORMAL;
+
+    if (!*fmtCtx && !(*fmtCtx = avformat_alloc_context())) {
+        av_freep(&pb->buffer);
+        avio_context_free(&pb);
+        delete r;
+        return AVERROR(ENOMEM);
+    }
+    (*fmtCtx)->pb = pb;
+    (*fmtCtx)->flags |= AVFMT_FLAG_CUSTOM_IO;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.insert(pb);
+    }
+
+    // the context is freed on failure, release the mapping with it
+    if ((ret = avformat_open_input(fmtCtx, path.c_str(), NULL, NULL)) < 0) {
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            registry.erase(pb);
+        }
+        av_freep(&pb->buffer);
+        avio_context_free(&pb);
+        delete r;
+    }
+    return ret;
+
+fallback:
+    delete r;
+    return avformat_open_input(fmtCtx, path.c_str(), NULL, NULL);
+}
+
+void MappedReader::CloseInput(AVFormatContext **fmtCtx) {
+    AVIOContext *pb;
+    bool mapped;
+
+    if (!fmtCtx || !*fmtCtx)
+        return;
+    pb = (*fmtCtx)->pb;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        mapped = pb && ((*fmtCtx)->flags & AVFMT_FLAG_CUSTOM_IO) && registry.erase(pb);
+    }
+    avformat_close_input(fmtCtx);
+    if (mapped) {
+        delete (MappedReader *)pb->opaque;
+        av_freep(&pb->buffer);
+        avio_context_free(&pb);
+    }
+}
+
+int MappedReader::map(const std::string &path) {
+#ifdef _WIN32
+    return AVERROR(ENOSYS);
+#else
+    struct stat st;
+    void *addr;
+    int fd;
+
+    // URLs other than plain files keep their protocol
+    if (path.find("://") != std::string::npos)
+        return AVERROR(ENOTSUP);
+    if ((fd = open(path.c_str(), O_RDONLY)) < 0)
+        return AVERROR(errno);
+    // pipes and devices cannot be mapped, empty files need no mapping
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+        (uint64_t)st.st_size > SIZE_MAX) {
+        close(fd);
+        return AVERROR(ENOTSUP);
+    }
+    std::call_once(bus_handler_once, install_bus_handler);
+    addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (addr == MAP_FAILED)
+        return AVERROR(errno);
+
+    data = (const uint8_t *)addr;
+    length = (size_t)st.st_size;
+    madvise(addr, length, MADV_SEQUENTIAL);
+    prefetch();
+    return 0;
+#endif
+}
+
+void MappedReader::prefetch() {
+#ifndef _WIN32
+    static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start, stop;
+
+    if (options.readahead <= 0)
+        return;
+    // advise the next window once the reader is half way through the last
+    if (prefetched > position && prefetched - position > (size_t)options.readahead / 2)
+        return;
+    start = std::max(prefetched, position) & ~(page - 1);
+    stop = std::min(length, position + (size_t)options.readahead);
+    if (stop > start)
+        madvise((void *)(data + start), stop - start, MADV_WILLNEED);
+    prefetched = stop;
+#endif
+}
+
+int MappedReader::read_packet(void *opaque, uint8_t *buf, int size) {
+    MappedReader *r = (MappedReader *)opaque;
+    size_t n;
+
+    if (r->position >= r->length)
+        return AVERROR_EOF;
+    n = std::min((size_t)size, r->length - r->position);
+#ifndef _WIN32
+    // the file shrank under the mapping, fail like a read of a cut file
+    if (!copy_mapped(buf, r->data + r->position, n)) {
+        av_log(NULL, AV_LOG_ERROR, "Input truncated at %zu bytes while it was read\n",
+               r->position);
+        return AVERROR(EIO);
+    }
+#else
+    memcpy(buf, r->data + r->position, n);
+#endif
+    r->position += n;
+    r->prefetch();
+    return (int)n;
+}
+
+int64_t MappedReader::seek(void *opaque, int64_t offset, int whence) {
+    MappedReader *r = (MappedReader *)opaque;
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return (int64_t)r->length;
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        offset += (int64_t)r->position;
+        break;
+    case SEEK_END:
+        offset += (int64_t)r->length;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (offset < 0)
+        return AVERROR(EINVAL);
+    // reading past the end reports EOF, like a file
+    r->position = (size_t)offset;
+    // a jump outside the advised window restarts it at the new position
+    if (r->position > r->prefetched ||
+        r->prefetched - r->position > (size_t)r->options.readahead)
+        r->prefetched = r->position;
+    r->prefetch();
+    return offset;
+}
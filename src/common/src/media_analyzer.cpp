@@ -0,0 +1,397 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+
+#include "../include/media_analyzer.h"
+#include "../include/bounded_queue.h"
+#include "../include/json_writer.h"
+#include "../include/mapped_reader.h"
+#include "../include/probe_cache.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+#include <libavutil/pixdesc.h>
+};
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <filesystem>
+#include <thread>
+
+#define ANALYZER_READAHEAD (8 << 20)
+#define LUMA_SAMPLE_STEP 2  // every other row and column is enough
+
+struct MediaAnalyzer::StreamState {
+    StreamAnalysis *result = NULL;
+    AVRational timeBase;
+
+    // packets of the current bitrate window, time and size
+    std::deque<std::pair<double, int>> window;
+    int64_t windowBytes = 0;
+    double first = NAN;
+    double end = NAN;
+
+    int gopPackets = 0;  // packets since the last keyframe
+    double lastKey = NAN;
+    double intervalSum = 0;
+    int64_t maxPts = AV_NOPTS_VALUE;
+
+    AVCodecContext *decCtx = NULL;
+    BoundedQueue<AVPacket *> *queue = NULL;
+    std::thread worker;
+};
+
+MediaAnalyzer::MediaAnalyzer(const MediaAnalyzerOptions &options) : options(options) {
+    if (this->options.bitrateWindow <= 0)
+        this->options.bitrateWindow = 1.0;
+}
+
+void MediaAnalyzer::count_packet(StreamState *state, const AVPacket *pkt) {
+    StreamAnalysis *result = state->result;
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    int bucket = 0;
+    double t;
+
+    result->packets++;
+    result->bytes += pkt->size;
+    while (bucket < ANALYZER_SIZE_BUCKETS - 1 && (pkt->size >> (bucket + 1)))
+        bucket++;
+    result->sizeHistogram[bucket]++;
+
+    if (result->type == AVMEDIA_TYPE_VIDEO) {
+        if (pkt->flags & AV_PKT_FLAG_KEY) {
+            if (result->keyframes > 0) {
+                result->gopLengths[state->gopPackets]++;
+                state->gopPackets = 0;
+            }
+            result->keyframes++;
+            if (pkt->pts != AV_NOPTS_VALUE) {
+                t = pkt->pts * av_q2d(state->timeBase);
+                if (!std::isnan(state->lastKey)) {
+                    state->intervalSum += t - state->lastKey;
+                    result->keyframeIntervalMax =
+                        std::max(result->keyframeIntervalMax, t - state->lastKey);
+                }
+                state->lastKey = t;
+            }
+        }
+        if (result->keyframes > 0)
+            state->gopPackets++;
+        // a packet shown before one decoded earlier is a B-frame
+        if (pkt->pts != AV_NOPTS_VALUE) {
+            if (state->maxPts != AV_NOPTS_VALUE && pkt->pts < state->maxPts)
+                result->reorderedPackets++;
+            else
+                state->maxPts = pkt->pts;
+        }
+    }
+
+    if (ts == AV_NOPTS_VALUE)
+        return;
+    t = ts * av_q2d(state->timeBase);
+    if (std::isnan(state->first))
+        state->first = t;
+    state->end = std::max(std::isnan(state->end) ? t : state->end,
+                          t + std::max<int64_t>(pkt->duration, 0) * av_q2d(state->timeBase));
+
+    // bytes of the last bitrateWindow seconds, the peak only counts once a
+    // whole window was seen
+    state->window.emplace_back(t, pkt->size);
+    state->windowBytes += pkt->size;
+    while (!state->window.empty() && t - state->window.front().first >= options.bitrateWindow) {
+        state->windowBytes -= state->window.front().second;
+        state->window.pop_front();
+    }
+    if (t - state->first >= options.bitrateWindow)
+        result->peakBitrate =
+            std::max(result->peakBitrate, state->windowBytes * 8 / options.bitrateWindow);
+}
+
+void MediaAnalyzer::finish_stream(StreamState *state) {
+    StreamAnalysis *result = state->result;
+    int64_t gops = 0;
+    int64_t gopPackets = 0;
+
+    if (!std::isnan(state->first) && state->end > state->first) {
+        result->duration = state->end - state->first;
+        result->averageBitrate = result->bytes * 8 / result->duration;
+    }
+    // shorter than one window, the whole stream is the window
+    if (result->peakBitrate < result->averageBitrate)
+        result->peakBitrate = result->averageBitrate;
+
+    if (result->type != AVMEDIA_TYPE_VIDEO)
+        return;
+    if (state->gopPackets > 0)
+        result->gopLengths[state->gopPackets]++;
+    for (const auto &gop : result->gopLengths) {
+        if (!gops)
+            result->gopMin = gop.first;
+        result->gopMax = gop.first;
+        gops += gop.second;
+        gopPackets += (int64_t)gop.first * gop.second;
+    }
+    if (gops)
+        result->gopAverage = (double)gopPackets / gops;
+    if (result->keyframes > 1)
+        result->keyframeInterval = state->intervalSum / (result->keyframes - 1);
+    result->hasBFrames = result->reorderedPackets > 0 || result->bFrames > 0;
+}
+
+int MediaAnalyzer::open_decoder(StreamState *state, const AVStream *st) {
+    const AVCodec *codec = avcodec_find_decoder(st->codecpar->codec_id);
+    int ret;
+
+    if (!codec)
+        return AVERROR_DECODER_NOT_FOUND;
+    if (!(state->decCtx = avcodec_alloc_context3(codec)))
+        return AVERROR(ENOMEM);
+    if ((ret = avcodec_parameters_to_context(state->decCtx, st->codecpar)) < 0)
+        return ret;
+    state->decCtx->pkt_timebase = st->time_base;
+    state->decCtx->thread_count = options.decoderThreads;
+    state->decCtx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    if (options.keyframesOnly)
+        state->decCtx->skip_frame = AVDISCARD_NONKEY;
+    if ((ret = avcodec_open2(state->decCtx, codec, NULL)) < 0)
+        return ret;
+
+    state->result->lumaHistogram.assign(ANALYZER_LUMA_BINS, 0);
+    state->queue = new BoundedQueue<AVPacket *>(ANALYZER_QUEUE_SIZE);
+    state->worker = std::thread(decode_loop, state);
+    return 0;
+}
+
+void MediaAnalyzer::count_frame(StreamState *state, const AVFrame *frame) {
+    StreamAnalysis *result = state->result;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+    int depth, step;
+
+    result->decodedFrames++;
+    if (frame->pict_type == AV_PICTURE_TYPE_I)
+        result->iFrames++;
+    else if (frame->pict_type == AV_PICTURE_TYPE_P)
+        result->pFrames++;
+    else if (frame->pict_type == AV_PICTURE_TYPE_B)
+        result->bFrames++;
+
+    // planar luma of 8 bits, or up to 16 bits in native little endian words
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL |
+                                 AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BE)))
+        return;
+    depth = desc->comp[0].depth;
+    step = desc->comp[0].step;
+    if (desc->comp[0].plane != 0 || depth < 8 || depth > 16 || step != (depth > 8 ? 2 : 1))
+        return;
+
+    for (int y = 0; y < frame->height; y += LUMA_SAMPLE_STEP) {
+        const uint8_t *row = frame->data[0] + (ptrdiff_t)y * frame->linesize[0];
+        for (int x = 0; x < frame->width; x += LUMA_SAMPLE_STEP) {
+            int v = step == 1 ? row[x] : ((const uint16_t *)row)[x] >> desc->comp[0].shift;
+            result->lumaHistogram[(v >> (depth - 5)) & (ANALYZER_LUMA_BINS - 1)]++;
+        }
+    }
+}
+
+void MediaAnalyzer::decode_loop(StreamState *state) {
+    AVFrame *frame = av_frame_alloc();
+    AVPacket *pkt = NULL;
+    bool more = true;
+    int ret;
+
+    if (!frame) {
+        state->queue->Abort();
+        return;
+    }
+    while (more) {
+        // a NULL packet after the last one drains the decoder
+        more = state->queue->Pop(pkt);
+        ret = avcodec_send_packet(state->decCtx, more ? pkt : NULL);
+        av_packet_free(&pkt);
+        // broken packets are skipped, the analysis goes on
+        if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+            av_log(NULL, AV_LOG_DEBUG, "Analyzer skipped a packet\n");
+        while ((ret = avcodec_receive_frame(state->decCtx, frame)) >= 0) {
+            count_frame(state, frame);
+            av_frame_unref(frame);
+        }
+    }
+    av_frame_free(&frame);
+}
+
+int MediaAnalyzer::Analyze(const std::string &path, MediaAnalysis *analysis,
+                           const std::atomic<bool> *cancel) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<StreamState> states;
+    AVFormatContext *fmtCtx = NULL;
+    MappedReaderOptions input_options;
+    AVPacket *pkt = NULL;
+    std::error_code ec;
+    int ret;
+
+    *analysis = MediaAnalysis();
+    analysis->path = path;
+    input_options.readahead = ANALYZER_READAHEAD;
+    if ((ret = MappedReader::OpenInput(&fmtCtx, path, input_options)) < 0)
+        return ret;
+    if ((ret = ProbeCache::Instance().FindStreamInfo(fmtCtx, path)) < 0)
+        goto end;
+
+    analysis->formatName = fmtCtx->iformat->name;
+    analysis->size = (int64_t)std::filesystem::file_size(path, ec);
+    if (ec)
+        analysis->size = fmtCtx->pb ? avio_size(fmtCtx->pb) : 0;
+    if (fmtCtx->duration != AV_NOPTS_VALUE)
+        analysis->duration = fmtCtx->duration / (double)AV_TIME_BASE;
+    if (analysis->duration > 0 && analysis->size > 0)
+        analysis->bitrate = analysis->size * 8 / analysis->duration;
+
+    // the states point into the results, neither may reallocate
+    analysis->streams.resize(fmtCtx->nb_streams);
+    states.resize(fmtCtx->nb_streams);
+    for (unsigned int i = 0; i < fmtCtx->nb_streams; i++) {
+        const AVStream *st = fmtCtx->streams[i];
+        StreamAnalysis *result = &analysis->streams[i];
+
+        result->index = i;
+        result->type = st->codecpar->codec_type;
+        result->codec = avcodec_get_name(st->codecpar->codec_id);
+        result->sizeHistogram.assign(ANALYZER_SIZE_BUCKETS, 0);
+        states[i].result = result;
+        states[i].timeBase = st->time_base;
+        if (options.decode && result->type == AVMEDIA_TYPE_VIDEO &&
+            !(st->disposition & AV_DISPOSITION_ATTACHED_PIC) &&
+            open_decoder(&states[i], st) < 0)
+            av_log(NULL, AV_LOG_WARNING, "Stream %u will not be decoded\n", i);
+    }
+
+    if (!(pkt = av_packet_alloc())) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    // read errors end the input the same way EOF does
+    while (av_read_frame(fmtCtx, pkt) >= 0) {
+        if (cancel && *cancel) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+        // streams that appear after the header are not analyzed
+        if ((unsigned int)pkt->stream_index >= states.size()) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        StreamState *state = &states[pkt->stream_index];
+        count_packet(state, pkt);
+        if (state->queue && (!options.keyframesOnly || (pkt->flags & AV_PKT_FLAG_KEY))) {
+            AVPacket *copy = av_packet_clone(pkt);
+            if (copy && !state->queue->Push(copy))
+                av_packet_free(&copy);
+        }
+        av_packet_unref(pkt);
+    }
+
+end:
+    for (StreamState &state : states) {
+        if (state.queue) {
+            if (ret < 0)
+                state.queue->Abort();
+            else
+                state.queue->Close();
+            state.worker.join();
+            while (state.queue->TryPop(pkt))
+                av_packet_free(&pkt);
+            delete state.queue;
+        }
+        avcodec_free_context(&state.decCtx);
+        if (ret >= 0)
+            finish_stream(&state);
+    }
+    av_packet_free(&pkt);
+    MappedReader::CloseInput(&fmtCtx);
+    analysis->elapsed =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return ret;
+}
+
+static const char *media_type_name(AVMediaType type) {
+    const char *name = av_get_media_type_string(type);
+    return name ? name : "unknown";
+}
+
+std::string MediaAnalyzer::ToJson(const MediaAnalysis &analysis) {
+    JsonWriter json;
+
+    json.BeginObject();
+    json.Key("path").String(analysis.path);
+    json.Key("format").String(analysis.formatName);
+    json.Key("size").Int(analysis.size);
+    json.Key("duration").Double(analysis.duration);
+    json.Key("bitrate").Double(analysis.bitrate);
+    json.Key("elapsed").Double(analysis.elapsed);
+    json.Key("streams").BeginArray();
+    for (const StreamAnalysis &s : analysis.streams) {
+        json.BeginObject();
+        json.Key("index").Int(s.index);
+        json.Key("type").String(media_type_name(s.type));
+        json.Key("codec").String(s.codec);
+        json.Key("packets").Int(s.packets);
+        json.Key("bytes").Int(s.bytes);
+        json.Key("duration").Double(s.duration);
+        json.Key("average_bitrate").Double(s.averageBitrate);
+        json.Key("peak_bitrate").Double(s.peakBitrate);
+        json.Key("packet_sizes").BeginArray();
+        for (int64_t count : s.sizeHistogram)
+            json.Int(count);
+        json.EndArray();
+
+        if (s.type == AVMEDIA_TYPE_VIDEO) {
+            json.Key("keyframes").Int(s.keyframes);
+            json.Key("gop").BeginObject();
+            json.Key("min").Int(s.gopMin);
+            json.Key("max").Int(s.gopMax);
+            json.Key("average").Double(s.gopAverage);
+            json.Key("lengths").BeginObject();
+            for (const auto &gop : s.gopLengths)
+                json.Key(std::to_string(gop.first)).Int(gop.second);
+            json.EndObject();
+            json.EndObject();
+            json.Key("keyframe_interval").Double(s.keyframeInterval);
+            json.Key("keyframe_interval_max").Double(s.keyframeIntervalMax);
+            json.Key("b_frames").Bool(s.hasBFrames);
+            json.Key("reordered_packets").Int(s.reorderedPackets);
+        }
+
+        if (!s.lumaHistogram.empty()) {
+            json.Key("frames").BeginObject();
+            json.Key("decoded").Int(s.decodedFrames);
+            json.Key("i").Int(s.iFrames);
+            json.Key("p").Int(s.pFrames);
+            json.Key("b").Int(s.bFrames);
+            json.Key("luma_histogram").BeginArray();
+            for (int64_t count : s.lumaHistogram)
+                json.Int(count);
+            json.EndArray();
+            json.EndObject();
+        }
+        json.EndObject();
+    }
+    json.EndArray();
+    json.EndObject();
+    return json.GetString();
+}
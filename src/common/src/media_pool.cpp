@@ -0,0 +1,173 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "../include/media_pool.h"
+
+#include <climits>
+#include <cstring>
+
+MediaPool::MediaPool() {}
+
+MediaPool::~MediaPool() {
+    // the free lists free the recycled structs themselves, buffers still
+    // referenced by packets keep their pool alive
+    for (auto &it : bufferPools)
+        av_buffer_pool_uninit(&it.second.pool);
+}
+
+void MediaPool::count_request(Counters &c, bool allocated) {
+    c.requests++;
+    if (allocated) {
+        c.allocations++;
+        if (c.requests > MEDIA_POOL_WARMUP)
+            c.steadyAllocations++;
+    }
+    if (++c.inUse > c.peakInUse)
+        c.peakInUse = c.inUse;
+}
+
+AVPacket *MediaPool::GetPacket() {
+    std::lock_guard<std::mutex> lock(mutex);
+    AVPacket *pkt = NULL;
+    bool allocated = freePackets.empty();
+    if (allocated) {
+        if (!(pkt = av_packet_alloc()))
+            return NULL;
+    } else {
+        pkt = freePackets.back().release();
+        freePackets.pop_back();
+    }
+    count_request(packets, allocated);
+    return pkt;
+}
+
+void MediaPool::ReleasePacket(AVPacket **pkt) {
+    if (!pkt || !*pkt)
+        return;
+    av_packet_unref(*pkt);
+    std::lock_guard<std::mutex> lock(mutex);
+    freePackets.emplace_back(*pkt);
+    packets.inUse--;
+    *pkt = NULL;
+}
+
+AVFrame *MediaPool::GetFrame() {
+    std::lock_guard<std::mutex> lock(mutex);
+    AVFrame *frame = NULL;
+    bool allocated = freeFrames.empty();
+    if (allocated) {
+        if (!(frame = av_frame_alloc()))
+            return NULL;
+    } else {
+        frame = freeFrames.back().release();
+        freeFrames.pop_back();
+    }
+    count_request(frames, allocated);
+    return frame;
+}
+
+void MediaPool::ReleaseFrame(AVFrame **frame) {
+    if (!frame || !*frame)
+        return;
+    av_frame_unref(*frame);
+    std::lock_guard<std::mutex> lock(mutex);
+    freeFrames.emplace_back(*frame);
+    frames.inUse--;
+    *frame = NULL;
+}
+
+bool MediaPool::AttachEncoder(AVCodecContext *enc_ctx) {
+    if (!(enc_ctx->codec->capabilities & AV_CODEC_CAP_DR1))
+        return false;
+    enc_ctx->opaque = this;
+    enc_ctx->get_encode_buffer = get_encode_buffer;
+    return true;
+}
+
+// the pool's allocator only runs inside av_buffer_pool_get(), which is
+// called with the mutex held, so the counters can be touched directly
+static AVBufferRef *pool_alloc(void *opaque, size_t size) {
+    AVBufferRef *buf = av_buffer_alloc(size);
+    if (buf)
+        (*static_cast<int *>(opaque))++;
+    return buf;
+}
+
+AVBufferRef *MediaPool::get_buffer(AVCodecContext *ctx, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    BufferPool &bp = bufferPools[ctx];
+
+    // grow to the next power of two, packets handed out earlier keep the old
+    // pool alive until they are released
+    if (size > bp.size) {
+        size_t pool_size = bp.size ? bp.size : 4096;
+        while (pool_size < size)
+            pool_size *= 2;
+        av_buffer_pool_uninit(&bp.pool);
+        bp.pool = av_buffer_pool_init2(pool_size, &buffers.allocations, pool_alloc, NULL);
+        if (!bp.pool) {
+            bp.size = 0;
+            return NULL;
+        }
+        if (bp.size)
+            bp.resizes++;
+        bp.size = pool_size;
+    }
+
+    int before = buffers.allocations;
+    AVBufferRef *buf = av_buffer_pool_get(bp.pool);
+    buffers.requests++;
+    if (buffers.allocations != before && buffers.requests > MEDIA_POOL_WARMUP)
+        buffers.steadyAllocations++;
+    return buf;
+}
+
+int MediaPool::get_encode_buffer(AVCodecContext *ctx, AVPacket *pkt, int flags) {
+    MediaPool *pool = static_cast<MediaPool *>(ctx->opaque);
+    (void)flags;
+
+    if (pkt->size < 0 || pkt->size > INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE)
+        return AVERROR(EINVAL);
+
+    AVBufferRef *buf = pool->get_buffer(ctx, pkt->size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!buf)
+        return AVERROR(ENOMEM);
+    pkt->buf = buf;
+    pkt->data = buf->data;
+    memset(pkt->data + pkt->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    return 0;
+}
+
+void MediaPool::LogStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    int resizes = 0;
+    for (auto &it : bufferPools)
+        resizes += it.second.resizes;
+
+    av_log(NULL, AV_LOG_INFO,
+           "Packets: %d requests, %d allocated (%d after warm-up), peak %d in use\n",
+           packets.requests, packets.allocations, packets.steadyAllocations,
+           packets.peakInUse);
+    av_log(NULL, AV_LOG_INFO,
+           "Frames: %d requests, %d allocated (%d after warm-up), peak %d in use\n",
+           frames.requests, frames.allocations, frames.steadyAllocations,
+           frames.peakInUse);
+    if (buffers.requests > 0)
+        av_log(NULL, AV_LOG_INFO,
+               "Encoder buffers: %d requests, %d allocated (%d after warm-up), "
+               "%d pool resizes\n",
+               buffers.requests, buffers.allocations, buffers.steadyAllocations,
+               resizes);
+}
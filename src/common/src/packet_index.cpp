@@ -0,0 +1,458 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "../include/packet_index.h"
+#include "../include/mapped_reader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// the stream headers and the entries start 8 byte aligned
+static size_t align8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+// temporary name of a sidecar being written, unique per process and thread
+// so concurrent builders of the same sidecar never write the same file
+static std::string temp_path(const std::string &sidecarPath) {
+#ifdef _WIN32
+    int pid = _getpid();
+#else
+    int pid = (int)getpid();
+#endif
+    size_t tid = std::hash<std::thread::id>()(std::this_thread::get_id());
+    return sidecarPath + "." + std::to_string(pid) + "." + std::to_string(tid) + ".tmp";
+}
+
+static bool pts_less(const PacketIndexEntry &a, const PacketIndexEntry &b) {
+    return a.pts < b.pts;
+}
+
+static std::string cache_dir() {
+    const char *dir;
+#ifdef _WIN32
+    if ((dir = getenv("LOCALAPPDATA")) && *dir)
+        return std::string(dir) + "/OpenConverter/index";
+#else
+    if ((dir = getenv("XDG_CACHE_HOME")) && *dir)
+        return std::string(dir) + "/OpenConverter/index";
+    if ((dir = getenv("HOME")) && *dir)
+        return std::string(dir) + "/.cache/OpenConverter/index";
+#endif
+    std::error_code ec;
+    return (std::filesystem::temp_directory_path(ec) / "OpenConverter" / "index").string();
+}
+
+PacketIndex::PacketIndex() {}
+
+PacketIndex::~PacketIndex() { Close(); }
+
+std::string PacketIndex::GetSidecarPath(const std::string &mediaPath) {
+    std::error_code ec;
+    std::string key = std::filesystem::absolute(mediaPath, ec).string();
+    if (ec)
+        key = mediaPath;
+
+    // FNV-1a keeps the name short and stable across runs
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.ocidx", (unsigned long long)hash);
+    return cache_dir() + "/" + name;
+}
+
+int PacketIndex::file_key(const std::string &mediaPath, uint64_t *size,
+                          int64_t *mtime) {
+    std::error_code ec;
+    *size = std::filesystem::file_size(mediaPath, ec);
+    if (ec)
+        return AVERROR(ENOENT);
+    auto time = std::filesystem::last_write_time(mediaPath, ec);
+    if (ec)
+        return AVERROR(ENOENT);
+    *mtime = (int64_t)time.time_since_epoch().count();
+    return 0;
+}
+
+int PacketIndex::Load(const std::string &mediaPath) {
+    std::string sidecarPath = GetSidecarPath(mediaPath);
+    std::error_code ec;
+    int ret;
+
+    Close();
+    if ((ret = map_file(sidecarPath)) < 0)
+        return ret;
+    if ((ret = validate(mediaPath)) < 0) {
+        Close();
+        return ret;
+    }
+    // the modification time tracks the last use for PruneCache()
+    std::filesystem::last_write_time(sidecarPath, std::filesystem::file_time_type::clock::now(), ec);
+    return 0;
+}
+
+int PacketIndex::Open(const std::string &mediaPath) {
+    std::string sidecarPath = GetSidecarPath(mediaPath);
+    int ret;
+
+    if (Load(mediaPath) >= 0)
+        return 0;
+
+    av_log(NULL, AV_LOG_INFO, "Building packet index of %s\n", mediaPath.c_str());
+    if ((ret = build(mediaPath, sidecarPath)) < 0)
+        return ret;
+    return Load(mediaPath);
+}
+
+void PacketIndex::PruneCache(const std::string &dir, uint64_t limit,
+                             const std::string &keep) {
+    struct Sidecar {
+        std::filesystem::path path;
+        std::filesystem::file_time_type used;
+        uint64_t size;
+    };
+    std::vector<Sidecar> sidecars;
+    uint64_t total = 0;
+    std::error_code ec;
+
+    std::filesystem::directory_iterator it(dir, ec);
+    for (; !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        std::error_code entry_ec;
+        Sidecar s;
+        if (it->path().extension() != ".ocidx" || !it->is_regular_file(entry_ec))
+            continue;
+        s.path = it->path();
+        s.size = it->file_size(entry_ec);
+        if (!entry_ec)
+            s.used = it->last_write_time(entry_ec);
+        if (entry_ec)
+            continue;
+        total += s.size;
+        sidecars.push_back(s);
+    }
+    if (total <= limit)
+        return;
+
+    std::sort(sidecars.begin(), sidecars.end(),
+              [](const Sidecar &a, const Sidecar &b) { return a.used < b.used; });
+    for (const Sidecar &s : sidecars) {
+        if (total <= limit)
+            break;
+        if (s.path == std::filesystem::path(keep))
+            continue;
+        // a sidecar still mapped by a reader stays valid until it is closed
+        if (std::filesystem::remove(s.path, ec))
+            total -= s.size;
+    }
+    av_log(NULL, AV_LOG_VERBOSE, "Packet index cache pruned to %llu bytes\n",
+           (unsigned long long)total);
+}
+
+void PacketIndex::Close() {
+#ifdef _WIN32
+    data.clear();
+    data.shrink_to_fit();
+#else
+    if (base)
+        munmap((void *)base, length);
+#endif
+    base = NULL;
+    length = 0;
+    streams = NULL;
+    table = NULL;
+}
+
+int PacketIndex::map_file(const std::string &sidecarPath) {
+#ifdef _WIN32
+    std::ifstream in(sidecarPath, std::ios::binary | std::ios::ate);
+    if (!in)
+        return AVERROR(ENOENT);
+    std::streamsize size = in.tellg();
+    if (size <= 0)
+        return AVERROR(ENOENT);
+    data.resize((size_t)size);
+    in.seekg(0);
+    if (!in.read((char *)data.data(), size))
+        return AVERROR(EIO);
+    base = data.data();
+    length = data.size();
+#else
+    struct stat st;
+    int fd = open(sidecarPath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return AVERROR(ENOENT);
+    if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+        close(fd);
+        return AVERROR(ENOENT);
+    }
+    void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return AVERROR(errno);
+    base = (const uint8_t *)addr;
+    length = (size_t)st.st_size;
+#endif
+    return 0;
+}
+
+int PacketIndex::validate(const std::string &mediaPath) {
+    const FileHeader *header = (const FileHeader *)base;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    size_t offset;
+    uint64_t tableCount;
+
+    if (length < sizeof(FileHeader) ||
+        memcmp(header->magic, PACKET_INDEX_MAGIC, sizeof(header->magic)) ||
+        header->version != PACKET_INDEX_VERSION)
+        return AVERROR_INVALIDDATA;
+
+    // stale if the file was replaced or modified since the index was built
+    if (file_key(mediaPath, &size, &mtime) < 0 || header->fileSize != size ||
+        header->mtime != mtime)
+        return AVERROR(ENOENT);
+
+    offset = sizeof(FileHeader);
+    if (header->pathLength > length - offset)
+        return AVERROR_INVALIDDATA;
+    std::error_code ec;
+    std::string path = std::filesystem::absolute(mediaPath, ec).string();
+    if (path.size() != header->pathLength ||
+        memcmp(base + offset, path.data(), path.size()))
+        return AVERROR(ENOENT);
+
+    offset = align8(offset + header->pathLength);
+    if (header->streamCount > (length - offset) / sizeof(StreamHeader))
+        return AVERROR_INVALIDDATA;
+    streams = (const StreamHeader *)(base + offset);
+
+    offset += header->streamCount * sizeof(StreamHeader);
+    table = (const PacketIndexEntry *)(base + offset);
+    tableCount = (length - offset) / sizeof(PacketIndexEntry);
+    for (uint32_t i = 0; i < header->streamCount; i++) {
+        const StreamHeader &s = streams[i];
+        if (s.entryOffset > tableCount || s.entryCount > tableCount - s.entryOffset ||
+            s.keyOffset > tableCount || s.keyCount > tableCount - s.keyOffset ||
+            s.timeBaseDen <= 0)
+            return AVERROR_INVALIDDATA;
+    }
+    return 0;
+}
+
+int PacketIndex::build(const std::string &mediaPath, const std::string &sidecarPath) {
+    AVFormatContext *fmt_ctx = NULL;
+    AVPacket *pkt = NULL;
+    std::vector<std::vector<PacketIndexEntry>> entries;
+    std::vector<std::vector<PacketIndexEntry>> keys;
+    std::vector<int64_t> endPts;
+    std::vector<StreamHeader> headers;
+    FileHeader header;
+    std::string path;
+    std::string tmpPath = temp_path(sidecarPath);
+    std::error_code ec;
+    uint64_t offset = 0;
+    int ret;
+
+    memset(&header, 0, sizeof(header));
+    if ((ret = file_key(mediaPath, &header.fileSize, &header.mtime)) < 0)
+        return ret;
+
+    // one sequential pass, ideal for the mapped reader
+    if ((ret = MappedReader::OpenInput(&fmt_ctx, mediaPath, MappedReaderOptions())) < 0)
+        return ret;
+    pkt = av_packet_alloc();
+    if (!pkt) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    // packets only, nothing is decoded and no stream info is needed
+    while (av_read_frame(fmt_ctx, pkt) >= 0) {
+        size_t idx = (size_t)pkt->stream_index;
+        if (idx >= entries.size()) {
+            entries.resize(idx + 1);
+            keys.resize(idx + 1);
+            endPts.resize(idx + 1, AV_NOPTS_VALUE);
+        }
+        PacketIndexEntry e;
+        e.pts = pkt->pts;
+        e.dts = pkt->dts;
+        e.pos = pkt->pos;
+        e.size = pkt->size;
+        e.streamIndex = (uint16_t)pkt->stream_index;
+        e.flags = (uint16_t)pkt->flags;
+        entries[idx].push_back(e);
+        if (pkt->pts != AV_NOPTS_VALUE) {
+            if (pkt->flags & AV_PKT_FLAG_KEY)
+                keys[idx].push_back(e);
+            if (endPts[idx] == AV_NOPTS_VALUE || pkt->pts + pkt->duration > endPts[idx])
+                endPts[idx] = pkt->pts + pkt->duration;
+        }
+        av_packet_unref(pkt);
+    }
+
+    // streams may be added while reading
+    entries.resize(fmt_ctx->nb_streams);
+    keys.resize(fmt_ctx->nb_streams);
+    endPts.resize(fmt_ctx->nb_streams, AV_NOPTS_VALUE);
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        StreamHeader s;
+        std::stable_sort(keys[i].begin(), keys[i].end(), pts_less);
+        s.timeBaseNum = fmt_ctx->streams[i]->time_base.num;
+        s.timeBaseDen = fmt_ctx->streams[i]->time_base.den;
+        s.endPts = endPts[i];
+        s.entryOffset = offset;
+        s.entryCount = entries[i].size();
+        offset += entries[i].size();
+        s.keyOffset = offset;
+        s.keyCount = keys[i].size();
+        offset += keys[i].size();
+        headers.push_back(s);
+    }
+
+    path = std::filesystem::absolute(mediaPath, ec).string();
+    memcpy(header.magic, PACKET_INDEX_MAGIC, sizeof(header.magic));
+    header.version = PACKET_INDEX_VERSION;
+    header.streamCount = (uint32_t)headers.size();
+    header.pathLength = path.size();
+
+    std::filesystem::create_directories(std::filesystem::path(sidecarPath).parent_path(), ec);
+    {
+        // written under a temporary name so readers never see a partial file
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        static const char zeros[8] = {0};
+        out.write((const char *)&header, sizeof(header));
+        out.write(path.data(), path.size());
+        out.write(zeros, align8(sizeof(header) + path.size()) - sizeof(header) - path.size());
+        out.write((const char *)headers.data(), headers.size() * sizeof(StreamHeader));
+        for (size_t i = 0; i < headers.size(); i++) {
+            out.write((const char *)entries[i].data(), entries[i].size() * sizeof(PacketIndexEntry));
+            out.write((const char *)keys[i].data(), keys[i].size() * sizeof(PacketIndexEntry));
+        }
+        if (!out.flush()) {
+            ret = AVERROR(EIO);
+            goto end;
+        }
+    }
+    std::filesystem::rename(tmpPath, sidecarPath, ec);
+    ret = ec ? AVERROR(EIO) : 0;
+    if (ret >= 0)
+        PruneCache(std::filesystem::path(sidecarPath).parent_path().string(),
+                   PACKET_INDEX_CACHE_LIMIT, sidecarPath);
+
+end:
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_WARNING, "Could not store packet index %s\n", sidecarPath.c_str());
+        std::filesystem::remove(tmpPath, ec);
+    }
+    av_packet_free(&pkt);
+    MappedReader::CloseInput(&fmt_ctx);
+    return ret;
+}
+
+int PacketIndex::GetStreamCount() const {
+    return base ? (int)((const FileHeader *)base)->streamCount : 0;
+}
+
+AVRational PacketIndex::GetTimeBase(int stream) const {
+    if (stream < 0 || stream >= GetStreamCount())
+        return AVRational{0, 1};
+    return AVRational{streams[stream].timeBaseNum, streams[stream].timeBaseDen};
+}
+
+int64_t PacketIndex::GetEndPts(int stream) const {
+    if (stream < 0 || stream >= GetStreamCount())
+        return AV_NOPTS_VALUE;
+    return streams[stream].endPts;
+}
+
+const PacketIndexEntry *PacketIndex::GetEntries(int stream, size_t *count) const {
+    *count = 0;
+    if (stream < 0 || stream >= GetStreamCount())
+        return NULL;
+    *count = streams[stream].entryCount;
+    return table + streams[stream].entryOffset;
+}
+
+const PacketIndexEntry *PacketIndex::GetKeyframes(int stream, size_t *count) const {
+    *count = 0;
+    if (stream < 0 || stream >= GetStreamCount())
+        return NULL;
+    *count = streams[stream].keyCount;
+    return table + streams[stream].keyOffset;
+}
+
+const PacketIndexEntry *PacketIndex::FindKeyframe(int stream, int64_t ts) const {
+    size_t count;
+    const PacketIndexEntry *keys = GetKeyframes(stream, &count);
+    PacketIndexEntry target;
+
+    if (!count)
+        return NULL;
+    target.pts = ts;
+    const PacketIndexEntry *it = std::upper_bound(keys, keys + count, target, pts_less);
+    return it == keys ? NULL : it - 1;
+}
+
+std::vector<double> PacketIndex::GetKeyframeTimes(int stream) const {
+    std::vector<double> times;
+    size_t count;
+    const PacketIndexEntry *keys = GetKeyframes(stream, &count);
+    double tb = av_q2d(GetTimeBase(stream));
+
+    times.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        times.push_back(keys[i].pts * tb);
+    return times;
+}
+
+int PacketIndex::SeekToKeyframe(AVFormatContext *fmtCtx, int stream, int64_t ts) const {
+    const PacketIndexEntry *key = FindKeyframe(stream, ts);
+    int ret;
+
+    if (!key)
+        return AVERROR(ENOENT);
+
+    // formats with timestamp discontinuities (TS, PS) have no usable seek
+    // index of their own, the byte offset gets there without any probing
+    if (key->pos >= 0 && (fmtCtx->iformat->flags & AVFMT_TS_DISCONT) &&
+        !(fmtCtx->iformat->flags & AVFMT_NO_BYTE_SEEK)) {
+        ret = avformat_seek_file(fmtCtx, -1, key->pos, key->pos, key->pos,
+                                 AVSEEK_FLAG_BYTE);
+        if (ret >= 0)
+            return ret;
+    }
+    ret = avformat_seek_file(fmtCtx, stream, key->pts, key->pts, key->pts, 0);
+    if (ret < 0)
+        ret = av_seek_frame(fmtCtx, stream, key->pts, AVSEEK_FLAG_BACKWARD);
+    return ret;
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../include/phase_hook.h"
+
+std::atomic<PhaseHook::Callback> PhaseHook::callback{NULL};
+void *PhaseHook::opaque = NULL;
+
+static const char *const phase_names[PHASE_COUNT] = {
+    "idle", "open", "prepare", "loop", "flush", "trailer", "close"};
+
+void PhaseHook::Set(Callback callback, void *opaque) {
+    PhaseHook::opaque = opaque;
+    PhaseHook::callback.store(callback);
+}
+
+const char *PhaseHook::Name(TranscodePhase phase) {
+    return phase >= 0 && phase < PHASE_COUNT ? phase_names[phase] : "unknown";
+}
@@ -0,0 +1,329 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "../include/probe_cache.h"
+
+extern "C" {
+#include <libavutil/dict.h>
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+};
+
+#include <filesystem>
+
+MediaProbe::~MediaProbe() {
+    for (ProbedStream &s : streams)
+        avcodec_parameters_free(&s.codecpar);
+}
+
+std::shared_ptr<MediaProbe> MediaProbe::FromContext(const AVFormatContext *fmtCtx) {
+    std::shared_ptr<MediaProbe> probe = std::make_shared<MediaProbe>();
+    const AVDictionaryEntry *tag = NULL;
+
+    probe->formatName = fmtCtx->iformat ? fmtCtx->iformat->name : "";
+    probe->startTime = fmtCtx->start_time;
+    probe->duration = fmtCtx->duration;
+    probe->bitRate = fmtCtx->bit_rate;
+    probe->streams.reserve(fmtCtx->nb_streams);
+    for (unsigned int i = 0; i < fmtCtx->nb_streams; i++) {
+        const AVStream *st = fmtCtx->streams[i];
+        ProbedStream s;
+
+        s.codecpar = avcodec_parameters_alloc();
+        if (!s.codecpar || avcodec_parameters_copy(s.codecpar, st->codecpar) < 0) {
+            avcodec_parameters_free(&s.codecpar);
+            return NULL;
+        }
+        s.timeBase = st->time_base;
+        s.avgFrameRate = st->avg_frame_rate;
+        s.rFrameRate = st->r_frame_rate;
+        s.startTime = st->start_time;
+        s.duration = st->duration;
+        s.nbFrames = st->nb_frames;
+        s.disposition = st->disposition;
+        tag = NULL;
+        while ((tag = av_dict_get(st->metadata, "", tag, AV_DICT_IGNORE_SUFFIX)))
+            s.metadata[tag->key] = tag->value;
+        probe->streams.push_back(s);
+    }
+    return probe;
+}
+
+int MediaProbe::FindBestStream(AVMediaType type) const {
+    int best = -1;
+
+    for (size_t i = 0; i < streams.size(); i++) {
+        const ProbedStream &s = streams[i];
+        if (s.codecpar->codec_type != type || s.codecpar->codec_id == AV_CODEC_ID_NONE)
+            continue;
+        // cover art is not the video of the file
+        if (type == AVMEDIA_TYPE_VIDEO && (s.disposition & AV_DISPOSITION_ATTACHED_PIC))
+            continue;
+        if (s.disposition & AV_DISPOSITION_DEFAULT)
+            return (int)i;
+        if (best < 0)
+            best = (int)i;
+    }
+    return best;
+}
+
+bool MediaProbe::Apply(AVFormatContext *fmtCtx) const {
+    // streams found only while reading packets are not in the header
+    if (fmtCtx->ctx_flags & AVFMTCTX_NOHEADER)
+        return false;
+    if (!fmtCtx->iformat || formatName != fmtCtx->iformat->name ||
+        fmtCtx->nb_streams != streams.size())
+        return false;
+    for (unsigned int i = 0; i < fmtCtx->nb_streams; i++) {
+        const AVStream *st = fmtCtx->streams[i];
+        const ProbedStream &s = streams[i];
+        if (st->codecpar->codec_type != s.codecpar->codec_type ||
+            st->codecpar->codec_id != s.codecpar->codec_id ||
+            av_cmp_q(st->time_base, s.timeBase) != 0)
+            return false;
+    }
+
+    for (unsigned int i = 0; i < fmtCtx->nb_streams; i++) {
+        AVStream *st = fmtCtx->streams[i];
+        const ProbedStream &s = streams[i];
+        if (avcodec_parameters_copy(st->codecpar, s.codecpar) < 0)
+            return false;
+        st->avg_frame_rate = s.avgFrameRate;
+        st->r_frame_rate = s.rFrameRate;
+        if (st->start_time == AV_NOPTS_VALUE)
+            st->start_time = s.startTime;
+        if (st->duration == AV_NOPTS_VALUE)
+            st->duration = s.duration;
+        if (st->nb_frames <= 0)
+            st->nb_frames = s.nbFrames;
+    }
+    if (fmtCtx->start_time == AV_NOPTS_VALUE)
+        fmtCtx->start_time = startTime;
+    if (fmtCtx->duration == AV_NOPTS_VALUE)
+        fmtCtx->duration = duration;
+    if (fmtCtx->bit_rate <= 0)
+        fmtCtx->bit_rate = bitRate;
+    return true;
+}
+
+ProbeCache &ProbeCache::Instance() {
+    static ProbeCache cache;
+    return cache;
+}
+
+void ProbeCache::SetLimits(const ProbeLimits &limits) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // results of the old limits may describe fewer streams
+    this->limits = limits;
+    entries.clear();
+    ages.clear();
+}
+
+ProbeLimits ProbeCache::GetLimits() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return limits;
+}
+
+bool ProbeCache::file_key(const std::string &path, std::string *key, uint64_t *size,
+                          int64_t *mtime) {
+    std::error_code ec;
+
+    // pipes and URLs are not files, they are probed every time
+    if (path.empty() || path == "-" || path.find("://") != std::string::npos ||
+        path.compare(0, 5, "pipe:") == 0)
+        return false;
+    if (!std::filesystem::is_regular_file(path, ec))
+        return false;
+    *size = std::filesystem::file_size(path, ec);
+    if (ec)
+        return false;
+    auto time = std::filesystem::last_write_time(path, ec);
+    if (ec)
+        return false;
+    *mtime = (int64_t)time.time_since_epoch().count();
+    *key = std::filesystem::absolute(path, ec).string();
+    if (ec)
+        *key = path;
+    return true;
+}
+
+std::shared_ptr<const MediaProbe> ProbeCache::Find(const std::string &path) {
+    std::string key;
+    uint64_t size;
+    int64_t mtime;
+
+    if (!file_key(path, &key, &size, &mtime))
+        return NULL;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it == entries.end())
+        return NULL;
+    if (it->second.size != size || it->second.mtime != mtime) {
+        ages.erase(it->second.age);
+        entries.erase(it);
+        return NULL;
+    }
+    ages.splice(ages.begin(), ages, it->second.age);
+    return it->second.probe;
+}
+
+void ProbeCache::store(const std::string &key, uint64_t size, int64_t mtime,
+                       std::shared_ptr<const MediaProbe> probe) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+
+    if (it != entries.end()) {
+        ages.splice(ages.begin(), ages, it->second.age);
+        it->second.size = size;
+        it->second.mtime = mtime;
+        it->second.probe = probe;
+        return;
+    }
+    ages.push_front(key);
+    entries[key] = {size, mtime, probe, ages.begin()};
+    if (entries.size() > PROBE_CACHE_SIZE) {
+        entries.erase(ages.back());
+        ages.pop_back();
+    }
+}
+
+void ProbeCache::apply_limits(AVFormatContext *fmtCtx) {
+    ProbeLimits l = GetLimits();
+
+    if (l.probeSize > 0)
+        fmtCtx->probesize = l.probeSize;
+    if (l.analyzeDuration > 0)
+        fmtCtx->max_analyze_duration = l.analyzeDuration;
+}
+
+int ProbeCache::FindStreamInfo(AVFormatContext *fmtCtx, const std::string &path) {
+    std::shared_ptr<const MediaProbe> probe = Find(path);
+    std::shared_ptr<MediaProbe> fresh;
+    std::string key;
+    uint64_t size;
+    int64_t mtime;
+    int ret;
+
+    if (probe && probe->Apply(fmtCtx)) {
+        av_log(NULL, AV_LOG_DEBUG, "Reusing the probe of %s\n", path.c_str());
+        return 0;
+    }
+
+    apply_limits(fmtCtx);
+    if ((ret = avformat_find_stream_info(fmtCtx, NULL)) < 0)
+        return ret;
+    if (file_key(path, &key, &size, &mtime) && (fresh = MediaProbe::FromContext(fmtCtx)))
+        store(key, size, mtime, fresh);
+    return ret;
+}
+
+int ProbeCache::interrupt_cb(void *opaque) {
+    return ((const std::atomic<bool> *)opaque)->load();
+}
+
+int ProbeCache::open_input(AVFormatContext **fmtCtx, const std::string &path,
+                           const std::atomic<bool> *cancel) {
+    if (!(*fmtCtx = avformat_alloc_context()))
+        return AVERROR(ENOMEM);
+    // a slow mount or a network file gives up as soon as it is cancelled
+    if (cancel) {
+        (*fmtCtx)->interrupt_callback.callback = interrupt_cb;
+        (*fmtCtx)->interrupt_callback.opaque = (void *)cancel;
+    }
+    return avformat_open_input(fmtCtx, path.c_str(), NULL, NULL);
+}
+
+std::shared_ptr<const MediaProbe> ProbeCache::Get(const std::string &path, int *error,
+                                                  const std::atomic<bool> *cancel) {
+    std::shared_ptr<const MediaProbe> probe = Find(path);
+    std::shared_ptr<const MediaProbe> result;
+    AVFormatContext *fmtCtx = NULL;
+    int ret;
+
+    if (probe)
+        return probe;
+
+    if ((ret = open_input(&fmtCtx, path, cancel)) < 0)
+        goto end;
+    if ((ret = FindStreamInfo(fmtCtx, path)) < 0)
+        goto end;
+    // files that cannot be cached still get a result
+    if (!(result = Find(path)) && !(result = MediaProbe::FromContext(fmtCtx)))
+        ret = AVERROR(ENOMEM);
+
+end:
+    avformat_close_input(&fmtCtx);
+    if (cancel && *cancel)
+        ret = AVERROR_EXIT;
+    if (error)
+        *error = ret < 0 ? ret : 0;
+    return ret < 0 ? NULL : result;
+}
+
+std::shared_ptr<const MediaProbe> ProbeCache::Probe(const std::string &path, int *error,
+                                                    const std::atomic<bool> *cancel) {
+    std::shared_ptr<const MediaProbe> result;
+    AVFormatContext *fmtCtx = NULL;
+    int ret;
+
+    if ((ret = open_input(&fmtCtx, path, cancel)) < 0)
+        goto end;
+    apply_limits(fmtCtx);
+    if ((ret = avformat_find_stream_info(fmtCtx, NULL)) < 0)
+        goto end;
+    if (!(result = MediaProbe::FromContext(fmtCtx)))
+        ret = AVERROR(ENOMEM);
+
+end:
+    avformat_close_input(&fmtCtx);
+    if (cancel && *cancel)
+        ret = AVERROR_EXIT;
+    if (error)
+        *error = ret < 0 ? ret : 0;
+    return ret < 0 ? NULL : result;
+}
+
+std::shared_ptr<const MediaProbe> ProbeCache::GetHeader(const std::string &path, int *error,
+                                                        const std::atomic<bool> *cancel) {
+    std::shared_ptr<const MediaProbe> probe = Find(path);
+    std::shared_ptr<MediaProbe> result;
+    AVFormatContext *fmtCtx = NULL;
+    int ret;
+
+    if (probe)
+        return probe;
+
+    if ((ret = open_input(&fmtCtx, path, cancel)) < 0)
+        goto end;
+    if (!(result = MediaProbe::FromContext(fmtCtx)))
+        ret = AVERROR(ENOMEM);
+    else
+        result->complete = false;
+
+end:
+    avformat_close_input(&fmtCtx);
+    if (cancel && *cancel)
+        ret = AVERROR_EXIT;
+    if (error)
+        *error = ret < 0 ? ret : 0;
+    return ret < 0 ? NULL : result;
+}
+
+void ProbeCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    ages.clear();
+}
@@ -50,6 +50,10 @@ double ProcessParameter::get_time_required() { return timeRequired; }
 
 ProcessParameter ProcessParameter::get_process_parmeter() { return *this; }
 
+void ProcessParameter::set_stats(const TranscodeStats &stats) {
+    notify_stats_update(stats);
+}
+
 void ProcessParameter::add_observer(ProcessObserver* observer) {
     if (observer) {
         observers.push_back(observer);
@@ -78,3 +82,11 @@ void ProcessParameter::notify_time_update(double timeRequired) {
         }
     }
 }
+
+void ProcessParameter::notify_stats_update(const TranscodeStats &stats) {
+    for (auto observer : observers) {
+        if (observer) {
+            observer->on_stats_update(stats);
+        }
+    }
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../include/progress_reporter.h"
+
+#include <cstdio>
+
+#include "../include/json_writer.h"
+#include "../include/log_sink.h"
+
+ProgressReporter &ProgressReporter::Instance() {
+    static ProgressReporter reporter;
+    return reporter;
+}
+
+void ProgressReporter::Configure(const ProgressOptions &options) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->options = options;
+    running = false;
+    enabled = options.fd >= 0;
+}
+
+void ProgressReporter::Update(int64_t done, int64_t total, double remaining) {
+    ProgressSample sample;
+
+    if (!enabled)
+        return;
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running) {
+        running = true;
+        start = now;
+        next = now;
+    }
+    lastDone = done;
+    lastTotal = total;
+    if (now < next)
+        return;
+    next = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                     std::chrono::duration<double>(options.interval));
+
+    sample.done = done;
+    sample.total = total;
+    sample.percent = total > 0 ? done * 100.0 / total : 0;
+    sample.remaining = remaining;
+    sample.state = "continue";
+    emit(sample, now);
+}
+
+void ProgressReporter::Finish(bool ok) {
+    ProgressSample sample;
+
+    if (!enabled)
+        return;
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running)
+        start = now;
+    sample.done = ok ? lastTotal : lastDone;
+    sample.total = lastTotal;
+    sample.percent = ok ? 100 : (lastTotal > 0 ? lastDone * 100.0 / lastTotal : 0);
+    sample.state = ok ? "end" : "failed";
+    emit(sample, now);
+    running = false;
+    lastDone = 0;
+    lastTotal = 0;
+}
+
+void ProgressReporter::emit(ProgressSample &sample,
+                            std::chrono::steady_clock::time_point now) {
+    sample.elapsed = std::chrono::duration<double>(now - start).count();
+    LogSink::Instance().Write(options.fd, Format(options.format, sample));
+}
+
+std::string ProgressReporter::Format(const std::string &format,
+                                     const ProgressSample &sample) {
+    char line[256];
+
+    if (format == "json") {
+        JsonWriter json;
+        json.BeginObject()
+            .Key("done").Int(sample.done)
+            .Key("total").Int(sample.total)
+            .Key("percent").Double(sample.percent)
+            .Key("elapsed").Double(sample.elapsed)
+            .Key("remaining").Double(sample.remaining)
+            .Key("progress").String(sample.state)
+            .EndObject();
+        return json.GetString() + "\n";
+    }
+    snprintf(line, sizeof(line),
+             "done=%lld total=%lld percent=%.2f elapsed=%.3f remaining=%.1f progress=%s\n",
+             (long long)sample.done, (long long)sample.total, sample.percent,
+             sample.elapsed, sample.remaining, sample.state.c_str());
+    return line;
+}
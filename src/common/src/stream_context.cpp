@@ -14,6 +14,10 @@
  */
 
 #include "../include/stream_context.h"
+#include "../include/async_writer.h"
+#include "../include/mapped_reader.h"
+
+#include <utility>
 
 StreamContext::StreamContext() {
     fmtCtx = NULL;
@@ -21,33 +25,45 @@ StreamContext::StreamContext() {
 
     videoIdx = OC_INVALID_STREAM_IDX;
     videoStream = NULL;
-    videoCodec = NULL;
-    videoCodecCtx = NULL;
 
     audioIdx = OC_INVALID_STREAM_IDX;
     audioStream = NULL;
-    audioCodec = NULL;
-    audioCodecCtx = NULL;
+}
+
+StreamContext::~StreamContext() { Close(); }
 
-    pkt = NULL;
-    frame = NULL;
+StreamContext::StreamContext(StreamContext &&other) noexcept : StreamContext() {
+    *this = std::move(other);
 }
 
-StreamContext::~StreamContext() {
-    if (videoCodecCtx) {
-        avcodec_free_context(&videoCodecCtx);
-        videoCodecCtx = NULL;
-    }
-    if (audioCodecCtx) {
-        avcodec_free_context(&audioCodecCtx);
-        audioCodecCtx = NULL;
-    }
-    if (pkt) {
-        av_packet_free(&pkt);
-        pkt = NULL;
-    }
-    if (frame) {
-        av_frame_free(&frame);
-        frame = NULL;
+StreamContext &StreamContext::operator=(StreamContext &&other) noexcept {
+    if (this == &other)
+        return *this;
+    Close();
+    fmtCtx = other.fmtCtx;
+    filename = other.filename;
+    videoIdx = other.videoIdx;
+    videoStream = other.videoStream;
+    audioIdx = other.audioIdx;
+    audioStream = other.audioStream;
+    other.fmtCtx = NULL;
+    other.videoStream = NULL;
+    other.audioStream = NULL;
+    return *this;
+}
+
+void StreamContext::Close() {
+    if (!fmtCtx)
+        return;
+    if (fmtCtx->iformat) {
+        MappedReader::CloseInput(&fmtCtx);
+    } else {
+        // a finished output already closed its writer
+        if (fmtCtx->oformat && !(fmtCtx->oformat->flags & AVFMT_NOFILE))
+            AsyncWriter::Close(&fmtCtx->pb);
+        avformat_free_context(fmtCtx);
     }
+    fmtCtx = NULL;
+    videoStream = NULL;
+    audioStream = NULL;
 }
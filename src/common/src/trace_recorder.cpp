@@ -0,0 +1,147 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../include/trace_recorder.h"
+
+#include <cerrno>
+#include <cstdio>
+
+#include "../include/transcode_stats.h"
+
+std::atomic<bool> TraceRecorder::enabled{false};
+
+// marks the buffer of an exiting thread so Write() can free it
+struct TraceThreadSlot {
+    void *buffer = NULL;
+    std::mutex *mutex = NULL;
+    bool *exited = NULL;
+
+    ~TraceThreadSlot() {
+        if (!mutex)
+            return;
+        std::lock_guard<std::mutex> lock(*mutex);
+        *exited = true;
+    }
+};
+
+static thread_local TraceThreadSlot trace_slot;
+
+TraceRecorder &TraceRecorder::Instance() {
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+void TraceRecorder::Start() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    reset_buffers();
+    origin = TranscodeCounters::Now();
+    enabled = true;
+}
+
+void TraceRecorder::reset_buffers() {
+    // the buffers of exited threads are only kept until they are written
+    for (size_t i = 0; i < buffers.size();) {
+        ThreadBuffer *b = buffers[i].get();
+        if (b->exited) {
+            buffers.erase(buffers.begin() + i);
+            continue;
+        }
+        b->chunks.clear();
+        b->count = 0;
+        b->dropped = 0;
+        i++;
+    }
+}
+
+TraceRecorder::ThreadBuffer *TraceRecorder::thread_buffer() {
+    if (trace_slot.buffer)
+        return (ThreadBuffer *)trace_slot.buffer;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    buffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+    ThreadBuffer *b = buffers.back().get();
+    b->tid = nextTid++;
+    trace_slot.buffer = b;
+    trace_slot.mutex = &mutex;
+    trace_slot.exited = &b->exited;
+    return b;
+}
+
+void TraceRecorder::SetThreadName(const char *name, int index) {
+    if (!Enabled())
+        return;
+    ThreadBuffer *b = thread_buffer();
+    b->name = index >= 0 ? std::string(name) + " " + std::to_string(index) : name;
+}
+
+void TraceRecorder::Record(const char *name, int stream, int64_t start, int64_t end) {
+    if (!Enabled())
+        return;
+    ThreadBuffer *b = thread_buffer();
+    size_t chunk = b->count / TRACE_EVENTS_PER_CHUNK;
+
+    if (chunk == b->chunks.size()) {
+        if (chunk >= TRACE_MAX_CHUNKS) {
+            b->dropped++;
+            return;
+        }
+        b->chunks.emplace_back(new TraceEvent[TRACE_EVENTS_PER_CHUNK]);
+    }
+    b->chunks[chunk][b->count % TRACE_EVENTS_PER_CHUNK] = {name, stream, start, end};
+    b->count++;
+}
+
+int TraceRecorder::Write(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const char *sep = "";
+    FILE *f;
+    int ret = 0;
+
+    enabled = false;
+    if (!(f = fopen(path.c_str(), "w")))
+        return -errno;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (const std::unique_ptr<ThreadBuffer> &b : buffers) {
+        std::string name = b->name.empty() ? "thread " + std::to_string(b->tid) : b->name;
+        if (b->dropped > 0)
+            name += " (" + std::to_string(b->dropped) + " events dropped)";
+        fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                   "\"args\":{\"name\":\"%s\"}}",
+                sep, b->tid, name.c_str());
+        sep = ",";
+
+        for (size_t i = 0; i < b->count; i++) {
+            const TraceEvent &e = b->chunks[i / TRACE_EVENTS_PER_CHUNK][i % TRACE_EVENTS_PER_CHUNK];
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                       "\"ts\":%.3f,\"dur\":%.3f",
+                    e.name, b->tid, (e.start - origin) / 1e3, (e.end - e.start) / 1e3);
+            if (e.stream >= 0)
+                fprintf(f, ",\"args\":{\"stream\":%d}", e.stream);
+            fputc('}', f);
+        }
+    }
+    fprintf(f, "\n]}\n");
+    if (ferror(f))
+        ret = -EIO;
+    if (fclose(f) != 0 && !ret)
+        ret = -errno;
+
+    reset_buffers();
+    return ret;
+}
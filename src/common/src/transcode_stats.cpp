@@ -0,0 +1,136 @@
+/*
+ * Copyright 2026 Jack Lau
+ * Email: jacklau1222gm@gmail.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../include/transcode_stats.h"
+
+#include <chrono>
+
+#include "../include/json_writer.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+static const char *stage_names[STAGE_COUNT] = {"demux", "decode", "filter", "encode", "mux"};
+
+static const char *counter_names[COUNTER_COUNT] = {
+    "packets_read",    "bytes_read",      "frames_decoded", "frames_filtered",
+    "packets_encoded", "packets_written", "bytes_written",
+};
+
+int64_t TranscodeCounters::Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void TranscodeCounters::Reset() {
+    for (int i = 0; i < STAGE_COUNT; i++)
+        stages[i] = 0;
+    for (Stream &s : streams) {
+        s.type = NULL;
+        s.copied = false;
+        for (int i = 0; i < COUNTER_COUNT; i++)
+            s.values[i] = 0;
+    }
+    mediaTime = 0;
+    start = Now();
+}
+
+void TranscodeCounters::SetStream(int index, const char *type, bool copied) {
+    if (index < 0 || index >= TRANSCODE_STATS_MAX_STREAMS)
+        return;
+    streams[index].copied = copied;
+    streams[index].type = type ? type : "unknown";
+}
+
+void TranscodeCounters::Snapshot(TranscodeStats *stats) const {
+    stats->wallTime = (Now() - start) / 1e9;
+    stats->mediaDuration = mediaTime / 1e6;
+    stats->speed = stats->wallTime > 0 ? stats->mediaDuration / stats->wallTime : 0;
+    for (int i = 0; i < STAGE_COUNT; i++)
+        stats->stages[i] = stages[i] / 1e9;
+
+    stats->streams.clear();
+    for (int i = 0; i < TRANSCODE_STATS_MAX_STREAMS; i++) {
+        const Stream &s = streams[i];
+        const char *type = s.type;
+        StreamStats stream;
+
+        if (!type)
+            continue;
+        stream.index = i;
+        stream.type = type;
+        stream.copied = s.copied;
+        for (int c = 0; c < COUNTER_COUNT; c++)
+            stream.counters[c] = s.values[c];
+        stats->streams.push_back(stream);
+    }
+}
+
+void TranscodeCounters::ReadResourceUsage(TranscodeStats *stats) {
+#ifndef _WIN32
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+        return;
+    stats->userTime = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    stats->systemTime = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#ifdef __APPLE__
+    stats->peakRss = usage.ru_maxrss;
+#else
+    stats->peakRss = (int64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+const char *TranscodeCounters::StageName(TranscodeStage stage) {
+    return stage >= 0 && stage < STAGE_COUNT ? stage_names[stage] : "unknown";
+}
+
+std::string TranscodeCounters::ToJson(const TranscodeStats &stats) {
+    JsonWriter json;
+
+    json.BeginObject()
+        .Key("ok").Bool(stats.ok)
+        .Key("wall_time").Double(stats.wallTime)
+        .Key("user_time").Double(stats.userTime)
+        .Key("system_time").Double(stats.systemTime)
+        .Key("peak_rss").Int(stats.peakRss)
+        .Key("media_duration").Double(stats.mediaDuration)
+        .Key("speed").Double(stats.speed);
+
+    json.Key("stages").BeginObject();
+    for (int i = 0; i < STAGE_COUNT; i++)
+        json.Key(stage_names[i]).Double(stats.stages[i]);
+    json.EndObject();
+
+    json.Key("streams").BeginArray();
+    for (const StreamStats &s : stats.streams) {
+        json.BeginObject()
+            .Key("index").Int(s.index)
+            .Key("type").String(s.type)
+            .Key("copied").Bool(s.copied);
+        for (int c = 0; c < COUNTER_COUNT; c++)
+            json.Key(counter_names[c]).Int(s.counters[c]);
+        json.EndObject();
+    }
+    json.EndArray();
+
+    json.EndObject();
+    return json.GetString();
+}
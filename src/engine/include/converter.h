@@ -33,10 +33,17 @@ public:
     bool set_transcoder(std::string transcoderName);
     bool convert_format(const std::string &src, const std::string &dst);
 
+    // what the last conversion cost, per stage where the transcoder knows
+    const TranscodeStats &get_stats() const { return stats; }
+    // also write the statistics of every conversion as JSON to path
+    void set_stats_file(const std::string &path) { statsFile = path; }
+
 private:
     Transcoder *transcoder = NULL;
     bool copyVideo;
     bool copyAudio;
+    TranscodeStats stats;
+    std::string statsFile;
 
 public:
     ProcessParameter *processParameter = NULL;
@@ -17,6 +17,12 @@
 
 #include "../include/converter.h"
 
+extern "C" {
+#include <libavutil/log.h>
+};
+
+#include <fstream>
+
 #if defined(ENABLE_BMF)
     #include "../../transcoder/include/transcoder_bmf.h"
 #endif
@@ -101,7 +107,35 @@ bool Converter::convert_format(const std::string &src, const std::string &dst) {
         copyAudio = false;
     }
 
-    return transcoder->transcode(src, dst);
+    TranscodeStats before;
+    TranscodeCounters::ReadResourceUsage(&before);
+    int64_t start = TranscodeCounters::Now();
+
+    bool ok = transcoder->transcode(src, dst);
+    ProgressReporter::Instance().Finish(ok);
+
+    // the stage counters come from the transcoder, the cost of the whole
+    // conversion is measured here for every transcoder alike
+    stats = TranscodeStats();
+    transcoder->fill_stats(&stats);
+    TranscodeCounters::ReadResourceUsage(&stats);
+    stats.ok = ok;
+    stats.wallTime = (TranscodeCounters::Now() - start) / 1e9;
+    stats.userTime -= before.userTime;
+    stats.systemTime -= before.systemTime;
+    stats.speed = stats.wallTime > 0 ? stats.mediaDuration / stats.wallTime : 0;
+    av_log(NULL, AV_LOG_INFO,
+           "Converted in %.2fs (%.2fx), cpu %.2fs user %.2fs system, peak rss %lld KiB\n",
+           stats.wallTime, stats.speed, stats.userTime, stats.systemTime,
+           (long long)(stats.peakRss / 1024));
+    if (!statsFile.empty()) {
+        std::ofstream out(statsFile);
+        out << TranscodeCounters::ToJson(stats) << "\n";
+        if (!out)
+            av_log(NULL, AV_LOG_ERROR, "Could not write statistics to %s\n",
+                   statsFile.c_str());
+    }
+    return ok;
 }
 
 Converter::~Converter() {
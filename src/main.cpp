@@ -1,10 +1,19 @@
+#include "common/include/batch_probe.h"
 #include "common/include/encode_parameter.h"
+#include "common/include/log_sink.h"
+#include "common/include/media_analyzer.h"
+#include "common/include/probe_cache.h"
 #include "common/include/process_parameter.h"
+#include "common/include/progress_reporter.h"
+#include "common/include/trace_recorder.h"
 #include "engine/include/converter.h"
+#include <climits>
 #include <cstring>
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <filesystem>
+#include <vector>
 
 #if defined(ENABLE_GUI)
     #include "builder/include/open_converter.h"
@@ -28,6 +37,9 @@ static bool is_valid_output_candidate(const fs::path &p) {
 void printUsage(const char *programName) {
     std::cout << "Usage: " << programName
               << " [options] input_file output_file\n"
+              << "       " << programName << " --analyze [options] input_file [output.json]\n"
+              << "       " << programName << " --probe [--jobs N] file_or_directory...\n"
+              << "Use - as input_file or output_file to read stdin or write stdout.\n"
               << "Options:\n"
               << "  --transcoder TYPE        Set transcoder type (FFMPEG, BMF, "
                  "FFTOOL)\n"
@@ -36,11 +48,53 @@ void printUsage(const char *programName) {
               << "  -a, --audio-codec CODEC  Set audio codec\n"
               << "  -b:v, --bitrate:video BITRATE    Set bitrate for video codec\n"
               << "  -b:a, --bitrate:audio BITRATE    Set bitrate for audio codec\n"
+              << "  -f FORMAT                Set the output container format (needed for stdout)\n"
+              << "  --frag-duration SECONDS  Write fragmented MP4 with fragments of this length,\n"
+              << "                           MP4 on stdout is always fragmented\n"
+              << "  --segment-duration SECONDS  Target segment length of HLS/DASH output (default 6)\n"
+              << "  --playlist-type TYPE     HLS playlist type (vod, event, live)\n"
+              << "  --segment-name TEMPLATE  Segment file names, e.g. seg_%05d.ts for HLS or\n"
+              << "                           seg_$RepresentationID$_$Number$.m4s for DASH\n"
+              << "  --hls-segment-type TYPE  HLS segment container (mpegts, fmp4)\n"
               << "  -pix_fmt PIX_FMT         Set pixel format for video\n"
               << "  -scale SCALE(w)x(h)      Set scale for video (width x height)\n"
               << "  -ss START_TIME           Set start time for cutting (format: HH:MM:SS or seconds)\n"
               << "  -to END_TIME             Set end time for cutting (format: HH:MM:SS or seconds)\n"
               << "  -t DURATION              Set duration for cutting (format: HH:MM:SS or seconds)\n"
+              << "  --smart-cut              Re-encode only around the cut points, copy the rest of the video\n"
+              << "  --chunks N               Split the video at keyframes and encode N chunks in parallel\n"
+              << "  --min-chunk-duration SECONDS  Minimum length of a chunk (default 10)\n"
+              << "  --decoder-threads N      Set decoder thread count (0 = auto)\n"
+              << "  --decoder-thread-type TYPE  Set decoder threading (frame, slice)\n"
+              << "  --encoder-threads N      Set encoder thread count (0 = auto)\n"
+              << "  --encoder-thread-type TYPE  Set encoder threading (frame, slice)\n"
+              << "  --filter-threads N       Set filter graph thread count (0 = auto)\n"
+              << "  --map SELECTOR:ACTION    Copy, transcode or drop streams, can be repeated\n"
+              << "                           (e.g. 2:drop, s:copy, a,lang=eng:transcode)\n"
+              << "  --rendition WxH[@BITRATE]:OUTPUT  Also write OUTPUT scaled to WxH from the same\n"
+              << "                           decode, can be repeated (e.g. 1280x720@2500k:out_720p.mp4)\n"
+              << "  --output-buffer SIZE     Write the output behind SIZE byte buffers (e.g. 8M)\n"
+              << "  --sync-every SIZE        Flush the output to disk every SIZE bytes written\n"
+              << "  --readahead SIZE         Prefetch SIZE bytes of a local input ahead of the demuxer\n"
+              << "  --no-preallocate         Do not reserve the expected output size up front\n"
+              << "  --probesize SIZE         Read at most SIZE bytes to find the input streams\n"
+              << "  --analyzeduration TIME   Analyze at most TIME of the input to find the streams\n"
+              << "  --analyze                Read every packet and print bitrate, GOP and packet\n"
+              << "                           size statistics as JSON instead of converting\n"
+              << "  --analyze-decode         Also decode the video for frame types and luma\n"
+              << "  --analyze-keyframes      Like --analyze-decode, keyframes only\n"
+              << "  --bitrate-window SECONDS Length of the peak bitrate window (default 1)\n"
+              << "  --probe                  Probe files and directory trees, one JSON line per file\n"
+              << "  --jobs N                 Files probed at once (default: one per CPU core)\n"
+              << "  --loglevel LEVEL         FFmpeg log level (quiet, error, warning, info, verbose,\n"
+              << "                           debug, trace or a number, default info)\n"
+              << "  --progress TARGET        Where progress lines go: - for stdout, stderr (default),\n"
+              << "                           a file descriptor number or none\n"
+              << "  --progress-format FORMAT Progress lines as kv (key=value, default) or json\n"
+              << "  --progress-interval SECONDS  Time between two progress lines (default 0.5)\n"
+              << "  --stats FILE             Write per-stage timing and resource use as JSON\n"
+              << "  --trace FILE             Record every pipeline call and write a Chrome trace\n"
+              << "                           (open in Perfetto or chrome://tracing)\n"
               << "  -h, --help               Show this help message\n"
               << "\n"
               << "Note: Use either -to or -t, not both. If both are specified, -to takes precedence.\n";
@@ -84,6 +138,45 @@ bool parseTime(const std::string &s, double &out_seconds) {
     }
 }
 
+// SELECTOR[,SELECTOR...]:ACTION, a selector is a stream index, a type
+// (v, a, s, d, t or the full name) or lang=CODE
+bool parseStreamRule(const std::string &s, StreamRule &rule) {
+    size_t colon = s.rfind(':');
+    if (colon == std::string::npos || colon == 0)
+        return false;
+
+    std::string action = s.substr(colon + 1);
+    if (action == "copy") rule.action = STREAM_ACTION_COPY;
+    else if (action == "transcode") rule.action = STREAM_ACTION_TRANSCODE;
+    else if (action == "drop") rule.action = STREAM_ACTION_DROP;
+    else return false;
+
+    size_t start = 0;
+    while (start < colon) {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos || end > colon) end = colon;
+        std::string sel = s.substr(start, end - start);
+        start = end + 1;
+
+        if (sel.empty()) return false;
+        if (sel.compare(0, 5, "lang=") == 0) {
+            rule.language = sel.substr(5);
+        } else if (std::isdigit(static_cast<unsigned char>(sel[0]))) {
+            try {
+                rule.index = std::stoi(sel);
+            } catch (...) {
+                return false;
+            }
+        } else if (sel == "v" || sel == "video") rule.type = "video";
+        else if (sel == "a" || sel == "audio") rule.type = "audio";
+        else if (sel == "s" || sel == "subtitle") rule.type = "subtitle";
+        else if (sel == "d" || sel == "data") rule.type = "data";
+        else if (sel == "t" || sel == "attachment") rule.type = "attachment";
+        else return false;
+    }
+    return true;
+}
+
 bool parseBitrate(const std::string &s, int64_t &out_bps) {
 
     // split numeric prefix and optional single unit
@@ -125,6 +218,77 @@ bool parseBitrate(const std::string &s, int64_t &out_bps) {
     return true;
 }
 
+// WxH[@BITRATE]:OUTPUT, the first colon ends the size so Windows drive
+// letters in OUTPUT are fine
+bool parseRendition(const std::string &s, Rendition &rendition) {
+    size_t colon = s.find(':');
+    if (colon == std::string::npos || colon + 1 == s.size())
+        return false;
+    std::string spec = s.substr(0, colon);
+    rendition.outputPath = s.substr(colon + 1);
+
+    size_t at = spec.find('@');
+    if (at != std::string::npos) {
+        if (!parseBitrate(spec.substr(at + 1), rendition.videoBitRate))
+            return false;
+        spec = spec.substr(0, at);
+    }
+
+    size_t x = spec.find('x');
+    if (x == std::string::npos)
+        return false;
+    try {
+        int width = std::stoi(spec.substr(0, x));
+        int height = std::stoi(spec.substr(x + 1));
+        if (width <= 0 || height <= 0 || width > UINT16_MAX || height > UINT16_MAX)
+            return false;
+        rendition.width = static_cast<uint16_t>(width);
+        rendition.height = static_cast<uint16_t>(height);
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
+
+// deep analysis of the input, the JSON goes to outputFile or stdout
+static bool runAnalysis(const std::string &inputFile, const std::string &outputFile,
+                        const MediaAnalyzerOptions &options) {
+    MediaAnalyzer analyzer(options);
+    MediaAnalysis analysis;
+    int ret = analyzer.Analyze(inputFile == "-" ? "pipe:0" : inputFile, &analysis);
+    if (ret < 0) {
+        char msg[128];
+        av_strerror(ret, msg, sizeof(msg));
+        std::cerr << "Analysis failed: " << msg << "\n";
+        return false;
+    }
+
+    std::string json = MediaAnalyzer::ToJson(analysis);
+    if (outputFile.empty() || outputFile == "-") {
+        std::cout << json << std::endl;
+        return true;
+    }
+    std::ofstream out(outputFile);
+    out << json << "\n";
+    if (!out) {
+        std::cerr << "Error: Could not write '" << outputFile << "'\n";
+        return false;
+    }
+    return true;
+}
+
+// one JSON line per file on stdout, the summary goes to stderr
+static bool runProbe(const std::vector<std::string> &paths, const BatchProbeOptions &options) {
+    BatchProbe batch(options);
+    BatchProbeStats stats;
+    batch.Run(paths, std::cout, &stats);
+
+    std::cerr << "Probed " << stats.files << " files (" << stats.failed << " failed) in "
+              << stats.elapsed << "s, "
+              << (stats.elapsed > 0 ? stats.files / stats.elapsed : 0.0) << " files/s\n";
+    return stats.files > stats.failed;
+}
+
 static bool confirm_overwrite(const fs::path &p) {
     std::string line;
     while (true) {
@@ -164,6 +328,43 @@ bool handleCLI(int argc, char *argv[]) {
     double startTime = -1.0;
     double endTime = -1.0;
     double duration = -1.0;
+    bool smartCut = false;
+    int chunkCount = 1;
+    double minChunkDuration = -1.0;
+    int decoderThreads = -1;
+    int encoderThreads = -1;
+    int filterThreads = -1;
+    std::string decoderThreadType;
+    std::string encoderThreadType;
+    std::vector<StreamRule> streamRules;
+    std::vector<Rendition> renditions;
+    int64_t outputBufferSize = -1;
+    int64_t outputSyncInterval = -1;
+    bool outputPreallocate = true;
+    int64_t inputReadahead = -1;
+    int64_t probeSize = -1;
+    double analyzeDuration = -1.0;
+    std::string outputFormat;
+    double fragmentDuration = -1.0;
+    double segmentDuration = -1.0;
+    std::string playlistType;
+    std::string segmentTemplate;
+    std::string segmentType;
+    bool analyze = false;
+    MediaAnalyzerOptions analyzerOptions;
+    // with --probe every positional argument is a file or a directory
+    bool probe = false;
+    BatchProbeOptions probeOptions;
+    int logLevel = AV_LOG_INFO;
+    ProgressOptions progressOptions;
+    progressOptions.fd = 2;
+    std::string statsFile;
+    std::string traceFile;
+    std::vector<std::string> probePaths;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--probe") == 0)
+            probe = true;
+    }
 
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -242,16 +443,264 @@ bool handleCLI(int argc, char *argv[]) {
                     return false;
                 }
             }
+        } else if (strcmp(argv[i], "--smart-cut") == 0) {
+            smartCut = true;
+        } else if (strcmp(argv[i], "--chunks") == 0) {
+            if (i + 1 < argc) {
+                try {
+                    chunkCount = std::stoi(argv[++i]);
+                } catch (...) {
+                    chunkCount = 0;
+                }
+                if (chunkCount < 1) {
+                    std::cerr << "Error: Invalid chunk count '" << argv[i] << "'\n";
+                    return false;
+                }
+            }
+        } else if (strcmp(argv[i], "--min-chunk-duration") == 0) {
+            if (i + 1 < argc) {
+                if (!parseTime(argv[++i], minChunkDuration)) {
+                    std::cerr << "Error: Invalid minimum chunk duration format\n";
+                    return false;
+                }
+            }
+        } else if (strcmp(argv[i], "--decoder-threads") == 0 ||
+                   strcmp(argv[i], "--encoder-threads") == 0 ||
+                   strcmp(argv[i], "--filter-threads") == 0) {
+            if (i + 1 < argc) {
+                int *threads = &filterThreads;
+                if (strcmp(argv[i], "--decoder-threads") == 0)
+                    threads = &decoderThreads;
+                else if (strcmp(argv[i], "--encoder-threads") == 0)
+                    threads = &encoderThreads;
+                try {
+                    *threads = std::stoi(argv[++i]);
+                } catch (...) {
+                    *threads = -1;
+                }
+                if (*threads < 0) {
+                    std::cerr << "Error: Invalid thread count '" << argv[i] << "'\n";
+                    return false;
+                }
+            }
+        } else if (strcmp(argv[i], "--decoder-thread-type") == 0 ||
+                   strcmp(argv[i], "--encoder-thread-type") == 0) {
+            if (i + 1 < argc) {
+                std::string type = argv[i + 1];
+                if (type != "frame" && type != "slice") {
+                    std::cerr << "Error: Thread type must be 'frame' or 'slice'\n";
+                    return false;
+                }
+                if (strcmp(argv[i], "--decoder-thread-type") == 0)
+                    decoderThreadType = type;
+                else
+                    encoderThreadType = type;
+                i++;
+            }
+        } else if (strcmp(argv[i], "--map") == 0) {
+            if (i + 1 < argc) {
+                StreamRule rule;
+                if (!parseStreamRule(argv[++i], rule)) {
+                    std::cerr << "Error: Invalid stream mapping '" << argv[i] << "'\n";
+                    return false;
+                }
+                streamRules.push_back(rule);
+            }
+        } else if (strcmp(argv[i], "--rendition") == 0) {
+            if (i + 1 < argc) {
+                Rendition rendition;
+                if (!parseRendition(argv[++i], rendition)) {
+                    std::cerr << "Error: Invalid rendition '" << argv[i] << "'\n";
+                    return false;
+                }
+                renditions.push_back(rendition);
+            }
+        } else if (strcmp(argv[i], "--output-buffer") == 0 ||
+                   strcmp(argv[i], "--sync-every") == 0) {
+            if (i + 1 < argc) {
+                int64_t size;
+                if (!parseBitrate(argv[i + 1], size) || size > INT_MAX) {
+                    std::cerr << "Error: Invalid size '" << argv[i + 1] << "'\n";
+                    return false;
+                }
+                if (strcmp(argv[i], "--output-buffer") == 0)
+                    outputBufferSize = size;
+                else
+                    outputSyncInterval = size;
+                i++;
+            }
+        } else if (strcmp(argv[i], "--readahead") == 0) {
+            if (i + 1 < argc) {
+                if (!parseBitrate(argv[++i], inputReadahead)) {
+                    std::cerr << "Error: Invalid size '" << argv[i] << "'\n";
+                    return false;
+                }
+            }
+        } else if (strcmp(argv[i], "--probesize") == 0) {
+            if (i + 1 < argc) {
+                if (!parseBitrate(argv[++i], probeSize) || probeSize < 32) {
+                    std::cerr << "Error: Invalid probe size '" << argv[i] << "'\n";
+                    return false;
+                }
+            }
+        } else if (strcmp(argv[i], "--analyzeduration") == 0) {
+            if (i + 1 < argc) {
+                if (!parseTime(argv[++i], analyzeDuration) || analyzeDuration <= 0.0) {
+                    std::cerr << "Error: Invalid analyze duration format\n";
+                    return false;
+                }
+            }
+        } else if (strcmp(argv[i], "-f") == 0) {
+            if (i + 1 < argc) {
+                outputFormat = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--frag-duration") == 0) {
+            if (i + 1 < argc) {
+                if (!parseTime(argv[++i], fragmentDuration)) {
+                    std::cerr << "Error: Invalid fragment duration format\n";
+                    return false;
+                }
+            }
+        } else if (strcmp(argv[i], "--segment-duration") == 0) {
+            if (i + 1 < argc) {
+                if (!parseTime(argv[++i], segmentDuration) || segmentDuration <= 0.0) {
+                    std::cerr << "Error: Invalid segment duration format\n";
+                    return false;
+                }
+            }
+        } else if (strcmp(argv[i], "--playlist-type") == 0) {
+            if (i + 1 < argc) {
+                playlistType = argv[++i];
+                if (playlistType != "vod" && playlistType != "event" && playlistType != "live") {
+                    std::cerr << "Error: Playlist type must be 'vod', 'event' or 'live'\n";
+                    return false;
+                }
+            }
+        } else if (strcmp(argv[i], "--segment-name") == 0) {
+            if (i + 1 < argc) {
+                segmentTemplate = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--hls-segment-type") == 0) {
+            if (i + 1 < argc) {
+                segmentType = argv[++i];
+                if (segmentType != "mpegts" && segmentType != "fmp4") {
+                    std::cerr << "Error: HLS segment type must be 'mpegts' or 'fmp4'\n";
+                    return false;
+                }
+            }
+        } else if (strcmp(argv[i], "--no-preallocate") == 0) {
+            outputPreallocate = false;
+        } else if (strcmp(argv[i], "--probe") == 0) {
+            // handled above
+        } else if (strcmp(argv[i], "--jobs") == 0) {
+            if (i + 1 < argc) {
+                try {
+                    probeOptions.jobs = std::stoi(argv[++i]);
+                } catch (...) {
+                    probeOptions.jobs = -1;
+                }
+                if (probeOptions.jobs < 1) {
+                    std::cerr << "Error: Invalid job count '" << argv[i] << "'\n";
+                    return false;
+                }
+            }
+        } else if (strcmp(argv[i], "--loglevel") == 0) {
+            if (i + 1 < argc) {
+                if (!LogSink::ParseLevel(argv[++i], &logLevel)) {
+                    std::cerr << "Error: Invalid log level '" << argv[i] << "'\n";
+                    return false;
+                }
+            }
+        } else if (strcmp(argv[i], "--progress") == 0) {
+            if (i + 1 < argc) {
+                std::string target = argv[++i];
+                if (target == "-" || target == "stdout") {
+                    progressOptions.fd = 1;
+                } else if (target == "stderr") {
+                    progressOptions.fd = 2;
+                } else if (target == "none") {
+                    progressOptions.fd = -1;
+                } else {
+                    try {
+                        progressOptions.fd = std::stoi(target);
+                    } catch (...) {
+                        progressOptions.fd = -1;
+                    }
+                    if (progressOptions.fd < 0) {
+                        std::cerr << "Error: Invalid progress target '" << target << "'\n";
+                        return false;
+                    }
+                }
+            }
+        } else if (strcmp(argv[i], "--progress-format") == 0) {
+            if (i + 1 < argc) {
+                progressOptions.format = argv[++i];
+                if (progressOptions.format != "kv" && progressOptions.format != "json") {
+                    std::cerr << "Error: Progress format must be 'kv' or 'json'\n";
+                    return false;
+                }
+            }
+        } else if (strcmp(argv[i], "--progress-interval") == 0) {
+            if (i + 1 < argc) {
+                if (!parseTime(argv[++i], progressOptions.interval) ||
+                    progressOptions.interval < 0.0) {
+                    std::cerr << "Error: Invalid progress interval format\n";
+                    return false;
+                }
+            }
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            if (i + 1 < argc) {
+                traceFile = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            if (i + 1 < argc) {
+                statsFile = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--analyze") == 0) {
+            analyze = true;
+        } else if (strcmp(argv[i], "--analyze-decode") == 0 ||
+                   strcmp(argv[i], "--analyze-keyframes") == 0) {
+            analyze = true;
+            analyzerOptions.decode = true;
+            analyzerOptions.keyframesOnly = strcmp(argv[i], "--analyze-keyframes") == 0;
+        } else if (strcmp(argv[i], "--bitrate-window") == 0) {
+            if (i + 1 < argc) {
+                if (!parseTime(argv[++i], analyzerOptions.bitrateWindow) ||
+                    analyzerOptions.bitrateWindow <= 0.0) {
+                    std::cerr << "Error: Invalid bitrate window format\n";
+                    return false;
+                }
+            }
+        } else if (probe) {
+            // every other argument of a probe run is a path
+            if (argv[i][0] == '-' && argv[i][1]) {
+                std::cerr << "Invalid or unexpected argument: '" << argv[i] << "'\n";
+                printUsage(argv[0]);
+                return false;
+            }
+            probePaths.push_back(argv[i]);
         } else {
             // positional argument: validate as input (existing) or output (candidate)
             fs::path p(argv[i]);
 
-            if (inputFile.empty() && (is_existing_regular_file(p))) {
+            if (strcmp(argv[i], "-") == 0 && (inputFile.empty() || outputFile.empty())) {
+                // stdin or stdout
+                if (inputFile.empty())
+                    inputFile = argv[i];
+                else
+                    outputFile = argv[i];
+            } else if (inputFile.empty() && (is_existing_regular_file(p))) {
                 inputFile = p.string();
             } else if (outputFile.empty() && is_valid_output_candidate(p) && !inputFile.empty()) {
-                if (fs::exists(p))
+                if (fs::exists(p)) {
+                    // the answer would be read from the media on stdin
+                    if (inputFile == "-") {
+                        std::cerr << "Output file already exists: '" << p.string() << "'\n";
+                        return false;
+                    }
                     if (!confirm_overwrite(p))
                         return false;
+                }
                 outputFile = p.string();
             } else {
                 // This catches stray tokens like "b" "0" as well as duplicates/ambiguous args
@@ -262,12 +711,51 @@ bool handleCLI(int argc, char *argv[]) {
         }
     }
 
+    // log lines are written by a background thread from here on
+    LogSink::Instance().Start(logLevel);
+
+    if (probeSize > 0 || analyzeDuration > 0.0) {
+        ProbeLimits limits;
+        limits.probeSize = probeSize > 0 ? probeSize : 0;
+        limits.analyzeDuration =
+            analyzeDuration > 0.0 ? (int64_t)(analyzeDuration * AV_TIME_BASE) : 0;
+        ProbeCache::Instance().SetLimits(limits);
+    }
+
+    if (probe) {
+        if (probePaths.empty()) {
+            std::cerr << "Error: Nothing to probe\n";
+            return false;
+        }
+        return runProbe(probePaths, probeOptions);
+    }
+
+    if (analyze && !inputFile.empty()) {
+        if (decoderThreads >= 0)
+            analyzerOptions.decoderThreads = decoderThreads;
+        return runAnalysis(inputFile, outputFile, analyzerOptions);
+    }
+
     if (inputFile.empty() || outputFile.empty()) {
         std::cerr << "Error: Input and output files must be specified\n";
         printUsage(argv[0]);
         return false;
     }
 
+    // the media owns stdout, messages go to stderr
+    if (outputFile == "-") {
+        std::cout.rdbuf(std::cerr.rdbuf());
+        if (outputFormat.empty()) {
+            std::cerr << "Error: Writing to stdout needs an output format (-f)\n";
+            return false;
+        }
+        if (progressOptions.fd == 1) {
+            std::cerr << "Error: Progress cannot go to stdout while the output does\n";
+            return false;
+        }
+    }
+    ProgressReporter::Instance().Configure(progressOptions);
+
     // Create parameters
     ProcessParameter *processParam = new ProcessParameter();
     EncodeParameter *encodeParam = new EncodeParameter();
@@ -299,6 +787,63 @@ bool handleCLI(int argc, char *argv[]) {
     if (audioBitRate != -1) {
         encodeParam->set_audio_bit_rate(audioBitRate);
     }
+    if (chunkCount > 1) {
+        encodeParam->SetChunkCount(chunkCount);
+    }
+    if (minChunkDuration > 0.0) {
+        encodeParam->SetMinChunkDuration(minChunkDuration);
+    }
+    if (decoderThreads >= 0) {
+        encodeParam->SetDecoderThreads(decoderThreads);
+    }
+    if (encoderThreads >= 0) {
+        encodeParam->SetEncoderThreads(encoderThreads);
+    }
+    if (filterThreads >= 0) {
+        encodeParam->SetFilterThreads(filterThreads);
+    }
+    if (!decoderThreadType.empty()) {
+        encodeParam->SetDecoderThreadType(decoderThreadType);
+    }
+    if (!encoderThreadType.empty()) {
+        encodeParam->SetEncoderThreadType(encoderThreadType);
+    }
+    for (const StreamRule &rule : streamRules) {
+        encodeParam->AddStreamRule(rule);
+    }
+    for (const Rendition &rendition : renditions) {
+        encodeParam->AddRendition(rendition);
+    }
+    if (outputBufferSize >= 0) {
+        encodeParam->SetOutputBufferSize(static_cast<int>(outputBufferSize));
+    }
+    if (outputSyncInterval >= 0) {
+        encodeParam->SetOutputSyncInterval(outputSyncInterval);
+    }
+    if (!outputPreallocate) {
+        encodeParam->SetOutputPreallocate(false);
+    }
+    if (inputReadahead >= 0) {
+        encodeParam->SetInputReadahead(inputReadahead);
+    }
+    if (!outputFormat.empty()) {
+        encodeParam->SetOutputFormat(outputFormat);
+    }
+    if (fragmentDuration > 0.0) {
+        encodeParam->SetFragmentDuration(fragmentDuration);
+    }
+    if (segmentDuration > 0.0) {
+        encodeParam->SetSegmentDuration(segmentDuration);
+    }
+    if (!playlistType.empty()) {
+        encodeParam->SetPlaylistType(playlistType);
+    }
+    if (!segmentTemplate.empty()) {
+        encodeParam->SetSegmentTemplate(segmentTemplate);
+    }
+    if (!segmentType.empty()) {
+        encodeParam->SetSegmentType(segmentType);
+    }
 
     // Handle time parameters with validation
     if (startTime >= 0.0) {
@@ -316,6 +861,9 @@ bool handleCLI(int argc, char *argv[]) {
         std::cout << "Duration: " << duration << "s, calculated end time: "
                   << calculatedEndTime << "s\n";
     }
+    if (smartCut) {
+        encodeParam->SetSmartCut(true);
+    }
 
     // Validate time range (will be checked in transcoder as well)
     if (startTime >= 0.0 && encodeParam->GetEndTime() >= 0.0) {
@@ -333,9 +881,18 @@ bool handleCLI(int argc, char *argv[]) {
         result = false;
         goto end;
     }
+    if (!statsFile.empty()) {
+        converter.set_stats_file(statsFile);
+    }
 
     // Perform conversion
+    if (!traceFile.empty()) {
+        TraceRecorder::Instance().Start();
+    }
     result = converter.convert_format(inputFile, outputFile);
+    if (!traceFile.empty() && TraceRecorder::Instance().Write(traceFile) < 0) {
+        std::cerr << "Error: Could not write trace '" << traceFile << "'\n";
+    }
     if (result) {
         std::cout << "Conversion completed successfully\n";
     } else {
@@ -350,8 +907,11 @@ end:
 }
 
 int main(int argc, char *argv[]) {
-    if (argc > 1)
-        return handleCLI(argc, argv) ? 0 : 1;
+    if (argc > 1) {
+        bool ok = handleCLI(argc, argv);
+        LogSink::Instance().Stop();
+        return ok ? 0 : 1;
+    }
 
 #if defined(ENABLE_GUI)
     QApplication app(argc, argv);
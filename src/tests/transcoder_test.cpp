@@ -1,11 +1,34 @@
+#include "../common/include/async_writer.h"
+#include "../common/include/batch_probe.h"
 #include "../common/include/encode_parameter.h"
+#include "../common/include/log_sink.h"
+#include "../common/include/mapped_reader.h"
+#include "../common/include/media_analyzer.h"
+#include "../common/include/packet_index.h"
+#include "../common/include/phase_hook.h"
+#include "../common/include/probe_cache.h"
+#include "../common/include/progress_reporter.h"
+#include "../common/include/trace_recorder.h"
 #include "../engine/include/converter.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+};
+
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <gtest/gtest.h>
 #include <iostream>
 #include <memory>
+#include <sstream>
 #include <string>
+#include <thread>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 // Test fixture for transcoder tests
 class TranscoderTest : public ::testing::Test {
@@ -32,6 +55,164 @@ protected:
     std::filesystem::path test_dir_;
 };
 
+#define CLIP_FPS 25
+#define CLIP_GOP 12
+
+// Encode a synthetic H.264 clip with a keyframe every CLIP_GOP frames and
+// B-frames in closed GOPs, the keyframes of test.mp4 are too sparse to
+// split it. Returns false when libx264 is not available.
+static bool write_test_clip(const std::string &path, int frames) {
+    const AVCodec *codec = avcodec_find_encoder_by_name("libx264");
+    AVFormatContext *fmtCtx = NULL;
+    AVCodecContext *encCtx = NULL;
+    AVStream *stream;
+    AVFrame *frame = NULL;
+    AVPacket *pkt = NULL;
+    bool ok = false;
+    int ret;
+
+    if (!codec || avformat_alloc_output_context2(&fmtCtx, NULL, NULL, path.c_str()) < 0)
+        return false;
+    if (!(encCtx = avcodec_alloc_context3(codec)) || !(stream = avformat_new_stream(fmtCtx, NULL)) ||
+        !(frame = av_frame_alloc()) || !(pkt = av_packet_alloc()))
+        goto end;
+    encCtx->width = 320;
+    encCtx->height = 240;
+    encCtx->pix_fmt = AV_PIX_FMT_YUV420P;
+    encCtx->time_base = AVRational{1, CLIP_FPS};
+    encCtx->framerate = AVRational{CLIP_FPS, 1};
+    encCtx->gop_size = CLIP_GOP;
+    encCtx->max_b_frames = 2;
+    if (fmtCtx->oformat->flags & AVFMT_GLOBALHEADER)
+        encCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    av_opt_set(encCtx->priv_data, "preset", "ultrafast", 0);
+    // ultrafast turns B-frames off, keep them and the scenecut keyframes out
+    av_opt_set(encCtx->priv_data, "x264-params", "bframes=2:scenecut=0", 0);
+    if (avcodec_open2(encCtx, codec, NULL) < 0 ||
+        avcodec_parameters_from_context(stream->codecpar, encCtx) < 0)
+        goto end;
+    stream->time_base = encCtx->time_base;
+    if (avio_open(&fmtCtx->pb, path.c_str(), AVIO_FLAG_WRITE) < 0)
+        goto end;
+    if (avformat_write_header(fmtCtx, NULL) < 0)
+        goto end;
+
+    frame->format = encCtx->pix_fmt;
+    frame->width = encCtx->width;
+    frame->height = encCtx->height;
+    if (av_frame_get_buffer(frame, 0) < 0)
+        goto end;
+    for (int i = 0; i <= frames; i++) {
+        if (i < frames) {
+            if (av_frame_make_writable(frame) < 0)
+                goto end;
+            for (int y = 0; y < frame->height; y++)
+                for (int x = 0; x < frame->width; x++)
+                    frame->data[0][y * frame->linesize[0] + x] = (uint8_t)(x + y + i * 3);
+            for (int y = 0; y < frame->height / 2; y++)
+                for (int x = 0; x < frame->width / 2; x++) {
+                    frame->data[1][y * frame->linesize[1] + x] = (uint8_t)(128 + y + i * 2);
+                    frame->data[2][y * frame->linesize[2] + x] = (uint8_t)(64 + x + i * 5);
+                }
+            frame->pts = i;
+        }
+        if (avcodec_send_frame(encCtx, i < frames ? frame : NULL) < 0)
+            goto end;
+        while ((ret = avcodec_receive_packet(encCtx, pkt)) >= 0) {
+            av_packet_rescale_ts(pkt, encCtx->time_base, stream->time_base);
+            pkt->stream_index = stream->index;
+            if (av_interleaved_write_frame(fmtCtx, pkt) < 0)
+                goto end;
+        }
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+            goto end;
+    }
+    ok = av_write_trailer(fmtCtx) >= 0;
+
+end:
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&encCtx);
+    if (fmtCtx)
+        avio_closep(&fmtCtx->pb);
+    avformat_free_context(fmtCtx);
+    return ok;
+}
+
+typedef struct VideoCheck {
+    int packets = 0;
+    int frames = 0;
+    int errors = 0;         // packets the decoder rejected
+    bool monotonic = true;  // dts and frame pts strictly increasing
+    double duration = 0;    // first to last frame plus one frame, in seconds
+} VideoCheck;
+
+// decode every packet of the main video stream of a file
+static VideoCheck check_video(const std::string &path) {
+    VideoCheck check;
+    AVFormatContext *fmtCtx = NULL;
+    AVCodecContext *decCtx = NULL;
+    const AVCodec *codec = NULL;
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    int64_t lastDts = AV_NOPTS_VALUE, firstPts = AV_NOPTS_VALUE, lastPts = AV_NOPTS_VALUE;
+    AVStream *stream;
+    int idx, ret;
+
+    check.errors = -1;
+    if (avformat_open_input(&fmtCtx, path.c_str(), NULL, NULL) < 0 ||
+        avformat_find_stream_info(fmtCtx, NULL) < 0 ||
+        (idx = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0)) < 0 ||
+        !(decCtx = avcodec_alloc_context3(codec)))
+        goto end;
+    stream = fmtCtx->streams[idx];
+    if (avcodec_parameters_to_context(decCtx, stream->codecpar) < 0 ||
+        avcodec_open2(decCtx, codec, NULL) < 0)
+        goto end;
+    check.errors = 0;
+
+    while (1) {
+        bool eof = av_read_frame(fmtCtx, pkt) < 0;
+        if (!eof && pkt->stream_index != idx) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        if (!eof) {
+            check.packets++;
+            if (lastDts != AV_NOPTS_VALUE && pkt->dts <= lastDts)
+                check.monotonic = false;
+            lastDts = pkt->dts;
+        }
+        if (avcodec_send_packet(decCtx, eof ? NULL : pkt) < 0)
+            check.errors++;
+        av_packet_unref(pkt);
+        while ((ret = avcodec_receive_frame(decCtx, frame)) >= 0) {
+            int64_t pts = frame->best_effort_timestamp;
+            if (lastPts != AV_NOPTS_VALUE && pts <= lastPts)
+                check.monotonic = false;
+            if (firstPts == AV_NOPTS_VALUE)
+                firstPts = pts;
+            lastPts = pts;
+            check.frames++;
+            av_frame_unref(frame);
+        }
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+            check.errors++;
+        if (eof)
+            break;
+    }
+    if (check.frames > 0)
+        check.duration = (lastPts - firstPts) * av_q2d(stream->time_base) +
+                         1.0 / av_q2d(stream->avg_frame_rate);
+
+end:
+    avcodec_free_context(&decCtx);
+    avformat_close_input(&fmtCtx);
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    return check;
+}
+
 // Test for remuxing
 TEST_F(TranscoderTest, Remux) {
     std::string inputFile = (test_dir_ / "test.mp4").string();
@@ -50,6 +231,32 @@ TEST_F(TranscoderTest, Remux) {
     EXPECT_GT(std::filesystem::file_size(outputFile), 0);
 }
 
+// Test for fragmented MP4 remuxing, as written to pipes
+TEST_F(TranscoderTest, RemuxFragmented) {
+    std::string inputFile = (test_dir_ / "test.mp4").string();
+    std::string outputFile = (test_dir_ / "output.mp4").string();
+
+    EncodeParameter encodeParams;
+    ProcessParameter processParams;
+    encodeParams.SetOutputFormat("mp4");
+    encodeParams.SetFragmentDuration(1.0);
+
+    auto converter = std::make_unique<Converter>(&processParams, &encodeParams);
+    converter->set_transcoder("FFMPEG");
+    EXPECT_TRUE(converter->convert_format(inputFile, outputFile));
+
+    // fragments start right after an empty moov
+    std::ifstream in(outputFile, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_NE(data.find("moof"), std::string::npos);
+
+    AVFormatContext *fmtCtx = NULL;
+    ASSERT_GE(avformat_open_input(&fmtCtx, outputFile.c_str(), NULL, NULL), 0);
+    EXPECT_GE(avformat_find_stream_info(fmtCtx, NULL), 0);
+    EXPECT_GT(fmtCtx->nb_streams, 0u);
+    avformat_close_input(&fmtCtx);
+}
+
 // Test for video transcoding
 TEST_F(TranscoderTest, VideoTranscode) {
     std::string inputFile = (test_dir_ / "test.mp4").string();
@@ -71,6 +278,63 @@ TEST_F(TranscoderTest, VideoTranscode) {
     EXPECT_GT(std::filesystem::file_size(outputFile), 0);
 }
 
+// Test for HLS packaging with keyframes forced at the segment boundaries
+TEST_F(TranscoderTest, VideoTranscodeHls) {
+    std::string inputFile = (test_dir_ / "test.mp4").string();
+    std::string outputFile = (test_dir_ / "index.m3u8").string();
+
+    EncodeParameter encodeParams;
+    ProcessParameter processParams;
+    encodeParams.set_video_codec_name("libx264");
+    encodeParams.SetSegmentDuration(1.0);
+    encodeParams.SetSegmentTemplate("part_%03d.ts");
+
+    auto converter = std::make_unique<Converter>(&processParams, &encodeParams);
+    converter->set_transcoder("FFMPEG");
+    EXPECT_TRUE(converter->convert_format(inputFile, outputFile));
+
+    std::ifstream in(outputFile);
+    std::string playlist((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_NE(playlist.find("#EXT-X-PLAYLIST-TYPE:VOD"), std::string::npos);
+    EXPECT_NE(playlist.find("#EXT-X-ENDLIST"), std::string::npos);
+    // the segments are written next to the playlist
+    EXPECT_TRUE(std::filesystem::exists(test_dir_ / "part_000.ts"));
+    EXPECT_TRUE(std::filesystem::exists(test_dir_ / "part_001.ts"));
+}
+
+// Test for an ABR ladder written from a single decode
+TEST_F(TranscoderTest, VideoTranscodeRenditions) {
+    std::string inputFile = (test_dir_ / "test.mp4").string();
+    std::string outputFile = (test_dir_ / "output_ladder_main.mp4").string();
+    std::string renditionFile = (test_dir_ / "output_ladder_small.mp4").string();
+
+    EncodeParameter encodeParams;
+    ProcessParameter processParams;
+
+    encodeParams.set_video_codec_name("libx264");
+    encodeParams.set_video_bit_rate(2000000); // 2Mbps
+
+    Rendition rendition;
+    rendition.outputPath = renditionFile;
+    rendition.width = 320;
+    rendition.height = 180;
+    rendition.videoBitRate = 300000;
+    encodeParams.AddRendition(rendition);
+
+    auto converter = std::make_unique<Converter>(&processParams, &encodeParams);
+    converter->set_transcoder("FFMPEG");
+    bool result = converter->convert_format(inputFile, outputFile);
+
+    EXPECT_TRUE(result);
+    EXPECT_TRUE(std::filesystem::exists(outputFile));
+    EXPECT_TRUE(std::filesystem::exists(renditionFile));
+    EXPECT_GT(std::filesystem::file_size(renditionFile), 0);
+
+    // the rendition is scaled down and encoded at a lower rate
+    EXPECT_LT(std::filesystem::file_size(renditionFile),
+              std::filesystem::file_size(outputFile));
+}
+
 // Test for audio transcoding
 TEST_F(TranscoderTest, AudioTranscode) {
     std::string inputFile = (test_dir_ / "test.mp4").string();
@@ -93,6 +357,28 @@ TEST_F(TranscoderTest, AudioTranscode) {
     EXPECT_GT(std::filesystem::file_size(outputFile), 0);
 }
 
+// Test for audio extraction, the video is discarded by the demuxer and the
+// cut ends on the audio timestamps
+TEST_F(TranscoderTest, AudioExtractCut) {
+    std::string inputFile = (test_dir_ / "test.mp4").string();
+    std::string fullFile = (test_dir_ / "full.aac").string();
+    std::string cutFile = (test_dir_ / "cut.aac").string();
+
+    EncodeParameter encodeParams;
+    ProcessParameter processParams;
+
+    auto converter = std::make_unique<Converter>(&processParams, &encodeParams);
+    converter->set_transcoder("FFMPEG");
+    EXPECT_TRUE(converter->convert_format(inputFile, fullFile));
+
+    encodeParams.SetStartTime(0.0);
+    encodeParams.SetEndTime(1.0);
+    EXPECT_TRUE(converter->convert_format(inputFile, cutFile));
+
+    EXPECT_GT(std::filesystem::file_size(cutFile), 0);
+    EXPECT_LT(std::filesystem::file_size(cutFile), std::filesystem::file_size(fullFile));
+}
+
 // Test for video cutting with copy mode (no re-encoding)
 TEST_F(TranscoderTest, VideoCutCopyMode) {
     std::string inputFile = (test_dir_ / "test.mp4").string();
@@ -221,3 +507,551 @@ TEST_F(TranscoderTest, VideoCutWithDuration) {
     EXPECT_LT(std::filesystem::file_size(outputFile),
               std::filesystem::file_size(inputFile));
 }
+
+// Test the packet index sidecar: built on first open, reused afterwards
+TEST_F(TranscoderTest, PacketIndexSidecar) {
+    std::string inputFile = (test_dir_ / "test.mp4").string();
+    std::string sidecar = PacketIndex::GetSidecarPath(inputFile);
+    std::filesystem::remove(sidecar);
+
+    PacketIndex index;
+    EXPECT_LT(index.Load(inputFile), 0);
+    ASSERT_GE(index.Open(inputFile), 0);
+    EXPECT_TRUE(std::filesystem::exists(sidecar));
+    EXPECT_GT(index.GetStreamCount(), 0);
+
+    // a second instance maps the stored file without rebuilding it
+    PacketIndex cached;
+    ASSERT_GE(cached.Load(inputFile), 0);
+    EXPECT_EQ(cached.GetStreamCount(), index.GetStreamCount());
+
+    // every stream of the test file starts with a keyframe
+    for (int i = 0; i < cached.GetStreamCount(); i++) {
+        size_t keyCount = 0;
+        const PacketIndexEntry *keys = cached.GetKeyframes(i, &keyCount);
+        ASSERT_GT(keyCount, 0u);
+        EXPECT_EQ(cached.FindKeyframe(i, keys[keyCount - 1].pts + 1),
+                  &keys[keyCount - 1]);
+        EXPECT_EQ(cached.FindKeyframe(i, keys[0].pts - 1), nullptr);
+    }
+
+    std::filesystem::remove(sidecar);
+}
+
+// Test for the size cap of the sidecar cache, least recently used go first
+TEST_F(TranscoderTest, PacketIndexPrune) {
+    std::filesystem::path dir = test_dir_ / "index";
+    std::filesystem::create_directories(dir);
+    auto now = std::filesystem::file_time_type::clock::now();
+    const char *names[] = {"a.ocidx", "b.ocidx", "c.ocidx", "notes.txt"};
+    for (int i = 0; i < 4; i++) {
+        std::ofstream(dir / names[i]) << std::string(1000, 'x');
+        std::filesystem::last_write_time(dir / names[i], now - std::chrono::hours(4 - i));
+    }
+
+    // a is the oldest but kept, b goes to bring the sidecars down to 2000
+    PacketIndex::PruneCache(dir.string(), 2000, (dir / "a.ocidx").string());
+    EXPECT_TRUE(std::filesystem::exists(dir / "a.ocidx"));
+    EXPECT_FALSE(std::filesystem::exists(dir / "b.ocidx"));
+    EXPECT_TRUE(std::filesystem::exists(dir / "c.ocidx"));
+    EXPECT_TRUE(std::filesystem::exists(dir / "notes.txt"));
+}
+
+// Test that the mapped input demuxes the same packets as the file protocol
+TEST_F(TranscoderTest, MappedReaderPackets) {
+    std::string inputFile = (test_dir_ / "test.mp4").string();
+    MappedReaderOptions options;
+    options.readahead = 1 << 20;
+
+    AVFormatContext *plain = NULL;
+    AVFormatContext *mapped = NULL;
+    ASSERT_GE(avformat_open_input(&plain, inputFile.c_str(), NULL, NULL), 0);
+    ASSERT_GE(MappedReader::OpenInput(&mapped, inputFile, options), 0);
+    EXPECT_TRUE(mapped->flags & AVFMT_FLAG_CUSTOM_IO);
+
+    AVPacket *a = av_packet_alloc();
+    AVPacket *b = av_packet_alloc();
+    int packets = 0;
+    while (av_read_frame(plain, a) >= 0) {
+        ASSERT_GE(av_read_frame(mapped, b), 0);
+        EXPECT_EQ(a->size, b->size);
+        EXPECT_EQ(a->pts, b->pts);
+        av_packet_unref(a);
+        av_packet_unref(b);
+        packets++;
+    }
+    EXPECT_GT(packets, 0);
+    EXPECT_LT(av_read_frame(mapped, b), 0);
+
+    av_packet_free(&a);
+    av_packet_free(&b);
+    avformat_close_input(&plain);
+    MappedReader::CloseInput(&mapped);
+    EXPECT_EQ(mapped, nullptr);
+}
+
+// Test for an input truncated by another writer while it is mapped
+TEST_F(TranscoderTest, MappedReaderTruncated) {
+    std::filesystem::path inputFile = test_dir_ / "truncated.mp4";
+    std::filesystem::copy_file(test_dir_ / "test.mp4", inputFile);
+    AVFormatContext *mapped = NULL;
+    MappedReaderOptions options;
+
+    ASSERT_GE(MappedReader::OpenInput(&mapped, inputFile.string(), options), 0);
+    ASSERT_GE(avformat_find_stream_info(mapped, NULL), 0);
+    std::error_code ec;
+    std::filesystem::resize_file(inputFile, 4096, ec);
+
+    // the reads end with an error instead of a SIGBUS
+    AVPacket *pkt = av_packet_alloc();
+    int ret;
+    while ((ret = av_read_frame(mapped, pkt)) >= 0)
+        av_packet_unref(pkt);
+    EXPECT_LT(ret, 0);
+
+    av_packet_free(&pkt);
+    MappedReader::CloseInput(&mapped);
+}
+
+// Test for the write-behind output with small buffers and a header rewrite
+TEST_F(TranscoderTest, AsyncWriterRewrite) {
+    std::string outputFile = (test_dir_ / "async.bin").string();
+    AsyncWriterOptions options;
+    options.bufferSize = 4096;
+    options.bufferCount = 2;
+    options.preallocate = 1 << 20;
+
+    std::string data(100000, 'a');
+    AVIOContext *pb = NULL;
+    ASSERT_GE(AsyncWriter::Open(&pb, outputFile, options), 0);
+    avio_write(pb, (const unsigned char *)data.data(), (int)data.size());
+    // like a muxer patching its header once the sizes are known
+    ASSERT_EQ(avio_seek(pb, 10, SEEK_SET), 10);
+    avio_write(pb, (const unsigned char *)"bbbb", 4);
+    ASSERT_GE(AsyncWriter::Close(&pb), 0);
+    EXPECT_EQ(pb, nullptr);
+
+    data.replace(10, 4, "bbbb");
+    std::ifstream in(outputFile, std::ios::binary);
+    std::string written((std::istreambuf_iterator<char>(in)),
+                        std::istreambuf_iterator<char>());
+    // the unused preallocation is released
+    EXPECT_EQ(written.size(), data.size());
+    EXPECT_EQ(written, data);
+}
+
+// Test for the shared probe cache and its invalidation on change
+TEST_F(TranscoderTest, ProbeCacheReuse) {
+    std::string inputFile = (test_dir_ / "test.mp4").string();
+    ProbeCache::Instance().Clear();
+
+    int error = 0;
+    std::shared_ptr<const MediaProbe> probe = ProbeCache::Instance().Get(inputFile, &error);
+    ASSERT_NE(probe, nullptr);
+    EXPECT_EQ(error, 0);
+    EXPECT_GE(probe->FindBestStream(AVMEDIA_TYPE_VIDEO), 0);
+    EXPECT_EQ(ProbeCache::Instance().Get(inputFile), probe);
+
+    // a fresh input of the file gets the probed parameters without analysis
+    AVFormatContext *fmtCtx = NULL;
+    ASSERT_GE(avformat_open_input(&fmtCtx, inputFile.c_str(), NULL, NULL), 0);
+    ASSERT_GE(ProbeCache::Instance().FindStreamInfo(fmtCtx, inputFile), 0);
+    ASSERT_EQ(fmtCtx->nb_streams, probe->streams.size());
+    for (unsigned int i = 0; i < fmtCtx->nb_streams; i++) {
+        EXPECT_EQ(fmtCtx->streams[i]->codecpar->codec_id, probe->streams[i].codecpar->codec_id);
+        EXPECT_EQ(fmtCtx->streams[i]->codecpar->width, probe->streams[i].codecpar->width);
+        EXPECT_EQ(fmtCtx->streams[i]->codecpar->sample_rate,
+                  probe->streams[i].codecpar->sample_rate);
+    }
+    avformat_close_input(&fmtCtx);
+
+    // a file that changed on disk is probed again
+    {
+        std::ofstream out(inputFile, std::ios::binary | std::ios::app);
+        out << "trailing";
+    }
+    EXPECT_EQ(ProbeCache::Instance().Find(inputFile), nullptr);
+    std::shared_ptr<const MediaProbe> reprobed = ProbeCache::Instance().Get(inputFile);
+    ASSERT_NE(reprobed, nullptr);
+    EXPECT_NE(reprobed, probe);
+    EXPECT_EQ(reprobed->streams.size(), probe->streams.size());
+}
+
+// Test for the header-only probe and a cancelled full probe
+TEST_F(TranscoderTest, ProbeCacheHeaderCancel) {
+    std::string inputFile = (test_dir_ / "test.mp4").string();
+    ProbeCache::Instance().Clear();
+
+    std::atomic<bool> cancel(true);
+    int error = 0;
+    EXPECT_EQ(ProbeCache::Instance().Get(inputFile, &error, &cancel), nullptr);
+    EXPECT_EQ(error, AVERROR_EXIT);
+    EXPECT_EQ(ProbeCache::Instance().Find(inputFile), nullptr);
+
+    // MP4 lists its streams in the header
+    cancel = false;
+    std::shared_ptr<const MediaProbe> header =
+        ProbeCache::Instance().GetHeader(inputFile, &error, &cancel);
+    ASSERT_NE(header, nullptr);
+    EXPECT_FALSE(header->complete);
+    EXPECT_GE(header->FindBestStream(AVMEDIA_TYPE_VIDEO), 0);
+    // header-only results are not cached
+    EXPECT_EQ(ProbeCache::Instance().Find(inputFile), nullptr);
+
+    std::shared_ptr<const MediaProbe> full = ProbeCache::Instance().Get(inputFile, &error, &cancel);
+    ASSERT_NE(full, nullptr);
+    EXPECT_TRUE(full->complete);
+    EXPECT_EQ(full->streams.size(), header->streams.size());
+    EXPECT_EQ(ProbeCache::Instance().GetHeader(inputFile), full);
+}
+
+// Test for the deep analysis of every packet, decoding the keyframes
+TEST_F(TranscoderTest, MediaAnalyzerStats) {
+    std::string inputFile = (test_dir_ / "test.mp4").string();
+    MediaAnalyzerOptions options;
+    options.decode = true;
+    options.keyframesOnly = true;
+
+    MediaAnalyzer analyzer(options);
+    MediaAnalysis analysis;
+    ASSERT_GE(analyzer.Analyze(inputFile, &analysis), 0);
+    EXPECT_GT(analysis.size, 0);
+
+    const StreamAnalysis *video = nullptr;
+    for (const StreamAnalysis &s : analysis.streams) {
+        int64_t histogram = 0;
+        for (int64_t count : s.sizeHistogram)
+            histogram += count;
+        EXPECT_EQ(histogram, s.packets);
+        EXPECT_GE(s.peakBitrate, s.averageBitrate);
+        if (s.type == AVMEDIA_TYPE_VIDEO && !video)
+            video = &s;
+    }
+    ASSERT_NE(video, nullptr);
+    EXPECT_GT(video->packets, 0);
+    EXPECT_GT(video->keyframes, 0);
+    EXPECT_GT(video->gopMin, 0);
+    EXPECT_LE(video->gopMin, video->gopMax);
+    // only the keyframes were decoded
+    EXPECT_GT(video->decodedFrames, 0);
+    EXPECT_LE(video->decodedFrames, video->keyframes);
+    int64_t luma = 0;
+    for (int64_t count : video->lumaHistogram)
+        luma += count;
+    EXPECT_GT(luma, 0);
+
+    std::string json = MediaAnalyzer::ToJson(analysis);
+    EXPECT_EQ(json.front(), '{');
+    EXPECT_EQ(json.back(), '}');
+    EXPECT_NE(json.find("\"gop\":{"), std::string::npos);
+    EXPECT_NE(json.find("\"luma_histogram\":["), std::string::npos);
+}
+
+// Test for probing a directory tree on several workers
+TEST_F(TranscoderTest, BatchProbeDirectory) {
+    std::filesystem::path library = test_dir_ / "library";
+    std::filesystem::create_directories(library / "nested");
+    std::filesystem::copy_file(test_dir_ / "test.mp4", library / "a.mp4");
+    std::filesystem::copy_file(test_dir_ / "test.mp4", library / "nested" / "b.mp4");
+    {
+        std::ofstream notes(library / "nested" / "notes.txt");
+        notes << "not media";
+    }
+    // a dangling link must not end the walk
+    std::error_code ec;
+    std::filesystem::create_symlink(library / "missing.mp4", library / "dangling.mp4", ec);
+
+    BatchProbeOptions options;
+    options.jobs = 2;
+    BatchProbe batch(options);
+    BatchProbeStats stats;
+    std::ostringstream out;
+    batch.Run({library.string(), (test_dir_ / "test.mp4").string()}, out, &stats);
+
+    EXPECT_EQ(stats.files, 4);
+    EXPECT_EQ(stats.failed, 1);
+    std::istringstream lines(out.str());
+    std::string line;
+    int count = 0, errors = 0;
+    while (std::getline(lines, line)) {
+        EXPECT_EQ(line.compare(0, 9, "{\"path\":\""), 0);
+        if (line.find("\"error\":") != std::string::npos)
+            errors++;
+        else
+            EXPECT_NE(line.find("\"streams\":[{"), std::string::npos);
+        count++;
+    }
+    EXPECT_EQ(count, 4);
+    EXPECT_EQ(errors, 1);
+    // the inventory leaves the probe cache alone
+    EXPECT_EQ(ProbeCache::Instance().Find((library / "a.mp4").string()), nullptr);
+}
+
+// Test for the rate limit and the line formats of the progress channel
+TEST_F(TranscoderTest, ProgressReporterRateLimit) {
+    std::filesystem::path path = test_dir_ / "progress.txt";
+    FILE *file = fopen(path.string().c_str(), "w");
+    ASSERT_NE(file, nullptr);
+
+    ProgressOptions options;
+    options.fd = fileno(file);
+    options.interval = 60;
+    ProgressReporter::Instance().Configure(options);
+    for (int i = 0; i < 1000; i++)
+        ProgressReporter::Instance().Update(i, 1000, 1.0);
+    ProgressReporter::Instance().Finish(true);
+    ProgressReporter::Instance().Configure(ProgressOptions());
+    fclose(file);
+
+    std::ifstream in(path);
+    std::string first, last, extra;
+    ASSERT_TRUE(std::getline(in, first));
+    ASSERT_TRUE(std::getline(in, last));
+    EXPECT_FALSE(std::getline(in, extra));
+    EXPECT_EQ(first.compare(0, 18, "done=0 total=1000 "), 0);
+    EXPECT_NE(first.find("progress=continue"), std::string::npos);
+    EXPECT_NE(last.find("percent=100.00"), std::string::npos);
+    EXPECT_NE(last.find("progress=end"), std::string::npos);
+
+    ProgressSample sample;
+    sample.done = 5;
+    sample.total = 10;
+    sample.percent = 50;
+    sample.state = "continue";
+    EXPECT_EQ(ProgressReporter::Format("json", sample),
+              "{\"done\":5,\"total\":10,\"percent\":50,\"elapsed\":0,\"remaining\":0,"
+              "\"progress\":\"continue\"}\n");
+}
+
+// Test for the names and numbers accepted as log levels
+TEST(LogSinkTest, ParseLevel) {
+    int level = 0;
+    EXPECT_TRUE(LogSink::ParseLevel("warning", &level));
+    EXPECT_EQ(level, AV_LOG_WARNING);
+    EXPECT_TRUE(LogSink::ParseLevel("48", &level));
+    EXPECT_EQ(level, 48);
+    EXPECT_FALSE(LogSink::ParseLevel("loud", &level));
+}
+
+#ifndef _WIN32
+// Test for a progress reader that falls behind by more than the log queue
+TEST(LogSinkTest, FullQueueBlocks) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    std::string line = std::string(1000, 'x') + "\n";
+    const int count = 2 * LOG_SINK_QUEUE_SIZE;
+    size_t received = 0;
+
+    LogSink::Instance().Start(av_log_get_level());
+    std::thread writer([&]() {
+        for (int i = 0; i < count; i++)
+            LogSink::Instance().Write(fds[1], line);
+        LogSink::Instance().Stop();
+        close(fds[1]);
+    });
+    // the sink stalls on the full pipe and the queue fills up behind it
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0)
+        received += n;
+    writer.join();
+    close(fds[0]);
+    EXPECT_EQ(received, count * line.size());
+}
+#endif
+
+// Test for the per-stage statistics of a transcode and their JSON report
+TEST_F(TranscoderTest, TranscodeStatsReport) {
+    std::string inputFile = (test_dir_ / "test.mp4").string();
+    std::string outputFile = (test_dir_ / "output.mp4").string();
+    std::string statsFile = (test_dir_ / "stats.json").string();
+
+    EncodeParameter encodeParams;
+    ProcessParameter processParams;
+    encodeParams.set_video_codec_name("libx264");
+
+    auto converter = std::make_unique<Converter>(&processParams, &encodeParams);
+    converter->set_transcoder("FFMPEG");
+    converter->set_stats_file(statsFile);
+    ASSERT_TRUE(converter->convert_format(inputFile, outputFile));
+
+    const TranscodeStats &stats = converter->get_stats();
+    EXPECT_TRUE(stats.ok);
+    EXPECT_GT(stats.wallTime, 0);
+    EXPECT_GT(stats.mediaDuration, 0);
+    EXPECT_GT(stats.stages[STAGE_DEMUX], 0);
+    EXPECT_GT(stats.stages[STAGE_DECODE], 0);
+    EXPECT_GT(stats.stages[STAGE_ENCODE], 0);
+    EXPECT_GT(stats.stages[STAGE_MUX], 0);
+
+    bool video = false;
+    for (const StreamStats &s : stats.streams) {
+        EXPECT_GT(s.counters[COUNTER_PACKETS_READ], 0);
+        EXPECT_GT(s.counters[COUNTER_BYTES_WRITTEN], 0);
+        if (s.type == "video") {
+            video = true;
+            EXPECT_FALSE(s.copied);
+            EXPECT_GT(s.counters[COUNTER_FRAMES_DECODED], 0);
+            EXPECT_EQ(s.counters[COUNTER_FRAMES_FILTERED], s.counters[COUNTER_FRAMES_DECODED]);
+            EXPECT_EQ(s.counters[COUNTER_PACKETS_ENCODED], s.counters[COUNTER_PACKETS_WRITTEN]);
+        }
+    }
+    EXPECT_TRUE(video);
+
+    std::ifstream in(statsFile);
+    std::string json((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(json.compare(0, 10, "{\"ok\":true"), 0);
+    EXPECT_NE(json.find("\"stages\":{\"demux\":"), std::string::npos);
+    EXPECT_NE(json.find("\"frames_decoded\":"), std::string::npos);
+}
+
+// Test for the Chrome trace of a transcode
+TEST_F(TranscoderTest, TraceRecorderExport) {
+    std::string inputFile = (test_dir_ / "test.mp4").string();
+    std::string outputFile = (test_dir_ / "output.mp4").string();
+    std::string traceFile = (test_dir_ / "trace.json").string();
+
+    EncodeParameter encodeParams;
+    ProcessParameter processParams;
+    encodeParams.set_video_codec_name("libx264");
+
+    TraceRecorder::Instance().Start();
+    auto converter = std::make_unique<Converter>(&processParams, &encodeParams);
+    converter->set_transcoder("FFMPEG");
+    ASSERT_TRUE(converter->convert_format(inputFile, outputFile));
+    ASSERT_EQ(TraceRecorder::Instance().Write(traceFile), 0);
+    EXPECT_FALSE(TraceRecorder::Enabled());
+
+    std::ifstream in(traceFile);
+    std::string trace((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(trace.compare(0, 17, "{\"displayTimeUnit"), 0);
+    EXPECT_NE(trace.find("\"args\":{\"name\":\"demux\"}"), std::string::npos);
+    EXPECT_NE(trace.find("\"name\":\"read\",\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(trace.find("\"name\":\"decode send\""), std::string::npos);
+    EXPECT_NE(trace.find("\"name\":\"encode receive\""), std::string::npos);
+    EXPECT_NE(trace.find("\"name\":\"write\""), std::string::npos);
+    EXPECT_EQ(trace.substr(trace.size() - 4), "\n]}\n");
+}
+
+static void record_phase(TranscodePhase phase, void *opaque) {
+    ((std::vector<TranscodePhase> *)opaque)->push_back(phase);
+}
+
+// Test for the order of the phases reported to the phase hook
+TEST_F(TranscoderTest, PhaseHookOrder) {
+    std::string inputFile = (test_dir_ / "test.mp4").string();
+    std::string outputFile = (test_dir_ / "output.mp4").string();
+    std::vector<TranscodePhase> phases;
+
+    EncodeParameter encodeParams;
+    ProcessParameter processParams;
+    encodeParams.set_video_codec_name("libx264");
+
+    PhaseHook::Set(record_phase, &phases);
+    auto converter = std::make_unique<Converter>(&processParams, &encodeParams);
+    converter->set_transcoder("FFMPEG");
+    bool ok = converter->convert_format(inputFile, outputFile);
+    PhaseHook::Set(NULL, NULL);
+    ASSERT_TRUE(ok);
+
+    std::vector<TranscodePhase> expected = {PHASE_OPEN, PHASE_PREPARE, PHASE_LOOP,
+                                            PHASE_FLUSH, PHASE_TRAILER, PHASE_CLOSE,
+                                            PHASE_IDLE};
+    EXPECT_EQ(phases, expected);
+    EXPECT_STREQ(PhaseHook::Name(PHASE_LOOP), "loop");
+}
+
+// Test for a chunked encode matching a single pass frame for frame
+TEST_F(TranscoderTest, ChunkedEncode) {
+    std::string inputFile = (test_dir_ / "clip.mp4").string();
+    std::string singleFile = (test_dir_ / "single.mp4").string();
+    std::string chunkedFile = (test_dir_ / "chunked.mp4").string();
+    ASSERT_TRUE(write_test_clip(inputFile, 4 * CLIP_FPS));
+
+    EncodeParameter encodeParams;
+    ProcessParameter processParams;
+    encodeParams.set_video_codec_name("libx264");
+
+    auto converter = std::make_unique<Converter>(&processParams, &encodeParams);
+    converter->set_transcoder("FFMPEG");
+    ASSERT_TRUE(converter->convert_format(inputFile, singleFile));
+
+    // keyframes every 0.48s, three chunks of at least 0.5s fit in 4s
+    encodeParams.SetChunkCount(3);
+    encodeParams.SetMinChunkDuration(0.5);
+    ASSERT_TRUE(converter->convert_format(inputFile, chunkedFile));
+
+    VideoCheck single = check_video(singleFile);
+    VideoCheck chunked = check_video(chunkedFile);
+    EXPECT_EQ(single.frames, 4 * CLIP_FPS);
+    EXPECT_EQ(chunked.frames, single.frames);
+    EXPECT_EQ(chunked.packets, chunked.frames);
+    EXPECT_EQ(chunked.errors, 0);
+    EXPECT_TRUE(chunked.monotonic);
+}
+// Test for a frame accurate smart cut of a stream with B-frames
+TEST_F(TranscoderTest, SmartCutBFrames) {
+    std::string inputFile = (test_dir_ / "clip.mp4").string();
+    std::string outputFile = (test_dir_ / "cut.mp4").string();
+    ASSERT_TRUE(write_test_clip(inputFile, 4 * CLIP_FPS));
+
+    EncodeParameter encodeParams;
+    ProcessParameter processParams;
+    // keyframes every 0.48s, neither end of the range is on one
+    encodeParams.SetStartTime(1.1);
+    encodeParams.SetEndTime(2.3);
+    encodeParams.SetSmartCut(true);
+
+    auto converter = std::make_unique<Converter>(&processParams, &encodeParams);
+    converter->set_transcoder("FFMPEG");
+    ASSERT_TRUE(converter->convert_format(inputFile, outputFile));
+
+    VideoCheck cut = check_video(outputFile);
+    EXPECT_NEAR(cut.duration, 2.3 - 1.1, 1.0 / CLIP_FPS);
+    EXPECT_NEAR(cut.frames, (2.3 - 1.1) * CLIP_FPS, 1);
+    EXPECT_EQ(cut.packets, cut.frames);
+    EXPECT_EQ(cut.errors, 0);
+    EXPECT_TRUE(cut.monotonic);
+}
+#ifdef __linux__
+#define SOAK_RUNS 40
+#define SOAK_WARMUP_RUNS 5
+#define SOAK_MAX_RSS_GROWTH (8 * 1024 * 1024)
+
+// resident set size of the process in bytes
+static int64_t current_rss() {
+    std::ifstream statm("/proc/self/statm");
+    int64_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// Test for leaks over many conversions in one process, the resident set
+// must stay flat once the allocator and the codecs are warmed up
+TEST_F(TranscoderTest, SoakFlatRss) {
+    std::string inputFile = (test_dir_ / "test.mp4").string();
+    std::string outputFile = (test_dir_ / "output.mp4").string();
+    int64_t warm = 0;
+
+    for (int i = 0; i < SOAK_RUNS; i++) {
+        EncodeParameter encodeParams;
+        ProcessParameter processParams;
+        // alternate transcoded and copied jobs
+        if (i % 2 == 0)
+            encodeParams.set_video_codec_name("libx264");
+        encodeParams.SetStartTime(0.0);
+        encodeParams.SetEndTime(1.0);
+
+        auto converter = std::make_unique<Converter>(&processParams, &encodeParams);
+        converter->set_transcoder("FFMPEG");
+        ASSERT_TRUE(converter->convert_format(inputFile, outputFile));
+
+        if (i == SOAK_WARMUP_RUNS - 1)
+            warm = current_rss();
+    }
+
+    ASSERT_GT(warm, 0);
+    EXPECT_LT(current_rss() - warm, SOAK_MAX_RSS_GROWTH);
+}
+#endif
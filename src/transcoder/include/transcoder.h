@@ -22,6 +22,7 @@
 
 #include "../../common/include/encode_parameter.h"
 #include "../../common/include/process_parameter.h"
+#include "../../common/include/progress_reporter.h"
 #include "../../common/include/stream_context.h"
 
 class Transcoder {
@@ -30,12 +31,17 @@ public:
                EncodeParameter *encodeParameter)
         : processParameter(processParameter), encodeParameter(encodeParameter) {
         last_ui_update = std::chrono::system_clock::now();
+        last_encoder_call_time = last_ui_update;
     }
 
     virtual ~Transcoder() = default;
 
     virtual bool transcode(std::string input_path, std::string output_path) = 0;
 
+    // counters of the running or last job, left empty by transcoders that
+    // do not time their stages
+    virtual void fill_stats(TranscodeStats *stats) {}
+
     double compute_smooth_duration(double new_duration) {
         if (new_duration >= min_duration_threshold) {
             duration_history.push_back(new_duration);
@@ -53,7 +59,6 @@ public:
     void send_process_parameter(int64_t frameNumber, int64_t frameTotalNumber) {
         processNumber = frameNumber * 100 / frameTotalNumber;
 
-        static auto last_encoder_call_time = std::chrono::system_clock::now();
         auto now = std::chrono::system_clock::now();
 
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -76,14 +81,15 @@ public:
             if (frameNumber > 0 && frameTotalNumber > 0) {
                 processParameter->set_time_required(remainTime);
             }
+            TranscodeStats stats;
+            fill_stats(&stats);
+            processParameter->set_stats(stats);
             last_ui_update = now;
         }
 
-        std::cout << "Process Number (percentage): " << processNumber << "%\t"
-                  << "Current duration (milliseconds): " << duration << "\t"
-                  << "Smoothed Duration: " << smooth_duration << " ms\t"
-                  << "Estimated Rest Time (seconds): " << remainTime
-                  << std::endl;
+        // rate limited, written off this thread
+        ProgressReporter::Instance().Update(frameNumber, frameTotalNumber,
+                                            remainTime);
     }
 
     ProcessParameter *processParameter = NULL;
@@ -96,6 +102,8 @@ public:
 
     std::chrono::system_clock::time_point
         last_ui_update; // Track last UI update time
+    std::chrono::system_clock::time_point
+        last_encoder_call_time; // per instance, chunk workers run in parallel
     std::vector<double>
         duration_history; // Store recent durations for averaging
 
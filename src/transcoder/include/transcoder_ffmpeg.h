@@ -17,6 +17,22 @@
 #define TRANSCODERFFMPEG_H
 
 #include "transcoder.h"
+#include "../../common/include/async_writer.h"
+#include "../../common/include/av_ptr.h"
+#include "../../common/include/bounded_queue.h"
+#include "../../common/include/mapped_reader.h"
+#include "../../common/include/media_pool.h"
+#include "../../common/include/packet_index.h"
+#include "../../common/include/phase_hook.h"
+#include "../../common/include/probe_cache.h"
+#include "../../common/include/trace_recorder.h"
+#include "../../common/include/transcode_stats.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -29,13 +45,81 @@ extern "C" {
 
 #define ENCODE_BIT_RATE 5000000
 
+// depth of the queues between the pipeline stages
+#define PIPELINE_PACKET_QUEUE_SIZE 64
+#define PIPELINE_FRAME_QUEUE_SIZE 8
+
+// chunk segments are written with this timestamp offset (in AV_TIME_BASE)
+// so the muxer never shifts them, the stitcher removes it again
+#define CHUNK_TS_OFFSET (10 * (int64_t)AV_TIME_BASE)
+
+// HLS and DASH segment length in seconds when none is set
+#define SEGMENT_DURATION 6.0
+
+// ends of a filter graph, the context of the first output owns the graph and
+// the ones of the other branches of a split graph leave it NULL
 typedef struct FilteringContext {
-    AVFilterContext *buffersrc_ctx;
-    AVFilterContext *buffersink_ctx;
-    AVFilterGraph *filter_graph;
+    AVFilterContext *buffersrc_ctx = NULL;
+    AVFilterContext *buffersink_ctx = NULL;
+    FilterGraphPtr filter_graph;
 } FilteringContext;
 
+// packet waiting to be written by the mux stage, timestamps are still in
+// time_base and get rescaled to the output stream right before writing
+typedef struct MuxPacket {
+    AVPacket *pkt;
+    AVRational time_base;
+    AVStream *out_stream;
+    int stream_index;  // input stream, for the statistics
+} MuxPacket;
+
+// one output file of a job with its mux stage, the main output comes first
+// and every rendition of an ABR ladder adds one
+typedef struct OutputContext {
+    StreamContext *encoder;
+    std::string path;
+    uint16_t width;  // 0 keeps the source size
+    uint16_t height;
+    int64_t videoBitRate;  // 0 uses the default rate control
+    BoundedQueue<MuxPacket> *muxQueue;
+    // encoder of a rendition, the main output belongs to the job
+    std::unique_ptr<StreamContext> rendition;
+} OutputContext;
+
+// one mapped input stream and the output stream it is written to, with the
+// codec and filter contexts when it is transcoded. Transcoded lanes run
+// decode, filter and encode on their own threads, copied lanes (dec_ctx and
+// enc_ctx are NULL) go straight from the demuxer to the muxer.
+// With several outputs the lane of the first output reads the input for all
+// of them: its filter graph is split into one branch per rendition lane and
+// its copied packets are duplicated to them. Rendition lanes of transcoded
+// streams only encode. A lane owns its codec contexts, lanes are move-only.
+typedef struct TranscodeLane {
+    AVStream *in_stream;
+    AVStream *out_stream;
+    CodecContextPtr dec_ctx;
+    CodecContextPtr enc_ctx;
+    FilteringContext *filter_ctx;
+    int output;  // index into the outputs of the job
+
+    TranscodeLane *source;                  // lane feeding this one, or NULL
+    std::vector<TranscodeLane *> renditions; // lanes fed by this one
+
+    // keyframes forced at segment boundaries, in AV_TIME_BASE, 0 for none
+    int64_t key_interval;
+    int64_t next_key;
+
+    BoundedQueue<AVPacket *> *packets;  // demux -> decode
+    BoundedQueue<AVFrame *> *decoded;   // decode -> filter
+    BoundedQueue<AVFrame *> *filtered;  // filter -> encode
+} TranscodeLane;
+
+struct ChunkJob;
+
 class TranscoderFFmpeg : public Transcoder {
+    // the microbenchmarks run single stages without opening a job
+    friend class TranscoderFFmpegBench;
+
 public:
     TranscoderFFmpeg(ProcessParameter *processParameter,
                      EncodeParameter *encodeParameter);
@@ -43,31 +127,54 @@ public:
 
     bool transcode(std::string input_path, std::string output_path);
 
+    void fill_stats(TranscodeStats *stats) override;
+
+    // split the input at keyframes, encode the ranges concurrently and join
+    // the segments without re-encoding
+    bool transcode_chunked(std::string input_path, std::string output_path);
+
+    // frame accurate cut that re-encodes only the partial GOPs at both ends
+    // of the range and copies the keyframe aligned middle
+    bool transcode_smart_cut(std::string input_path, std::string output_path);
+
     int open_media(StreamContext *decoder, StreamContext *encoder);
 
     int init_filter(AVCodecContext *dec_ctx, FilteringContext *filter_ctx, const char *filters_descr);
 
-    int init_filters_wrapper(StreamContext *decoder);
+    // graph with one buffersink per filter_ctx entry, the outputs of
+    // filters_descr are labelled out0, out1... The first entry owns the graph.
+    int init_filter(AVCodecContext *dec_ctx, FilteringContext **filter_ctx,
+                    int nb_outputs, const char *filters_descr);
 
-    int encode_video(AVStream *inStream, StreamContext *encoder,
-                     AVFrame *frame);
+    int init_filters_wrapper(TranscodeLane *lane);
 
-    int encode_write_video(StreamContext *encoder, AVFrame *frame);
+    // format and scale chain of the output the lane writes to
+    std::string output_filters(TranscodeLane *lane);
 
-    int transcode_video(StreamContext *decoder, StreamContext *encoder);
+    // decode stage: send one packet (NULL to flush) and queue the frames
+    int transcode_packet(TranscodeLane *lane, AVPacket *pkt);
 
-    int encode_audio(AVStream *inStream, StreamContext *encoder,
-                     AVFrame *frame);
+    // filter stage: push one frame (NULL to flush) and queue the output
+    int encode_frame(TranscodeLane *lane, AVFrame *frame);
 
-    int encode_write_audio(StreamContext *encoder, AVFrame *frame);
+    // queue the frames waiting in the buffersink of the lane
+    int drain_filter(TranscodeLane *lane);
 
-    int transcode_audio(StreamContext *decoder, StreamContext *encoder);
+    // encode stage: send one frame (NULL to flush) and queue the packets
+    int encode_write_frame(TranscodeLane *lane, AVFrame *frame);
 
-    int prepare_decoder(StreamContext *decoder);
+    // pick the main video and audio streams, they drive progress and cutting
+    int find_main_streams(StreamContext *decoder);
 
-    int prepare_encoder_video(StreamContext *decoder, StreamContext *encoder);
+    // apply the stream rules and set up a lane for every stream that is kept
+    // in every output
+    int prepare_streams(StreamContext *decoder);
 
-    int prepare_encoder_audio(StreamContext *decoder, StreamContext *encoder);
+    int prepare_decoder(TranscodeLane *lane, AVFormatContext *ifmtCtx);
+
+    int prepare_encoder_video(TranscodeLane *lane, AVFormatContext *ofmtCtx);
+
+    int prepare_encoder_audio(TranscodeLane *lane, AVFormatContext *ofmtCtx);
 
     int prepare_copy(AVFormatContext *avCtx, AVStream **stream,
                      AVCodecParameters *codecParam);
@@ -75,17 +182,107 @@ public:
     int remux(AVPacket *pkt, AVFormatContext *avCtx, AVStream *inStream,
               AVStream *outStream);
 
+    int remux(AVPacket *pkt, AVFormatContext *avCtx, AVStream *outStream,
+              AVRational inTimeBase);
+
 private:
+    bool transcode_single(std::string input_path, std::string output_path);
+
+    int collect_keyframes(const std::string &input_path,
+                          const AVOutputFormat *ofmt,
+                          std::vector<double> &keyframes, double &duration,
+                          int &video_idx, StreamAction &video_action,
+                          int &other_streams);
+    // run the jobs concurrently, the first video_jobs write the main video in
+    // order, a remaining job writes all other streams
+    bool run_segment_jobs(const std::string &input_path,
+                          const std::string &output_path,
+                          std::vector<ChunkJob> &jobs, size_t video_jobs);
+    bool stitch_chunks(const std::vector<std::string> &segments,
+                       const std::string &rest_segment,
+                       const std::string &output_path);
+
+    StreamAction resolve_stream_action(AVStream *stream, const AVOutputFormat *ofmt);
+    // decide what happens to every input stream before anything is opened,
+    // the demuxer discards the streams that reach no output
+    int plan_streams(StreamContext *decoder);
+    // stream whose timestamps decide where a cut ends
+    AVStream *clock_stream(StreamContext *decoder);
+    void close_streams();
+
+    // create the output contexts of the main output and the renditions
+    int open_outputs(StreamContext *encoder);
+    void close_outputs();
+    // write the header with the muxer options of the job, MP4 is fragmented
+    // when it cannot seek or a fragment duration is set
+    int write_header(AVFormatContext *fmtCtx);
+    // segment length of HLS and DASH outputs in seconds, 0 for other formats
+    double segment_duration(const AVOutputFormat *ofmt);
+    // write-behind settings of an output, the preallocation is estimated
+    // from the stream bit rates and the duration in seconds
+    AsyncWriterOptions output_io_options(int output, double duration);
+
+    // pipeline driver, runs until the input is exhausted or a stage fails
+    int run_pipeline(StreamContext *decoder, double startTime, int64_t endPts);
+    // single threaded demux to mux loop for jobs that only copy streams
+    int run_remux(StreamContext *decoder, double startTime, int64_t endPts);
+    // nothing is set up to be transcoded, the input needs no decoders
+    bool copy_only();
+    void setup_lanes(StreamContext *decoder);
+    void pick_progress_stream(StreamContext *decoder);
+    void free_lanes();
+    int push_copy(TranscodeLane *lane, AVPacket *pkt);
+    TranscodeLane *find_lane(int stream_index);
+
+    void demux_loop(StreamContext *decoder, double startTime, int64_t endPts);
+    void decode_loop(TranscodeLane *lane);
+    void filter_loop(TranscodeLane *lane);
+    void encode_loop(TranscodeLane *lane);
+    int mux_loop(OutputContext *output);
+
+    void producer_done();
+    // report the phase of the job, chunk workers stay silent
+    void enter_phase(TranscodePhase phase);
+    // account a finished FFmpeg call to its stage and trace it
+    void stage_done(TranscodeStage stage, const char *event, int stream, int64_t since);
+    void abort_pipeline(int err);
+
     char errorMsg[128];
-    // encoder's parameters
-    bool copyVideo;
-    bool copyAudio;
 
-    FilteringContext *filters_ctx;
+    // one per input stream and output, indexed output major
+    std::vector<FilteringContext> filters;
+
+    // pipeline state
+    std::vector<OutputContext> outputs;
+    std::vector<TranscodeLane> lanes;
+    std::vector<StreamAction> streamPlan;  // per input stream
+    MediaPool *mediaPool = NULL;
+    AVStream *progressStream = NULL;
+    std::atomic<int> activeProducers{0};
+    std::atomic<int> pipelineError{0};
+    std::atomic<bool> pipelineAborted{false};
+
+    // chunk workers only handle one input stream (or all but one) and write
+    // shifted timestamps
+    int onlyStreamIdx;
+    int skipStreamIdx;
+    int64_t outputTsOffset;
+    bool reportProgress;
+    // smart cut workers encode with the parameters of the source stream
+    bool matchSource;
+
+    // decoded frames outside [cutStart, cutEnd) are dropped, -1 is unbounded
+    double cutStart;
+    double cutEnd;
+
+    // stage timing and stream counters, chunk workers add to the counters
+    // of the job that started them
+    TranscodeCounters ownCounters;
+    TranscodeCounters *counters;
 
     // Progress tracking
     int64_t total_duration;   // Total duration in microseconds
-    int64_t current_duration; // Current processed duration in microseconds
+    std::atomic<int64_t> current_duration; // Current processed duration in microseconds
 
     // Helper function to update progress
     void update_progress(int64_t current_pts, AVRational time_base);
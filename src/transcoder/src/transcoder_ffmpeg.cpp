@@ -15,9 +15,15 @@
 
 #include "../include/transcoder_ffmpeg.h"
 extern "C" {
+#include <libavcodec/bsf.h>
 #include <libavutil/pixdesc.h>
 }
+#include <algorithm>
 #include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
 
 /* Receive pointers from converter */
 TranscoderFFmpeg::TranscoderFFmpeg(ProcessParameter *processParameter,
@@ -26,6 +32,14 @@ TranscoderFFmpeg::TranscoderFFmpeg(ProcessParameter *processParameter,
     frameTotalNumber = 0;
     total_duration = 0;
     current_duration = 0;
+    onlyStreamIdx = OC_INVALID_STREAM_IDX;
+    skipStreamIdx = OC_INVALID_STREAM_IDX;
+    outputTsOffset = 0;
+    reportProgress = true;
+    matchSource = false;
+    cutStart = -1;
+    cutEnd = -1;
+    counters = &ownCounters;
 }
 
 void TranscoderFFmpeg::print_error(const char *msg, int ret) {
@@ -40,28 +54,63 @@ void TranscoderFFmpeg::update_progress(int64_t current_pts,
     current_duration = av_rescale_q(current_pts, time_base, micros_base);
 
     // Calculate progress percentage
-    if (total_duration > 0) {
+    if (total_duration > 0 && reportProgress) {
+        counters->SetMediaTime(std::max(
+            current_duration - (cutStart > 0 ? (int64_t)(cutStart * AV_TIME_BASE) : 0),
+            (int64_t)0));
         // Use the base class's send_process_parameter which handles time delays
         // and smoothing
         send_process_parameter(current_duration, total_duration);
     }
 }
 
+// apply the requested threading before avcodec_open2(), a negative count and
+// an empty type keep the codec defaults
+static void set_codec_threads(AVCodecContext *ctx, int count,
+                              const std::string &type) {
+    if (count >= 0)
+        ctx->thread_count = count;
+    if (type == "frame")
+        ctx->thread_type = FF_THREAD_FRAME;
+    else if (type == "slice")
+        ctx->thread_type = FF_THREAD_SLICE;
+}
+
+static void log_codec_threads(const char *what, AVCodecContext *ctx) {
+    const char *type = "none";
+    if (ctx->active_thread_type & FF_THREAD_FRAME)
+        type = "frame";
+    else if (ctx->active_thread_type & FF_THREAD_SLICE)
+        type = "slice";
+    av_log(NULL, AV_LOG_INFO, "%s %s: %d threads, %s threading\n", what,
+           ctx->codec->name, ctx->thread_count, type);
+}
+
 int TranscoderFFmpeg::init_filter(AVCodecContext *dec_ctx, FilteringContext *filter_ctx, const char *filters_descr)
+{
+    return init_filter(dec_ctx, &filter_ctx, 1, filters_descr);
+}
+
+int TranscoderFFmpeg::init_filter(AVCodecContext *dec_ctx,
+                                  FilteringContext **filter_ctx,
+                                  int nb_outputs, const char *filters_descr)
 {
     char args[512];
     int ret = 0;
     const AVFilter *buffersrc = NULL;
     const AVFilter *buffersink = NULL;
-    AVFilterInOut *outputs = avfilter_inout_alloc();
-    AVFilterInOut *inputs  = avfilter_inout_alloc();
-    AVFilterContext *buffersink_ctx = NULL;
+    AVFilterInOut *graph_outputs = avfilter_inout_alloc();
+    AVFilterInOut *graph_inputs = NULL;
+    std::vector<AVFilterContext *> buffersink_ctx(nb_outputs, NULL);
     AVFilterContext *buffersrc_ctx = NULL;
     AVFilterGraph *filter_graph = avfilter_graph_alloc();
-    if (!outputs || !inputs || !filter_graph) {
+    if (!graph_outputs || !filter_graph) {
         ret = AVERROR(ENOMEM);
         goto end;
     }
+    // must be set before any filter is added to the graph
+    if (encodeParameter->GetFilterThreads() >= 0)
+        filter_graph->nb_threads = encodeParameter->GetFilterThreads();
 
     if (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
         buffersrc  = avfilter_get_by_name("buffer");
@@ -103,12 +152,32 @@ int TranscoderFFmpeg::init_filter(AVCodecContext *dec_ctx, FilteringContext *fil
         goto end;
     }
 
-    /* buffer video sink: to terminate the filter chain. */
-    ret = avfilter_graph_create_filter(&buffersink_ctx, buffersink, "out",
-                                       NULL, NULL, filter_graph);
-    if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot create buffer sink\n");
-        goto end;
+    /* buffer video sink: to terminate the filter chain, one per output. */
+    for (int i = nb_outputs - 1; i >= 0; i--) {
+        std::string name = nb_outputs > 1 ? "out" + std::to_string(i) : "out";
+        ret = avfilter_graph_create_filter(&buffersink_ctx[i], buffersink,
+                                           name.c_str(), NULL, NULL, filter_graph);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot create buffer sink\n");
+            goto end;
+        }
+
+        /*
+         * The buffer sink input must be connected to the output pad of
+         * the last filter described by filters_descr; since the last
+         * filter output label is not specified, it is set to "out" by
+         * default.
+         */
+        AVFilterInOut *input = avfilter_inout_alloc();
+        if (!input) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        input->name       = av_strdup(name.c_str());
+        input->filter_ctx = buffersink_ctx[i];
+        input->pad_idx    = 0;
+        input->next       = graph_inputs;
+        graph_inputs = input;
     }
 
     /*
@@ -122,117 +191,153 @@ int TranscoderFFmpeg::init_filter(AVCodecContext *dec_ctx, FilteringContext *fil
      * filter input label is not specified, it is set to "in" by
      * default.
      */
-    outputs->name       = av_strdup("in");
-    outputs->filter_ctx = buffersrc_ctx;
-    outputs->pad_idx    = 0;
-    outputs->next       = NULL;
-
-    /*
-     * The buffer sink input must be connected to the output pad of
-     * the last filter described by filters_descr; since the last
-     * filter output label is not specified, it is set to "out" by
-     * default.
-     */
-    inputs->name       = av_strdup("out");
-    inputs->filter_ctx = buffersink_ctx;
-    inputs->pad_idx    = 0;
-    inputs->next       = NULL;
+    graph_outputs->name       = av_strdup("in");
+    graph_outputs->filter_ctx = buffersrc_ctx;
+    graph_outputs->pad_idx    = 0;
+    graph_outputs->next       = NULL;
 
     if ((ret = avfilter_graph_parse_ptr(filter_graph, filters_descr,
-                                    &inputs, &outputs, NULL)) < 0)
+                                    &graph_inputs, &graph_outputs, NULL)) < 0)
         goto end;
 
     if ((ret = avfilter_graph_config(filter_graph, NULL)) < 0)
         goto end;
+    av_log(NULL, AV_LOG_INFO, "%s filter graph: %d threads\n",
+           av_get_media_type_string(dec_ctx->codec_type), filter_graph->nb_threads);
 
-    filter_ctx->buffersink_ctx = buffersink_ctx;
-    filter_ctx->buffersrc_ctx = buffersrc_ctx;
-    filter_ctx->filter_graph = filter_graph;
+    for (int i = 0; i < nb_outputs; i++) {
+        filter_ctx[i]->buffersink_ctx = buffersink_ctx[i];
+        filter_ctx[i]->buffersrc_ctx = buffersrc_ctx;
+        filter_ctx[i]->filter_graph.reset(i == 0 ? filter_graph : NULL);
+    }
+    filter_graph = NULL;
 
 end:
-    avfilter_inout_free(&inputs);
-    avfilter_inout_free(&outputs);
+    avfilter_graph_free(&filter_graph);
+    avfilter_inout_free(&graph_inputs);
+    avfilter_inout_free(&graph_outputs);
 
     return ret;
 }
 
 
-int TranscoderFFmpeg::init_filters_wrapper(StreamContext *decoder)
+std::string TranscoderFFmpeg::output_filters(TranscodeLane *lane)
 {
-    int i, ret = -1;
-    const char *filters_descr;
-    AVCodecContext *dec_ctx = NULL;
-    filters_ctx = reinterpret_cast<FilteringContext *>(av_malloc_array(decoder->fmtCtx->nb_streams, sizeof(*filters_ctx)));
-    if (!filters_ctx)
-        return AVERROR(ENOMEM);
+    std::string filters_descr;
 
-    for (i = 0; i < decoder->fmtCtx->nb_streams; i++) {
-        filters_ctx[i].buffersrc_ctx  = NULL;
-        filters_ctx[i].buffersink_ctx = NULL;
-        filters_ctx[i].filter_graph   = NULL;
-        if (!(decoder->fmtCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO ||
-            decoder->fmtCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO))
-            continue;
-        if (decoder->fmtCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            std::string d = "";
-            std::string pixelFormat = encodeParameter->get_pixel_format();
-            uint16_t width = encodeParameter->get_width();
-            uint16_t height = encodeParameter->get_height();
-            if (!pixelFormat.empty()) {
-                d += "format=" + pixelFormat;
-            }
-            if (width > 0 && height > 0) {
-                if (!d.empty()) {
-                    d += ",";
-                }
-                d += "scale=" + std::to_string(width) + ":" + std::to_string(height);
+    if (lane->in_stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+        std::string pixelFormat = encodeParameter->get_pixel_format();
+        uint16_t width = outputs[lane->output].width;
+        uint16_t height = outputs[lane->output].height;
+        if (!pixelFormat.empty()) {
+            filters_descr += "format=" + pixelFormat;
+        }
+        if (width > 0 && height > 0) {
+            if (!filters_descr.empty()) {
+                filters_descr += ",";
             }
-            if (d.empty())
-                d = "null";
-            filters_descr = d.c_str();
-            dec_ctx = decoder->videoCodecCtx;
-        } else {
-            filters_descr = "anull";
-            dec_ctx = decoder->audioCodecCtx;
+            filters_descr += "scale=" + std::to_string(width) + ":" + std::to_string(height);
         }
-        ret = init_filter(dec_ctx, &filters_ctx[i], filters_descr);
+        if (filters_descr.empty())
+            filters_descr = "null";
+    } else {
+        filters_descr = "anull";
     }
-    return ret;
+    return filters_descr;
+}
+
+int TranscoderFFmpeg::init_filters_wrapper(TranscodeLane *lane)
+{
+    std::vector<FilteringContext *> branches;
+    std::string filters_descr;
+
+    if (lane->renditions.empty())
+        return init_filter(lane->dec_ctx.get(), lane->filter_ctx,
+                           output_filters(lane).c_str());
+
+    // decode once and split the frames into one chain per output
+    std::vector<TranscodeLane *> targets(1, lane);
+    targets.insert(targets.end(), lane->renditions.begin(), lane->renditions.end());
+    filters_descr = lane->dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO ? "split=" : "asplit=";
+    filters_descr += std::to_string(targets.size());
+    for (size_t i = 0; i < targets.size(); i++)
+        filters_descr += "[s" + std::to_string(i) + "]";
+    for (size_t i = 0; i < targets.size(); i++) {
+        filters_descr += ";[s" + std::to_string(i) + "]" + output_filters(targets[i]) +
+                         "[out" + std::to_string(i) + "]";
+        branches.push_back(targets[i]->filter_ctx);
+    }
+    return init_filter(lane->dec_ctx.get(), branches.data(), (int)branches.size(),
+                       filters_descr.c_str());
+}
+
+void TranscoderFFmpeg::fill_stats(TranscodeStats *stats) {
+    counters->Snapshot(stats);
 }
 
 bool TranscoderFFmpeg::transcode(std::string input_path,
                                  std::string output_path) {
+    // chunk workers count into the job that started them
+    if (counters == &ownCounters)
+        counters->Reset();
+    // the renditions share the decoder, they are not split into jobs
+    if (!encodeParameter->GetRenditions().empty())
+        return transcode_single(input_path, output_path);
+    // segment jobs reopen the input and stage files, pipes allow neither
+    if (input_path == "-" || output_path == "-") {
+        if (encodeParameter->GetSmartCut() || encodeParameter->GetChunkCount() > 1)
+            av_log(NULL, AV_LOG_WARNING,
+                   "Smart cut and chunks need files, using a single pass\n");
+        return transcode_single(input_path, output_path);
+    }
+    if (encodeParameter->GetSmartCut()) {
+        if (encodeParameter->get_video_codec_name() != "")
+            av_log(NULL, AV_LOG_WARNING,
+                   "Smart cut copies the video, ignored with a video encoder\n");
+        else if (encodeParameter->GetStartTime() > 0 ||
+                 encodeParameter->GetEndTime() > 0)
+            return transcode_smart_cut(input_path, output_path);
+    }
+    if (encodeParameter->GetChunkCount() > 1) {
+        if (encodeParameter->get_video_codec_name() != "")
+            return transcode_chunked(input_path, output_path);
+        av_log(NULL, AV_LOG_WARNING,
+               "Chunked encoding needs a video encoder, using a single pass\n");
+    }
+    return transcode_single(input_path, output_path);
+}
+
+bool TranscoderFFmpeg::transcode_single(std::string input_path,
+                                        std::string output_path) {
     bool flag = false;
     int ret = -1;
     // deal with arguments
 
-    StreamContext *decoder = new StreamContext;
-    StreamContext *encoder = new StreamContext;
+    // closed on every path, the output before it was finished included
+    StreamContext inputContext;
+    StreamContext outputContext;
+    StreamContext *decoder = &inputContext;
+    StreamContext *encoder = &outputContext;
+    mediaPool = new MediaPool();
 
     // Declare variables before any goto statements
     double startTime = encodeParameter->GetStartTime();
     double endTime = encodeParameter->GetEndTime();
     int64_t endPts = -1;
+    double span;
+    PacketIndex index;
 
-    av_log_set_level(AV_LOG_DEBUG);
+    cutStart = startTime > 0 ? startTime : -1;
+    cutEnd = endTime > 0 ? endTime : -1;
 
     decoder->filename = input_path.c_str();
     encoder->filename = output_path.c_str();
 
-    if (encodeParameter->get_video_codec_name() == "") {
-        copyVideo = true;
-    } else {
-        copyVideo = false;
-    }
-
-    if (encodeParameter->get_audio_codec_name() == "") {
-        copyAudio = true;
-    } else {
-        copyAudio = false;
-    }
-
+    enter_phase(PHASE_OPEN);
     if ((ret = open_media(decoder, encoder)) < 0)
         goto end;
+    if ((ret = open_outputs(encoder)) < 0)
+        goto end;
 
     // Calculate total duration from the input file
     if (decoder->fmtCtx->duration != AV_NOPTS_VALUE) {
@@ -291,648 +396,2007 @@ bool TranscoderFFmpeg::transcode(std::string input_path,
         }
     }
 
-    if ((ret = prepare_decoder(decoder)) < 0)
+    enter_phase(PHASE_PREPARE);
+    if ((ret = plan_streams(decoder)) < 0)
         goto end;
 
-    if ((ret = init_filters_wrapper(decoder)) < 0)
+    if ((ret = find_main_streams(decoder)) < 0)
         goto end;
 
-    for (int i = 0; i < decoder->fmtCtx->nb_streams; i++) {
-        if (decoder->fmtCtx->streams[i]->codecpar->codec_type ==
-            AVMEDIA_TYPE_VIDEO) {
-            // skip video streams
-            if (encoder->fmtCtx->oformat->video_codec == AV_CODEC_ID_NONE) {
-                continue;
-            }
-            if (!copyVideo) {
-                if ((ret = prepare_encoder_video(decoder, encoder)) < 0)
-                    goto end;
-            } else {
-                ret = prepare_copy(encoder->fmtCtx, &encoder->videoStream,
-                                   decoder->videoStream->codecpar);
-                if (ret < 0)
-                    goto end;
-            }
-        } else if (decoder->fmtCtx->streams[i]->codecpar->codec_type ==
-                   AVMEDIA_TYPE_AUDIO) {
-            // skip audio streams
-            if (encoder->fmtCtx->oformat->audio_codec == AV_CODEC_ID_NONE) {
-                continue;
-            }
-            if (!copyAudio) {
-                if ((ret = prepare_encoder_audio(decoder, encoder)) < 0)
-                    goto end;
-            } else {
-                ret = prepare_copy(encoder->fmtCtx, &encoder->audioStream,
-                                   decoder->audioStream->codecpar);
-                if (ret < 0)
-                    goto end;
-            }
-        }
-    }
-    // binding
-    ret = avio_open2(&encoder->fmtCtx->pb, encoder->filename, AVIO_FLAG_WRITE,
-                     NULL, NULL);
-    if (ret < 0) {
-        print_error("Failed to open output file", ret);
+    if ((ret = prepare_streams(decoder)) < 0)
         goto end;
+    for (const TranscodeLane &lane : lanes) {
+        if (lane.output == 0)
+            counters->SetStream(lane.in_stream->index,
+                                av_get_media_type_string(lane.in_stream->codecpar->codec_type),
+                                !lane.dec_ctx);
     }
-    /* Write the stream header, if any. */
-    if ((ret = avformat_write_header(encoder->fmtCtx, NULL)) < 0) {
-        print_error("Failed to write header", ret);
-        goto end;
+
+    // expected length of the output, sizes the preallocation
+    span = (endTime > 0 ? endTime : total_duration / 1000000.0) -
+           (startTime > 0 ? startTime : 0);
+    for (size_t i = 0; i < outputs.size(); i++) {
+        OutputContext &output = outputs[i];
+        // binding, the muxers hand their writes to a background writer.
+        // Packagers like HLS and DASH open their files themselves.
+        if (!(output.encoder->fmtCtx->oformat->flags & AVFMT_NOFILE)) {
+            ret = AsyncWriter::Open(&output.encoder->fmtCtx->pb, output.encoder->filename,
+                                    output_io_options(i, span));
+            if (ret < 0) {
+                print_error("Failed to open output file", ret);
+                goto end;
+            }
+        }
+        /* Write the stream header, if any. */
+        if ((ret = write_header(output.encoder->fmtCtx)) < 0) {
+            print_error("Failed to write header", ret);
+            goto end;
+        }
     }
 
     // Handle start time seeking if specified
     if (startTime > 0) {
         int64_t seek_target = static_cast<int64_t>(startTime * AV_TIME_BASE);
-        if ((ret = av_seek_frame(decoder->fmtCtx, -1, seek_target, AVSEEK_FLAG_BACKWARD)) < 0) {
+        // a cached packet index gives the exact keyframe to start from
+        if (index.Load(input_path) >= 0 && decoder->videoIdx >= 0) {
+            AVRational tb = index.GetTimeBase(decoder->videoIdx);
+            ret = index.SeekToKeyframe(decoder->fmtCtx, decoder->videoIdx,
+                                       llrint(startTime / av_q2d(tb)));
+        } else {
+            ret = AVERROR(ENOENT);
+        }
+        if (ret < 0 &&
+            (ret = av_seek_frame(decoder->fmtCtx, -1, seek_target, AVSEEK_FLAG_BACKWARD)) < 0) {
             av_log(NULL, AV_LOG_WARNING, "Could not seek to start time\n");
         }
         // Flush codec buffers after seeking
-        if (decoder->videoCodecCtx) {
-            avcodec_flush_buffers(decoder->videoCodecCtx);
-        }
-        if (decoder->audioCodecCtx) {
-            avcodec_flush_buffers(decoder->audioCodecCtx);
+        for (TranscodeLane &lane : lanes) {
+            if (lane.dec_ctx)
+                avcodec_flush_buffers(lane.dec_ctx.get());
         }
     }
 
     // Calculate end time in stream time base for comparison
-    if (endTime > 0 && decoder->videoIdx >= 0) {
-        endPts = static_cast<int64_t>(endTime / av_q2d(decoder->videoStream->time_base));
+    if (endTime > 0 && clock_stream(decoder)) {
+        // round, chunk boundaries are exact keyframe timestamps
+        endPts = llrint(endTime / av_q2d(clock_stream(decoder)->time_base));
     }
 
-    // read video data from multimedia files to write into destination file
-    while (av_read_frame(decoder->fmtCtx, decoder->pkt) >= 0) {
-        // Check if we've reached the end time
-        if (endPts > 0 && decoder->pkt->stream_index == decoder->videoIdx) {
-            if (decoder->pkt->pts >= endPts) {
-                av_packet_unref(decoder->pkt);
-                break;
-            }
-        }
-
-        if (decoder->pkt->stream_index == decoder->videoIdx) {
-            if (encoder->fmtCtx->oformat->video_codec == AV_CODEC_ID_NONE) {
-                continue;
-            }
-
-            // Skip frames before start time
-            if (startTime > 0) {
-                double framePts = decoder->pkt->pts * av_q2d(decoder->videoStream->time_base);
-                if (framePts < startTime) {
-                    av_packet_unref(decoder->pkt);
-                    continue;
-                }
-            }
-
-            // Update progress based on video stream
-            update_progress(decoder->pkt->pts, decoder->videoStream->time_base);
-
-            if (!copyVideo) {
-                av_packet_rescale_ts(decoder->pkt, decoder->videoStream->time_base,
-                                     decoder->videoCodecCtx->time_base);
-                if ((ret = transcode_video(decoder, encoder)) < 0) {
-                    av_log(NULL, AV_LOG_ERROR, "Failed to transcode video frame\n");
-                    goto end;
-                }
-            } else {
-                ret = remux(decoder->pkt, encoder->fmtCtx, decoder->videoStream,
-                            encoder->videoStream);
-                if (ret < 0) {
-                    av_log(NULL, AV_LOG_ERROR, "Failed to remux video packet\n");
-                    goto end;
-                }
-            }
-        } else if (decoder->pkt->stream_index == decoder->audioIdx) {
-            if (encoder->fmtCtx->oformat->audio_codec == AV_CODEC_ID_NONE) {
-                continue;
-            }
-
-            // Skip frames before start time
-            if (startTime > 0) {
-                double framePts = decoder->pkt->pts * av_q2d(decoder->audioStream->time_base);
-                if (framePts < startTime) {
-                    av_packet_unref(decoder->pkt);
-                    continue;
-                }
-            }
-
-            // Update progress based on audio stream if no video stream
-            if (decoder->videoIdx < 0) {
-                update_progress(decoder->pkt->pts,
-                                decoder->audioStream->time_base);
-            }
-
-            if (!copyAudio) {
-                av_packet_rescale_ts(decoder->pkt, decoder->audioStream->time_base,
-                                     decoder->audioCodecCtx->time_base);
-                if ((ret = transcode_audio(decoder, encoder)) < 0) {
-                    av_log(NULL, AV_LOG_ERROR, "Failed to transcode audio frame\n");
-                    goto end;
-                }
-            } else {
-                ret = remux(decoder->pkt, encoder->fmtCtx, decoder->audioStream,
-                            encoder->audioStream);
-                if (ret < 0) {
-                    av_log(NULL, AV_LOG_ERROR, "Failed to remux audio packet\n");
-                    goto end;
-                }
-            }
-        }
-    }
-    if (!copyVideo) {
-        encoder->frame = NULL;
-        // write the buffered frame
-        if ((ret = encode_write_video(encoder, NULL)) < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Failed to flush video encoder\n");
-            goto end;
-        }
-    }
-    if (!copyAudio) {
-        encoder->frame = NULL;
-        if ((ret = encode_write_audio(encoder, NULL)) < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Failed to flush audio encoder\n");
+    // with nothing to decode the packets go straight to the muxer,
+    // otherwise demux, decode, filter, encode and mux run concurrently
+    enter_phase(PHASE_LOOP);
+    if (outputs.size() == 1 &&
+        std::none_of(lanes.begin(), lanes.end(),
+                     [](const TranscodeLane &lane) { return lane.dec_ctx != NULL; })) {
+        if ((ret = run_remux(decoder, startTime, endPts)) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Remux failed\n");
             goto end;
         }
+    } else if ((ret = run_pipeline(decoder, startTime, endPts)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Transcode pipeline failed\n");
+        goto end;
     }
 
     processParameter->set_process_number(1, 1);
 
-    if ((ret = av_write_trailer(encoder->fmtCtx)) < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to write trailer");
-        goto end;
+    enter_phase(PHASE_TRAILER);
+    for (OutputContext &output : outputs) {
+        if ((ret = av_write_trailer(output.encoder->fmtCtx)) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Failed to write trailer");
+            goto end;
+        }
+        // the output is complete only once the writer caught up
+        if ((ret = AsyncWriter::Close(&output.encoder->fmtCtx->pb)) < 0)
+            goto end;
     }
 
     flag = true;
 // free memory
 end:
-    if (decoder->fmtCtx) {
-        avformat_close_input(&decoder->fmtCtx);
-        decoder->fmtCtx = NULL;
-    }
-    delete decoder;
-
-    if (encoder->fmtCtx && !(encoder->fmtCtx->oformat->flags & AVFMT_NOFILE)) {
-        avio_closep(&encoder->fmtCtx->pb);
-    }
-    delete encoder;
-
+    enter_phase(PHASE_CLOSE);
+    close_streams();
+    decoder->Close();
+    close_outputs();
+    encoder->Close();
+
+    // the encoders may allocate from the pool until they are freed above
+    mediaPool->LogStats();
+    delete mediaPool;
+    mediaPool = NULL;
+
+    enter_phase(PHASE_IDLE);
     return flag;
 }
 
-int TranscoderFFmpeg::open_media(StreamContext *decoder,
-                                 StreamContext *encoder) {
+int TranscoderFFmpeg::collect_keyframes(const std::string &input_path,
+                                        const AVOutputFormat *ofmt,
+                                        std::vector<double> &keyframes,
+                                        double &duration, int &video_idx,
+                                        StreamAction &video_action,
+                                        int &other_streams) {
+    AVFormatContext *fmt_ctx = NULL;
+    PacketIndex index;
+    int64_t endPts;
     int ret = -1;
-    /* set the frameNumber to zero to avoid some bugs */
-    frameNumber = 0;
-    // open the multimedia file
-    if ((ret = avformat_open_input(&decoder->fmtCtx, decoder->filename, NULL,
-                                   NULL)) < 0) {
-        print_error("Failed to open input file", ret);
-        return ret;
-    }
 
-    if ((ret = avformat_find_stream_info(decoder->fmtCtx, NULL)) < 0) {
-        print_error("Failed to find stream info", ret);
+    if ((ret = avformat_open_input(&fmt_ctx, input_path.c_str(), NULL, NULL)) < 0)
         return ret;
-    }
-
-    ret = avformat_alloc_output_context2(&encoder->fmtCtx, NULL, NULL,
-                                         encoder->filename);
-    if (!encoder->fmtCtx) {
-        av_log(NULL, AV_LOG_ERROR, "Could not create output context\n");
-        return AVERROR(ENOMEM);
-    }
-
-    return 0;
-}
-
-int TranscoderFFmpeg::encode_video(AVStream *inStream, StreamContext *encoder,
-                                   AVFrame *frame) {
-    int ret = -1;
-    FilteringContext *fc = &filters_ctx[inStream->index];
+    if ((ret = ProbeCache::Instance().FindStreamInfo(fmt_ctx, input_path)) < 0)
+        goto end;
 
-    /* push the decoded frame into the filtergraph */
-    if ((ret = av_buffersrc_add_frame_flags(fc->buffersrc_ctx, frame, AV_BUFFERSRC_FLAG_KEEP_REF)) < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Error while feeding the filtergraph\n");
+    video_idx = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (video_idx < 0) {
+        ret = video_idx;
         goto end;
     }
-    /* pull filtered frames from the filtergraph */
-    while (1) {
-        if ((ret = av_buffersink_get_frame(fc->buffersink_ctx, frame)) == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            ret = 0;
-            break;
-        }
-        if (ret < 0)
-            goto end;
-        ret = encode_write_video(encoder, frame);
-        if (ret < 0)
-            goto end;
+    video_action = resolve_stream_action(fmt_ctx->streams[video_idx], ofmt);
+    other_streams = 0;
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        if ((int)i != video_idx &&
+            resolve_stream_action(fmt_ctx->streams[i], ofmt) != STREAM_ACTION_DROP)
+            other_streams++;
     }
+    duration = fmt_ctx->duration != AV_NOPTS_VALUE
+                   ? fmt_ctx->duration / (double)AV_TIME_BASE
+                   : 0;
+
+    // the packet index scans the file once and serves later runs from its
+    // sidecar, the chunk workers use it to seek as well
+    if ((ret = index.Open(input_path)) < 0)
+        goto end;
+    keyframes = index.GetKeyframeTimes(video_idx);
+    endPts = index.GetEndPts(video_idx);
+    if (endPts != AV_NOPTS_VALUE)
+        duration = std::max(duration, endPts * av_q2d(index.GetTimeBase(video_idx)));
+    ret = 0;
+
 end:
+    avformat_close_input(&fmt_ctx);
     return ret;
 }
 
-int TranscoderFFmpeg::encode_write_video(StreamContext *encoder, AVFrame *frame) {
-    int ret = -1;
-    AVPacket *output_packet = av_packet_alloc();
+// one video segment (or the job for all other streams) of a chunked transcode
+// or a smart cut
+struct ChunkJob {
+    EncodeParameter param;
+    ProcessParameter process;
+    TranscoderFFmpeg *transcoder = NULL;
+    std::string path;
+    double start = 0; // seconds
+    double end = 0;   // seconds
+    bool ok = false;
+};
+
+bool TranscoderFFmpeg::transcode_chunked(std::string input_path,
+                                         std::string output_path) {
+    std::vector<double> keyframes;
+    std::vector<double> bounds;
+    double duration = 0;
+    int videoIdx = OC_INVALID_STREAM_IDX;
+    StreamAction videoAction = STREAM_ACTION_AUTO;
+    int otherStreams = 0;
+    double startTime = encodeParameter->GetStartTime();
+    double endTime = encodeParameter->GetEndTime();
+    int chunkCount = encodeParameter->GetChunkCount();
+    double minChunk = encodeParameter->GetMinChunkDuration();
+    int ret;
 
-    if (encodeParameter->get_qscale() != -1 && frame) {
-        frame->quality = encoder->videoCodecCtx->global_quality;
-        frame->pict_type = AV_PICTURE_TYPE_NONE;
+    const AVOutputFormat *ofmt = av_guess_format(NULL, output_path.c_str(), NULL);
+    if (!ofmt) {
+        av_log(NULL, AV_LOG_ERROR, "Could not guess output format\n");
+        return false;
     }
-    // send frame to encoder
-    if ((ret = avcodec_send_frame(encoder->videoCodecCtx, frame)) < 0) {
-        print_error("Failed to send frame to encoder", ret);
-        goto end;
+
+    if ((ret = collect_keyframes(input_path, ofmt, keyframes, duration, videoIdx,
+                                 videoAction, otherStreams)) < 0) {
+        print_error("Failed to scan keyframes", ret);
+        return false;
+    }
+    if (videoAction != STREAM_ACTION_TRANSCODE) {
+        av_log(NULL, AV_LOG_INFO, "Video is not transcoded, using a single pass\n");
+        return transcode_single(input_path, output_path);
     }
 
-    while (ret >= 0) {
-        if ((ret = avcodec_receive_packet(encoder->videoCodecCtx, output_packet)) == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            ret = 0;
-            goto end;
-        } else if (ret < 0) {
-            goto end;
-        }
+    double rangeStart = startTime > 0 ? startTime : 0;
+    double rangeEnd = (endTime > 0 && endTime < duration) ? endTime : duration;
 
-        output_packet->stream_index = encoder->videoStream->index;
+    // aim for evenly sized chunks and move every boundary to the next keyframe
+    bounds.push_back(rangeStart);
+    for (int i = 1; i < chunkCount && rangeEnd > rangeStart; i++) {
+        double target = rangeStart + (rangeEnd - rangeStart) * i / chunkCount;
+        auto it = std::lower_bound(keyframes.begin(), keyframes.end(), target);
+        if (it == keyframes.end())
+            break;
+        if (*it - bounds.back() < minChunk || rangeEnd - *it < minChunk)
+            continue;
+        bounds.push_back(*it);
+    }
 
-        av_packet_rescale_ts(output_packet, encoder->videoCodecCtx->time_base,
-                             encoder->videoStream->time_base);
+    if (bounds.size() < 2) {
+        av_log(NULL, AV_LOG_INFO,
+               "Input too short for %d chunks of %.1fs, using a single pass\n",
+               chunkCount, minChunk);
+        return transcode_single(input_path, output_path);
+    }
 
-        if ((ret = av_interleaved_write_frame(encoder->fmtCtx, output_packet)) < 0) {
-            print_error("Failed to write packet", ret);
+    size_t videoJobs = bounds.size();
+    std::vector<ChunkJob> jobs(videoJobs + (otherStreams > 0 ? 1 : 0));
+
+    // the main video is split, the other streams are cheap and get one job
+    // over the whole range so audio has no gaps at the chunk boundaries
+    for (size_t i = 0; i < jobs.size(); i++) {
+        ChunkJob &job = jobs[i];
+        job.param = *encodeParameter;
+        job.param.SetChunkCount(1);
+        job.param.SetSmartCut(false);
+        job.transcoder = new TranscoderFFmpeg(&job.process, &job.param);
+        job.transcoder->outputTsOffset = CHUNK_TS_OFFSET;
+        job.transcoder->reportProgress = false;
+
+        if (i < videoJobs) {
+            job.start = bounds[i];
+            job.end = i + 1 < videoJobs ? bounds[i + 1] : rangeEnd;
+            if (i > 0)
+                job.param.SetStartTime(job.start);
+            if (i + 1 < videoJobs)
+                job.param.SetEndTime(job.end);
+            job.transcoder->onlyStreamIdx = videoIdx;
+            job.path = output_path + ".oc-chunk" + std::to_string(i) + ".nut";
+        } else {
+            job.start = rangeStart;
+            job.end = rangeEnd;
+            job.transcoder->skipStreamIdx = videoIdx;
+            job.path = output_path + ".oc-rest.nut";
         }
-
-        av_packet_unref(output_packet);
     }
-end:
-    av_packet_free(&output_packet);
-    return ret;
-}
 
-int TranscoderFFmpeg::encode_audio(AVStream *in_stream, StreamContext *encoder,
-                                   AVFrame *frame) {
-    int ret = -1;
+    av_log(NULL, AV_LOG_INFO, "Encoding %zu chunks in parallel\n", videoJobs);
+    return run_segment_jobs(input_path, output_path, jobs, videoJobs);
+}
 
-    FilteringContext *fc = &filters_ctx[in_stream->index];
+bool TranscoderFFmpeg::run_segment_jobs(const std::string &input_path,
+                                        const std::string &output_path,
+                                        std::vector<ChunkJob> &jobs,
+                                        size_t video_jobs) {
+    std::atomic<size_t> finished{0};
+    std::vector<std::thread> workers;
+    bool flag = true;
+
+    enter_phase(PHASE_LOOP);
+    for (ChunkJob &job : jobs) {
+        job.transcoder->counters = counters;
+        workers.emplace_back([&job, &finished, &input_path]() {
+            job.ok = job.transcoder->transcode(input_path, job.path);
+            finished++;
+        });
+    }
 
-    /* push the decoded frame into the filtergraph */
-    if ((ret = av_buffersrc_add_frame_flags(fc->buffersrc_ctx, frame, AV_BUFFERSRC_FLAG_KEEP_REF)) < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Error while feeding the filtergraph\n");
-        goto end;
+    // report the combined progress of the video segments
+    int64_t total = 0;
+    for (size_t i = 0; i < video_jobs; i++)
+        total += static_cast<int64_t>((jobs[i].end - jobs[i].start) * AV_TIME_BASE);
+    while (finished < jobs.size()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        int64_t done = 0;
+        for (size_t i = 0; i < video_jobs; i++) {
+            int64_t start = static_cast<int64_t>(jobs[i].start * AV_TIME_BASE);
+            int64_t end = static_cast<int64_t>(jobs[i].end * AV_TIME_BASE);
+            int64_t current = jobs[i].transcoder->current_duration;
+            done += std::min(std::max(current - start, (int64_t)0), end - start);
+        }
+        if (total > 0) {
+            counters->SetMediaTime(done);
+            send_process_parameter(done, total);
+        }
     }
-    /* pull filtered frames from the filtergraph */
-    while (1) {
-        if ((ret = av_buffersink_get_frame(fc->buffersink_ctx, frame)) == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            ret = 0;
-            break;
+    for (std::thread &worker : workers)
+        worker.join();
+
+    for (ChunkJob &job : jobs) {
+        if (!job.ok) {
+            av_log(NULL, AV_LOG_ERROR, "Chunk %s failed\n", job.path.c_str());
+            flag = false;
         }
-        if (ret < 0)
-            goto end;
-        ret = encode_write_audio(encoder, frame);
-        if (ret < 0)
-            goto end;
     }
-end:
-    return ret;
-}
 
-int TranscoderFFmpeg::encode_write_audio(StreamContext *encoder, AVFrame *frame) {
-    int ret = -1;
-    AVPacket *output_packet = av_packet_alloc();
-    // send frame to encoder
-    if ((ret = avcodec_send_frame(encoder->audioCodecCtx, frame)) < 0) {
-        print_error("Failed to send frame to encoder", ret);
-        goto end;
+    enter_phase(PHASE_TRAILER);
+    if (flag) {
+        std::vector<std::string> segments;
+        for (size_t i = 0; i < video_jobs; i++)
+            segments.push_back(jobs[i].path);
+        flag = stitch_chunks(segments,
+                             jobs.size() > video_jobs ? jobs.back().path : "",
+                             output_path);
     }
-    while (ret >= 0) {
-        if ((ret = avcodec_receive_packet(encoder->audioCodecCtx, output_packet)) == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            ret = 0;
-            goto end;
-        } else if (ret < 0) {
-            goto end;
-        }
-        output_packet->stream_index = encoder->audioStream->index;
-        av_packet_rescale_ts(output_packet, encoder->audioCodecCtx->time_base,
-                             encoder->audioStream->time_base);
-        if ((ret = av_interleaved_write_frame(encoder->fmtCtx, output_packet)) < 0) {
-            print_error("Failed to write packet", ret);
-        }
-        av_packet_unref(output_packet);
+    if (flag)
+        processParameter->set_process_number(1, 1);
+
+    enter_phase(PHASE_CLOSE);
+    std::error_code ec;
+    for (ChunkJob &job : jobs) {
+        delete job.transcoder;
+        std::filesystem::remove(job.path, ec);
     }
-end:
-    av_packet_free(&output_packet);
-    return ret;
+    enter_phase(PHASE_IDLE);
+    return flag;
 }
 
-int TranscoderFFmpeg::transcode_video(StreamContext *decoder,
-                                      StreamContext *encoder) {
-    int ret = -1;
+bool TranscoderFFmpeg::transcode_smart_cut(std::string input_path,
+                                           std::string output_path) {
+    std::vector<double> keyframes;
+    double duration = 0;
+    int videoIdx = OC_INVALID_STREAM_IDX;
+    StreamAction videoAction = STREAM_ACTION_AUTO;
+    int otherStreams = 0;
+    double startTime = encodeParameter->GetStartTime();
+    double endTime = encodeParameter->GetEndTime();
+    int ret;
 
-    // send packet to decoder
-    if ((ret = avcodec_send_packet(decoder->videoCodecCtx, decoder->pkt)) < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to send packet to decoder!\n");
-        goto end;
+    const AVOutputFormat *ofmt = av_guess_format(NULL, output_path.c_str(), NULL);
+    if (!ofmt) {
+        av_log(NULL, AV_LOG_ERROR, "Could not guess output format\n");
+        return false;
     }
 
-    while (ret >= 0) {
-        if ((ret = avcodec_receive_frame(decoder->videoCodecCtx, decoder->frame)) == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            ret = 0;
-            goto end;
-        } else if (ret < 0) {
-            goto end;
-        }
+    if ((ret = collect_keyframes(input_path, ofmt, keyframes, duration, videoIdx,
+                                 videoAction, otherStreams)) < 0) {
+        print_error("Failed to scan keyframes", ret);
+        return false;
+    }
+    if (videoAction != STREAM_ACTION_COPY || keyframes.empty()) {
+        av_log(NULL, AV_LOG_INFO, "Video is not copied, using a plain cut\n");
+        return transcode_single(input_path, output_path);
+    }
 
-        if ((ret = encode_video(decoder->videoStream, encoder, decoder->frame)) < 0) {
-            goto end;
-        }
+    double rangeStart = startTime > 0 ? startTime : 0;
+    bool toEnd = endTime <= 0 || endTime >= duration;
+    double rangeEnd = toEnd ? duration : endTime;
+    if (rangeEnd <= rangeStart) {
+        av_log(NULL, AV_LOG_ERROR, "End time must be greater than start time\n");
+        return false;
+    }
 
-        if (decoder->pkt) {
-            av_packet_unref(decoder->pkt);
-        }
+    // the copied part runs from the first keyframe inside the range to the
+    // last one, the partial GOPs before and after it are re-encoded.
+    // This assumes closed GOPs: the copy stops at the first packet at
+    // copyEnd, so the leading B-frames of an open GOP there, which follow
+    // the keyframe in decode order, are neither copied nor re-encoded.
+    double copyStart = rangeEnd;
+    double copyEnd = rangeEnd;
+    auto first = std::lower_bound(keyframes.begin(), keyframes.end(), rangeStart);
+    if (first != keyframes.end())
+        copyStart = *first;
+    if (!toEnd) {
+        auto last = std::upper_bound(keyframes.begin(), keyframes.end(), rangeEnd);
+        copyEnd = last != keyframes.begin() ? *(last - 1) : rangeStart;
+    }
 
-        av_frame_unref(decoder->frame);
+    struct Segment {
+        double start;
+        double end;
+        StreamAction action;
+    };
+    std::vector<Segment> parts;
+    if (copyStart >= copyEnd) {
+        // no keyframe inside the range
+        parts.push_back({rangeStart, rangeEnd, STREAM_ACTION_TRANSCODE});
+    } else {
+        if (copyStart > rangeStart)
+            parts.push_back({rangeStart, copyStart, STREAM_ACTION_TRANSCODE});
+        parts.push_back({copyStart, copyEnd, STREAM_ACTION_COPY});
+        if (copyEnd < rangeEnd)
+            parts.push_back({copyEnd, rangeEnd, STREAM_ACTION_TRANSCODE});
     }
 
-end:
-    return ret;
+    size_t videoJobs = parts.size();
+    std::vector<ChunkJob> jobs(videoJobs + (otherStreams > 0 ? 1 : 0));
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        ChunkJob &job = jobs[i];
+        job.param = *encodeParameter;
+        job.param.SetChunkCount(1);
+        job.param.SetSmartCut(false);
+        job.transcoder = new TranscoderFFmpeg(&job.process, &job.param);
+        job.transcoder->outputTsOffset = CHUNK_TS_OFFSET;
+        job.transcoder->reportProgress = false;
+
+        if (i < videoJobs) {
+            StreamRule rule;
+            rule.index = videoIdx;
+            rule.action = parts[i].action;
+            job.param.ClearStreamRules();
+            job.param.AddStreamRule(rule);
+            job.start = parts[i].start;
+            job.end = parts[i].end;
+            job.param.SetStartTime(job.start > 0 ? job.start : -1);
+            job.param.SetEndTime(toEnd && i + 1 == videoJobs ? -1 : job.end);
+            job.transcoder->onlyStreamIdx = videoIdx;
+            job.transcoder->matchSource = parts[i].action == STREAM_ACTION_TRANSCODE;
+            job.path = output_path + ".oc-cut" + std::to_string(i) + ".nut";
+        } else {
+            job.start = rangeStart;
+            job.end = rangeEnd;
+            job.transcoder->skipStreamIdx = videoIdx;
+            job.path = output_path + ".oc-rest.nut";
+        }
+    }
+
+    av_log(NULL, AV_LOG_INFO,
+           "Smart cut: copying %.3fs-%.3fs, re-encoding %.3fs at the edges\n",
+           copyStart < copyEnd ? copyStart : 0, copyStart < copyEnd ? copyEnd : 0,
+           copyStart < copyEnd ? (copyStart - rangeStart) + (rangeEnd - copyEnd)
+                               : rangeEnd - rangeStart);
+    return run_segment_jobs(input_path, output_path, jobs, videoJobs);
 }
 
-int TranscoderFFmpeg::transcode_audio(StreamContext *decoder,
-                                      StreamContext *encoder) {
+static int open_chunk(const std::string &path, AVFormatContext **fmt_ctx) {
     int ret;
-    if ((ret = avcodec_send_packet(decoder->audioCodecCtx, decoder->pkt)) < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to send packet to decoder!\n");
+    if ((ret = MappedReader::OpenInput(fmt_ctx, path, MappedReaderOptions())) < 0)
         return ret;
-    }
-
-    while (ret >= 0) {
-        if ((ret = avcodec_receive_frame(decoder->audioCodecCtx, decoder->frame)) == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            ret = 0;
-            break;
-        } else if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR,
-                   "Failed to receive frame from decoder!\n");
-            return ret;
-        }
+    if ((ret = avformat_find_stream_info(*fmt_ctx, NULL)) < 0)
+        return ret;
+    if ((*fmt_ctx)->nb_streams < 1)
+        return AVERROR_STREAM_NOT_FOUND;
+    return 0;
+}
 
-        if ((ret = encode_audio(decoder->audioStream, encoder, decoder->frame)) < 0) {
-            return ret;
-        }
+// Copied H.264/HEVC segments carry length prefixed packets, re-encoded ones
+// Annex B with in band headers. Everything is converted to Annex B so the
+// muxer sees a single bitstream format.
+static const char *annexb_filter_name(enum AVCodecID codec_id) {
+    if (codec_id == AV_CODEC_ID_H264)
+        return "h264_mp4toannexb";
+    if (codec_id == AV_CODEC_ID_HEVC)
+        return "hevc_mp4toannexb";
+    return NULL;
+}
 
-        if (decoder->pkt) {
-            av_packet_unref(decoder->pkt);
-        }
-        av_frame_unref(decoder->frame);
-    }
-    return ret;
+// sequential reader over the video segments of a chunked or smart cut job
+typedef struct ChunkReader {
+    const std::vector<std::string> *segments;
+    size_t segment;
+    AVFormatContext *fmt_ctx;
+    AVBSFContext *bsf_ctx;
+} ChunkReader;
+
+static void close_chunk_reader(ChunkReader *reader) {
+    MappedReader::CloseInput(&reader->fmt_ctx);
+    av_bsf_free(&reader->bsf_ctx);
 }
 
-int TranscoderFFmpeg::prepare_decoder(StreamContext *decoder) {
-    int ret = -1;
+// close the current segment and open the given one, past the last segment
+// the reader is left without a context
+static int open_chunk_reader(ChunkReader *reader, size_t segment) {
+    const AVBitStreamFilter *filter;
+    AVStream *stream;
+    int ret;
 
-    for (int i = 0; i < decoder->fmtCtx->nb_streams; i++) {
-        if (decoder->fmtCtx->streams[i]->codecpar->codec_type ==
-            AVMEDIA_TYPE_VIDEO) {
-            decoder->videoStream = decoder->fmtCtx->streams[i];
-            decoder->videoIdx = i;
-        } else if (decoder->fmtCtx->streams[i]->codecpar->codec_type ==
-                   AVMEDIA_TYPE_AUDIO) {
-            decoder->audioStream = decoder->fmtCtx->streams[i];
-            decoder->audioIdx = i;
-        }
-    }
+    close_chunk_reader(reader);
+    reader->segment = segment;
+    if (segment >= reader->segments->size())
+        return 0;
 
-    // find the decoder
-    // decoder->videoCodec = avcodec_find_encoder_by_name(codec);
-    // find the decoder by ID
-    if (decoder->videoIdx != OC_INVALID_STREAM_IDX) {
-        decoder->videoCodec =
-            avcodec_find_decoder(decoder->videoStream->codecpar->codec_id);
-        if (!decoder->videoCodec) {
-            av_log(NULL, AV_LOG_ERROR, "Couldn't find codec: %s \n",
-                avcodec_get_name(decoder->videoStream->codecpar->codec_id));
-            return AVERROR_DECODER_NOT_FOUND;
-        }
-        // init decoder context
-        decoder->videoCodecCtx = avcodec_alloc_context3(decoder->videoCodec);
-        if (!decoder->videoCodecCtx) {
-            av_log(NULL, AV_LOG_ERROR, "No memory!\n");
+    if ((ret = open_chunk((*reader->segments)[segment], &reader->fmt_ctx)) < 0)
+        return ret;
+    stream = reader->fmt_ctx->streams[0];
+
+    const char *name = annexb_filter_name(stream->codecpar->codec_id);
+    if (!name)
+        return 0;
+    if (!(filter = av_bsf_get_by_name(name)))
+        return AVERROR_BSF_NOT_FOUND;
+    if ((ret = av_bsf_alloc(filter, &reader->bsf_ctx)) < 0)
+        return ret;
+    if ((ret = avcodec_parameters_copy(reader->bsf_ctx->par_in, stream->codecpar)) < 0)
+        return ret;
+    reader->bsf_ctx->time_base_in = stream->time_base;
+    return av_bsf_init(reader->bsf_ctx);
+}
+
+// parameters of the current segment as the muxer will see them
+static AVCodecParameters *chunk_reader_par(ChunkReader *reader) {
+    if (reader->bsf_ctx)
+        return reader->bsf_ctx->par_out;
+    return reader->fmt_ctx->streams[0]->codecpar;
+}
+
+static AVRational chunk_reader_time_base(ChunkReader *reader) {
+    if (reader->bsf_ctx)
+        return reader->bsf_ctx->time_base_out;
+    return reader->fmt_ctx->streams[0]->time_base;
+}
+
+// read the next packet of the segment sequence in the time base tb, moving
+// on to the next segment when the current one is exhausted
+static int read_chunk_packet(ChunkReader *reader, AVPacket *pkt, AVRational tb) {
+    int ret;
+
+    while (reader->fmt_ctx) {
+        if (!reader->bsf_ctx) {
+            // read errors end the segment the same way EOF does
+            if (av_read_frame(reader->fmt_ctx, pkt) >= 0) {
+                av_packet_rescale_ts(pkt, chunk_reader_time_base(reader), tb);
+                return 0;
+            }
+        } else {
+            ret = av_bsf_receive_packet(reader->bsf_ctx, pkt);
+            if (ret >= 0) {
+                av_packet_rescale_ts(pkt, chunk_reader_time_base(reader), tb);
+                return 0;
+            }
+            if (ret == AVERROR(EAGAIN)) {
+                if (av_read_frame(reader->fmt_ctx, pkt) >= 0)
+                    ret = av_bsf_send_packet(reader->bsf_ctx, pkt);
+                else
+                    ret = av_bsf_send_packet(reader->bsf_ctx, NULL);
+                if (ret < 0)
+                    return ret;
+                continue;
+            }
+            if (ret != AVERROR_EOF)
+                return ret;
+        }
+        if ((ret = open_chunk_reader(reader, reader->segment + 1)) < 0)
+            return ret;
+    }
+    return AVERROR_EOF;
+}
+
+bool TranscoderFFmpeg::stitch_chunks(const std::vector<std::string> &segments,
+                                     const std::string &rest_segment,
+                                     const std::string &output_path) {
+    AVFormatContext *out_ctx = NULL;
+    AVFormatContext *rest_ctx = NULL;
+    AVBSFContext *bsf_ctx = NULL;
+    AVCodecParameters *video_par = avcodec_parameters_alloc();
+    AVStream *out_video = NULL;
+    std::vector<AVStream *> out_rest;
+    ChunkReader reader = {&segments, 0, NULL, NULL};
+    PacketPtr video_pkt(av_packet_alloc());
+    PacketPtr rest_pkt(av_packet_alloc());
+    PacketPtr bsf_pkt(av_packet_alloc());
+    AVRational video_tb = {0, 1};
+    AVRational rest_tb = {0, 1};
+    int64_t video_offset = 0;
+    int64_t rest_offset = 0;
+    int64_t last_video_dts = AV_NOPTS_VALUE;
+    bool video_eof = true;
+    bool rest_eof = rest_segment.empty();
+    bool flag = false;
+    int ret = -1;
+
+    if (!video_par || !video_pkt || !rest_pkt || !bsf_pkt)
+        goto end;
+
+    // The output stream is described by the segment with the finest time
+    // base. Re-encoded smart cut segments use the frame rate, the copied one
+    // keeps the source time base and parameters. Chunks are all alike.
+    for (size_t i = 0; i < segments.size(); i++) {
+        if ((ret = open_chunk_reader(&reader, i)) < 0) {
+            print_error("Failed to open chunk", ret);
+            goto end;
+        }
+        AVRational tb = chunk_reader_time_base(&reader);
+        if (i == 0 || av_cmp_q(tb, video_tb) < 0) {
+            video_tb = tb;
+            if ((ret = avcodec_parameters_copy(video_par, chunk_reader_par(&reader))) < 0)
+                goto end;
+        }
+    }
+    if ((ret = open_chunk_reader(&reader, 0)) < 0) {
+        print_error("Failed to open chunk", ret);
+        goto end;
+    }
+    if (!rest_eof && (ret = open_chunk(rest_segment, &rest_ctx)) < 0) {
+        print_error("Failed to open chunk", ret);
+        goto end;
+    }
+
+    avformat_alloc_output_context2(&out_ctx, NULL, NULL, output_path.c_str());
+    if (!out_ctx) {
+        av_log(NULL, AV_LOG_ERROR, "Could not create output context\n");
+        goto end;
+    }
+
+    video_offset = av_rescale_q(CHUNK_TS_OFFSET, AV_TIME_BASE_Q, video_tb);
+    if ((ret = prepare_copy(out_ctx, &out_video, video_par)) < 0)
+        goto end;
+    out_video->codecpar->codec_tag = 0;
+    out_video->time_base = video_tb;
+    av_dict_copy(&out_video->metadata, reader.fmt_ctx->streams[0]->metadata, 0);
+    out_video->disposition = reader.fmt_ctx->streams[0]->disposition;
+
+    for (unsigned int i = 0; rest_ctx && i < rest_ctx->nb_streams; i++) {
+        AVStream *out_stream = NULL;
+        if ((ret = prepare_copy(out_ctx, &out_stream, rest_ctx->streams[i]->codecpar)) < 0)
+            goto end;
+        out_stream->codecpar->codec_tag = 0;
+        out_stream->time_base = rest_ctx->streams[i]->time_base;
+        av_dict_copy(&out_stream->metadata, rest_ctx->streams[i]->metadata, 0);
+        out_stream->disposition = rest_ctx->streams[i]->disposition;
+        out_rest.push_back(out_stream);
+    }
+
+    // formats without global headers need the parameter sets in band, Annex B
+    // segments already repeat them at every keyframe
+    if (!(out_ctx->oformat->flags & AVFMT_GLOBALHEADER) &&
+        out_video->codecpar->extradata_size > 0 &&
+        !annexb_filter_name(out_video->codecpar->codec_id)) {
+        const AVBitStreamFilter *filter = av_bsf_get_by_name("dump_extra");
+        if (!filter || (ret = av_bsf_alloc(filter, &bsf_ctx)) < 0 ||
+            (ret = avcodec_parameters_copy(bsf_ctx->par_in, out_video->codecpar)) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Failed to set up dump_extra\n");
+            goto end;
+        }
+        bsf_ctx->time_base_in = video_tb;
+        if ((ret = av_bsf_init(bsf_ctx)) < 0)
+            goto end;
+    }
+
+    if (!(out_ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = AsyncWriter::Open(&out_ctx->pb, output_path, output_io_options(-1, 0));
+        if (ret < 0) {
+            print_error("Failed to open output file", ret);
+            goto end;
+        }
+    }
+    if ((ret = write_header(out_ctx)) < 0) {
+        print_error("Failed to write header", ret);
+        goto end;
+    }
+
+    // merge the video chunks with the other streams in dts order, the rest
+    // segment is already interleaved by its muxer
+    ret = read_chunk_packet(&reader, video_pkt.get(), video_tb);
+    if (ret < 0 && ret != AVERROR_EOF) {
+        print_error("Failed to read chunk", ret);
+        goto end;
+    }
+    video_eof = ret == AVERROR_EOF;
+    if (!rest_eof && av_read_frame(rest_ctx, rest_pkt.get()) < 0)
+        rest_eof = true;
+
+    while (!video_eof || !rest_eof) {
+        bool take_video = !video_eof;
+        if (!video_eof && !rest_eof) {
+            rest_tb = rest_ctx->streams[rest_pkt->stream_index]->time_base;
+            rest_offset = av_rescale_q(CHUNK_TS_OFFSET, AV_TIME_BASE_Q, rest_tb);
+            take_video = rest_pkt->dts != AV_NOPTS_VALUE &&
+                         av_compare_ts(video_pkt->dts - video_offset, video_tb,
+                                       rest_pkt->dts - rest_offset, rest_tb) <= 0;
+        }
+        if (take_video) {
+            video_pkt->pts -= video_offset;
+            video_pkt->dts -= video_offset;
+            // chunks meet at keyframes and never overlap, an overlap is a bug
+            // in the split, report it and keep the muxer going
+            if (last_video_dts != AV_NOPTS_VALUE && video_pkt->dts <= last_video_dts) {
+                av_log(NULL, AV_LOG_WARNING,
+                       "Chunk packet dts %" PRId64 " overlaps the previous chunk at %" PRId64
+                       ", presentation order may break\n",
+                       video_pkt->dts, last_video_dts);
+                video_pkt->dts = last_video_dts + 1;
+                if (video_pkt->pts < video_pkt->dts)
+                    video_pkt->pts = video_pkt->dts;
+            }
+            last_video_dts = video_pkt->dts;
+
+            if (bsf_ctx) {
+                if ((ret = av_bsf_send_packet(bsf_ctx, video_pkt.get())) < 0)
+                    goto end;
+                while ((ret = av_bsf_receive_packet(bsf_ctx, bsf_pkt.get())) >= 0) {
+                    if ((ret = remux(bsf_pkt.get(), out_ctx, out_video, video_tb)) < 0)
+                        goto end;
+                }
+                if (ret != AVERROR(EAGAIN))
+                    goto end;
+            } else if ((ret = remux(video_pkt.get(), out_ctx, out_video, video_tb)) < 0) {
+                goto end;
+            }
+
+            ret = read_chunk_packet(&reader, video_pkt.get(), video_tb);
+            if (ret < 0 && ret != AVERROR_EOF) {
+                print_error("Failed to read chunk", ret);
+                goto end;
+            }
+            video_eof = ret == AVERROR_EOF;
+        } else {
+            rest_tb = rest_ctx->streams[rest_pkt->stream_index]->time_base;
+            rest_offset = av_rescale_q(CHUNK_TS_OFFSET, AV_TIME_BASE_Q, rest_tb);
+            if (rest_pkt->pts != AV_NOPTS_VALUE)
+                rest_pkt->pts -= rest_offset;
+            if (rest_pkt->dts != AV_NOPTS_VALUE)
+                rest_pkt->dts -= rest_offset;
+            if ((ret = remux(rest_pkt.get(), out_ctx, out_rest[rest_pkt->stream_index], rest_tb)) < 0)
+                goto end;
+            if (av_read_frame(rest_ctx, rest_pkt.get()) < 0)
+                rest_eof = true;
+        }
+    }
+
+    if ((ret = av_write_trailer(out_ctx)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to write trailer");
+        goto end;
+    }
+    if (!(out_ctx->oformat->flags & AVFMT_NOFILE) &&
+        (ret = AsyncWriter::Close(&out_ctx->pb)) < 0)
+        goto end;
+    flag = true;
+
+end:
+    av_bsf_free(&bsf_ctx);
+    avcodec_parameters_free(&video_par);
+    close_chunk_reader(&reader);
+    MappedReader::CloseInput(&rest_ctx);
+    if (out_ctx) {
+        if (!(out_ctx->oformat->flags & AVFMT_NOFILE))
+            AsyncWriter::Close(&out_ctx->pb);
+        avformat_free_context(out_ctx);
+    }
+    return flag;
+}
+
+// whether the demuxer header alone describes every stream well enough to be
+// copied
+static bool stream_info_complete(const AVFormatContext *fmt_ctx) {
+    if (fmt_ctx->nb_streams == 0)
+        return false;
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        const AVCodecParameters *par = fmt_ctx->streams[i]->codecpar;
+        if (par->codec_id == AV_CODEC_ID_NONE)
+            return false;
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO && (par->width <= 0 || par->height <= 0))
+            return false;
+        if (par->codec_type == AVMEDIA_TYPE_AUDIO &&
+            (par->sample_rate <= 0 || par->ch_layout.nb_channels <= 0))
+            return false;
+    }
+    return true;
+}
+
+bool TranscoderFFmpeg::copy_only() {
+    if (!encodeParameter->get_video_codec_name().empty() ||
+        !encodeParameter->get_audio_codec_name().empty() ||
+        !encodeParameter->GetRenditions().empty() || matchSource)
+        return false;
+    for (const StreamRule &rule : encodeParameter->GetStreamRules()) {
+        if (rule.action == STREAM_ACTION_TRANSCODE)
+            return false;
+    }
+    return true;
+}
+
+int TranscoderFFmpeg::open_media(StreamContext *decoder,
+                                 StreamContext *encoder) {
+    int ret = -1;
+    MappedReaderOptions input_options;
+    std::string format = encodeParameter->GetOutputFormat();
+    /* set the frameNumber to zero to avoid some bugs */
+    frameNumber = 0;
+    // open the multimedia file, local files are read from a mapping
+    input_options.readahead = encodeParameter->GetInputReadahead();
+    if ((ret = MappedReader::OpenInput(&decoder->fmtCtx,
+                                       strcmp(decoder->filename, "-") ? decoder->filename
+                                                                      : "pipe:0",
+                                       input_options)) < 0) {
+        print_error("Failed to open input file", ret);
+        return ret;
+    }
+
+    // a plain remux needs no decoder parameters, the packets are only
+    // probed when the header leaves a stream undescribed
+    if (copy_only() && stream_info_complete(decoder->fmtCtx)) {
+        av_log(NULL, AV_LOG_DEBUG, "Stream parameters complete, not probing\n");
+    } else if ((ret = ProbeCache::Instance().FindStreamInfo(decoder->fmtCtx,
+                                                           decoder->filename)) < 0) {
+        print_error("Failed to find stream info", ret);
+        return ret;
+    }
+
+    ret = avformat_alloc_output_context2(&encoder->fmtCtx, NULL,
+                                         format.empty() ? NULL : format.c_str(),
+                                         encoder->filename);
+    if (!encoder->fmtCtx) {
+        av_log(NULL, AV_LOG_ERROR, "Could not create output context\n");
+        return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+int TranscoderFFmpeg::open_outputs(StreamContext *encoder) {
+    std::vector<Rendition> renditions = encodeParameter->GetRenditions();
+    int ret = 0;
+
+    // the output contexts keep pointers to the paths, never reallocate
+    outputs.clear();
+    outputs.reserve(renditions.size() + 1);
+
+    OutputContext main = {encoder, encoder->filename,
+                          encodeParameter->get_width(),
+                          encodeParameter->get_height(),
+                          encodeParameter->get_video_bit_rate(), NULL, NULL};
+    outputs.push_back(std::move(main));
+
+    for (const Rendition &rendition : renditions) {
+        OutputContext output = {NULL, rendition.outputPath,
+                                rendition.width, rendition.height,
+                                rendition.videoBitRate, NULL,
+                                std::make_unique<StreamContext>()};
+        output.encoder = output.rendition.get();
+        outputs.push_back(std::move(output));
+        OutputContext &added = outputs.back();
+        added.encoder->filename = added.path.c_str();
+        ret = avformat_alloc_output_context2(&added.encoder->fmtCtx, NULL, NULL,
+                                             added.encoder->filename);
+        if (!added.encoder->fmtCtx) {
+            av_log(NULL, AV_LOG_ERROR, "Could not create output context for %s\n",
+                   added.encoder->filename);
+            return ret < 0 ? ret : AVERROR(ENOMEM);
+        }
+    }
+
+    for (OutputContext &output : outputs)
+        output.encoder->fmtCtx->output_ts_offset = outputTsOffset;
+    if (outputs.size() > 1)
+        av_log(NULL, AV_LOG_INFO, "Writing %zu renditions from one decode\n",
+               outputs.size());
+    return 0;
+}
+
+int TranscoderFFmpeg::write_header(AVFormatContext *fmtCtx) {
+    AVDictionary *opts = NULL;
+    double fragment = encodeParameter->GetFragmentDuration();
+    int ret;
+
+    // MP4 can only be streamed in fragments, the moov goes up front empty
+    if (av_match_name(fmtCtx->oformat->name, "mp4,mov,ipod,ismv,3gp,3g2,psp,f4v") &&
+        (fragment > 0 ||
+         (fmtCtx->pb && !(fmtCtx->pb->seekable & AVIO_SEEKABLE_NORMAL)))) {
+        av_dict_set(&opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+        if (fragment > 0)
+            av_dict_set_int(&opts, "frag_duration", llrint(fragment * AV_TIME_BASE), 0);
+    }
+
+    if (segment_duration(fmtCtx->oformat) > 0) {
+        double segment = segment_duration(fmtCtx->oformat);
+        std::string type = encodeParameter->GetPlaylistType();
+        std::string name = encodeParameter->GetSegmentTemplate();
+        // the renditions keep the default names so they do not collide
+        bool is_main = outputs.empty() || fmtCtx == outputs[0].encoder->fmtCtx;
+        char duration[32];
+        snprintf(duration, sizeof(duration), "%.3f", segment);
+
+        if (!strcmp(fmtCtx->oformat->name, "hls")) {
+            av_dict_set(&opts, "hls_time", duration, 0);
+            // a packaged file lists every segment unless it is a live window
+            if (type.empty())
+                type = "vod";
+            if (type != "live")
+                av_dict_set(&opts, "hls_playlist_type", type.c_str(), 0);
+            if (!encodeParameter->GetSegmentType().empty())
+                av_dict_set(&opts, "hls_segment_type",
+                            encodeParameter->GetSegmentType().c_str(), 0);
+            // hls resolves segment names against the working directory,
+            // keep them next to the playlist
+            if (is_main && !name.empty()) {
+                std::filesystem::path path(name);
+                if (path.is_relative())
+                    path = std::filesystem::path(fmtCtx->url).parent_path() / path;
+                av_dict_set(&opts, "hls_segment_filename", path.string().c_str(), 0);
+            }
+        } else {
+            av_dict_set(&opts, "seg_duration", duration, 0);
+            if (is_main && !name.empty())
+                av_dict_set(&opts, "media_seg_name", name.c_str(), 0);
+            if (!type.empty() && type != "vod")
+                av_dict_set(&opts, "streaming", "1", 0);
+        }
+    }
+
+    ret = avformat_write_header(fmtCtx, &opts);
+    av_dict_free(&opts);
+    return ret;
+}
+
+double TranscoderFFmpeg::segment_duration(const AVOutputFormat *ofmt) {
+    if (!av_match_name(ofmt->name, "hls,dash"))
+        return 0;
+    if (encodeParameter->GetSegmentDuration() > 0)
+        return encodeParameter->GetSegmentDuration();
+    return SEGMENT_DURATION;
+}
+
+AsyncWriterOptions TranscoderFFmpeg::output_io_options(int output, double duration) {
+    AsyncWriterOptions options;
+    int64_t bit_rate = 0;
+
+    if (encodeParameter->GetOutputBufferSize() > 0)
+        options.bufferSize = encodeParameter->GetOutputBufferSize();
+    options.syncInterval = encodeParameter->GetOutputSyncInterval();
+    if (output < 0 || duration <= 0 || !encodeParameter->GetOutputPreallocate())
+        return options;
+
+    for (const TranscodeLane &lane : lanes) {
+        if (lane.output != output)
+            continue;
+        int64_t rate = lane.enc_ctx ? lane.enc_ctx->bit_rate
+                                    : lane.in_stream->codecpar->bit_rate;
+        // one stream without a known rate makes the estimate useless
+        if (rate <= 0)
+            return options;
+        bit_rate += rate;
+    }
+    // a little headroom for the container, the excess is released on close
+    options.preallocate = (int64_t)(bit_rate / 8 * duration * 1.02);
+    return options;
+}
+
+void TranscoderFFmpeg::close_outputs() {
+    // the renditions close with their contexts, the main output belongs to
+    // the caller
+    outputs.clear();
+}
+
+void TranscoderFFmpeg::setup_lanes(StreamContext *decoder) {
+    for (TranscodeLane &lane : lanes) {
+        if (lane.dec_ctx) {
+            lane.packets = new BoundedQueue<AVPacket *>(PIPELINE_PACKET_QUEUE_SIZE);
+            lane.decoded = new BoundedQueue<AVFrame *>(PIPELINE_FRAME_QUEUE_SIZE);
+        }
+        if (lane.enc_ctx)
+            lane.filtered = new BoundedQueue<AVFrame *>(PIPELINE_FRAME_QUEUE_SIZE);
+    }
+    for (OutputContext &output : outputs)
+        output.muxQueue = new BoundedQueue<MuxPacket>(PIPELINE_PACKET_QUEUE_SIZE);
+
+    pick_progress_stream(decoder);
+}
+
+void TranscoderFFmpeg::pick_progress_stream(StreamContext *decoder) {
+    // progress follows the main video stream, or the main audio one for
+    // audio only files
+    progressStream = NULL;
+    for (TranscodeLane &lane : lanes) {
+        if (lane.output != 0)
+            continue;
+        if (lane.in_stream->index == decoder->videoIdx) {
+            progressStream = lane.out_stream;
+            break;
+        }
+        if (lane.in_stream->index == decoder->audioIdx)
+            progressStream = lane.out_stream;
+    }
+    if (!progressStream && !lanes.empty())
+        progressStream = lanes.front().out_stream;
+}
+
+void TranscoderFFmpeg::free_lanes() {
+    AVPacket *pkt = NULL;
+    AVFrame *frame = NULL;
+    MuxPacket mux_pkt;
+
+    // release whatever an aborted run left in the queues
+    for (TranscodeLane &lane : lanes) {
+        if (lane.packets) {
+            while (lane.packets->TryPop(pkt))
+                mediaPool->ReleasePacket(&pkt);
+            delete lane.packets;
+            lane.packets = NULL;
+        }
+        if (lane.decoded) {
+            while (lane.decoded->TryPop(frame))
+                mediaPool->ReleaseFrame(&frame);
+            delete lane.decoded;
+            lane.decoded = NULL;
+        }
+        if (lane.filtered) {
+            while (lane.filtered->TryPop(frame))
+                mediaPool->ReleaseFrame(&frame);
+            delete lane.filtered;
+            lane.filtered = NULL;
+        }
+    }
+
+    for (OutputContext &output : outputs) {
+        if (!output.muxQueue)
+            continue;
+        while (output.muxQueue->TryPop(mux_pkt))
+            mediaPool->ReleasePacket(&mux_pkt.pkt);
+        delete output.muxQueue;
+        output.muxQueue = NULL;
+    }
+}
+
+TranscodeLane *TranscoderFFmpeg::find_lane(int stream_index) {
+    // the lanes of the first output read the input for all outputs
+    for (TranscodeLane &lane : lanes) {
+        if (lane.in_stream->index == stream_index && !lane.source)
+            return &lane;
+    }
+    return NULL;
+}
+
+void TranscoderFFmpeg::abort_pipeline(int err) {
+    int expected = 0;
+    pipelineError.compare_exchange_strong(expected, err);
+    pipelineAborted = true;
+
+    for (TranscodeLane &lane : lanes) {
+        if (lane.packets)
+            lane.packets->Abort();
+        if (lane.decoded)
+            lane.decoded->Abort();
+        if (lane.filtered)
+            lane.filtered->Abort();
+    }
+    for (OutputContext &output : outputs) {
+        if (output.muxQueue)
+            output.muxQueue->Abort();
+    }
+}
+
+void TranscoderFFmpeg::stage_done(TranscodeStage stage, const char *event, int stream,
+                                  int64_t since) {
+    int64_t now = counters->AddBusy(stage, since);
+    if (TraceRecorder::Enabled())
+        TraceRecorder::Instance().Record(event, stream, since, now);
+}
+
+void TranscoderFFmpeg::enter_phase(TranscodePhase phase) {
+    if (counters == &ownCounters)
+        PhaseHook::Enter(phase);
+}
+
+void TranscoderFFmpeg::producer_done() {
+    // the demuxer and every encoder feed the mux queues, the last one closes
+    // them
+    if (--activeProducers == 0) {
+        for (OutputContext &output : outputs)
+            output.muxQueue->Close();
+    }
+}
+
+int TranscoderFFmpeg::run_pipeline(StreamContext *decoder, double startTime,
+                                   int64_t endPts) {
+    std::vector<std::thread> workers;
+    int ret = 0;
+
+    pipelineError = 0;
+    pipelineAborted = false;
+
+    setup_lanes(decoder);
+
+    // one producer for the demuxer (copied packets) plus one per encoder
+    activeProducers = 1;
+    for (TranscodeLane &lane : lanes) {
+        if (lane.enc_ctx)
+            activeProducers++;
+    }
+
+    for (TranscodeLane &lane : lanes) {
+        if (lane.dec_ctx) {
+            workers.emplace_back(&TranscoderFFmpeg::decode_loop, this, &lane);
+            workers.emplace_back(&TranscoderFFmpeg::filter_loop, this, &lane);
+        }
+        if (lane.enc_ctx)
+            workers.emplace_back(&TranscoderFFmpeg::encode_loop, this, &lane);
+    }
+    workers.emplace_back(&TranscoderFFmpeg::demux_loop, this, decoder,
+                         startTime, endPts);
+    for (size_t i = 1; i < outputs.size(); i++) {
+        workers.emplace_back([this, i]() {
+            int err = mux_loop(&outputs[i]);
+            if (err < 0)
+                abort_pipeline(err);
+        });
+    }
+
+    av_log(NULL, AV_LOG_INFO, "Pipeline started: %zu streams, %zu threads\n",
+           lanes.size(), workers.size() + 1);
+
+    // muxing of the main output stays on the calling thread so progress is
+    // reported from there
+    if ((ret = mux_loop(&outputs[0])) < 0)
+        abort_pipeline(ret);
+
+    for (std::thread &worker : workers)
+        worker.join();
+
+    free_lanes();
+
+    if (pipelineError < 0)
+        return pipelineError;
+    return ret;
+}
+
+int TranscoderFFmpeg::run_remux(StreamContext *decoder, double startTime,
+                                int64_t endPts) {
+    AVFormatContext *ofmtCtx = outputs[0].encoder->fmtCtx;
+    AVPacket *pkt = mediaPool->GetPacket();
+    int64_t last_dts = AV_NOPTS_VALUE;  // in AV_TIME_BASE, across all streams
+    bool interleave = false;
+    int ret = 0;
+
+    if (!pkt)
+        return AVERROR(ENOMEM);
+    TraceRecorder::Instance().SetThreadName("remux");
+    pick_progress_stream(decoder);
+    av_log(NULL, AV_LOG_INFO, "Remuxing %zu streams without decoding\n", lanes.size());
+
+    while (1) {
+        int64_t since = TranscodeCounters::Now();
+        // read errors end the input the same way EOF does
+        if (av_read_frame(decoder->fmtCtx, pkt) < 0)
+            break;
+        stage_done(STAGE_DEMUX, "read", pkt->stream_index, since);
+        counters->Add(pkt->stream_index, COUNTER_PACKETS_READ, 1);
+        counters->Add(pkt->stream_index, COUNTER_BYTES_READ, pkt->size);
+
+        TranscodeLane *lane = find_lane(pkt->stream_index);
+        AVRational tb = decoder->fmtCtx->streams[pkt->stream_index]->time_base;
+
+        if (endPts > 0 && pkt->stream_index == clock_stream(decoder)->index &&
+            pkt->pts >= endPts) {
+            av_packet_unref(pkt);
+            break;
+        }
+        if (!lane || (startTime > 0 && pkt->pts * av_q2d(tb) < startTime)) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        // Packets of an interleaved input are written as they come. The first
+        // one out of dts order hands the interleaving to the muxer for good.
+        if (!interleave && pkt->dts != AV_NOPTS_VALUE) {
+            int64_t dts = av_rescale_q(pkt->dts, tb, AV_TIME_BASE_Q);
+            if (last_dts != AV_NOPTS_VALUE && dts < last_dts) {
+                av_log(NULL, AV_LOG_DEBUG, "Input is not interleaved, buffering in the muxer\n");
+                interleave = true;
+            }
+            last_dts = std::max(last_dts, dts);
+        }
+
+        pkt->stream_index = lane->out_stream->index;
+        av_packet_rescale_ts(pkt, tb, lane->out_stream->time_base);
+        if (lane->out_stream == progressStream && pkt->pts != AV_NOPTS_VALUE)
+            update_progress(pkt->pts, lane->out_stream->time_base);
+
+        int size = pkt->size;
+        since = TranscodeCounters::Now();
+        ret = interleave ? av_interleaved_write_frame(ofmtCtx, pkt)
+                         : av_write_frame(ofmtCtx, pkt);
+        stage_done(STAGE_MUX, "write", lane->in_stream->index, since);
+        counters->Add(lane->in_stream->index, COUNTER_PACKETS_WRITTEN, 1);
+        counters->Add(lane->in_stream->index, COUNTER_BYTES_WRITTEN, size);
+        av_packet_unref(pkt);
+        if (ret < 0) {
+            print_error("Failed to write packet", ret);
+            break;
+        }
+    }
+    // the muxer still holds the interleaved packets
+    enter_phase(PHASE_FLUSH);
+
+    mediaPool->ReleasePacket(&pkt);
+    return ret < 0 ? ret : 0;
+}
+
+void TranscoderFFmpeg::demux_loop(StreamContext *decoder, double startTime,
+                                  int64_t endPts) {
+    int ret = 0;
+
+    TraceRecorder::Instance().SetThreadName("demux");
+    while (!pipelineAborted) {
+        AVPacket *pkt = mediaPool->GetPacket();
+        if (!pkt) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        int64_t since = TranscodeCounters::Now();
+        // read errors end the input the same way EOF does
+        if (av_read_frame(decoder->fmtCtx, pkt) < 0) {
+            mediaPool->ReleasePacket(&pkt);
+            break;
+        }
+        stage_done(STAGE_DEMUX, "read", pkt->stream_index, since);
+        counters->Add(pkt->stream_index, COUNTER_PACKETS_READ, 1);
+        counters->Add(pkt->stream_index, COUNTER_BYTES_READ, pkt->size);
+
+        TranscodeLane *lane = find_lane(pkt->stream_index);
+
+        // Check if we've reached the end time. A decoded video stream still
+        // needs every packet that precedes the end in decode order, the frames
+        // past the end are dropped after decoding.
+        if (endPts > 0 && pkt->stream_index == clock_stream(decoder)->index &&
+            ((lane && lane->dec_ctx && pkt->dts != AV_NOPTS_VALUE)
+                 ? pkt->dts : pkt->pts) >= endPts) {
+            mediaPool->ReleasePacket(&pkt);
+            break;
+        }
+
+        if (!lane) {
+            mediaPool->ReleasePacket(&pkt);
+            continue;
+        }
+
+        // Skip copied packets before start time, decoders need the packets
+        // from the preceding keyframe and trim the frames themselves
+        if (startTime > 0 && !lane->dec_ctx &&
+            pkt->pts * av_q2d(lane->in_stream->time_base) < startTime) {
+            mediaPool->ReleasePacket(&pkt);
+            continue;
+        }
+
+        bool queued;
+        if (lane->dec_ctx) {
+            queued = lane->packets->Push(pkt);
+        } else {
+            ret = push_copy(lane, pkt);
+            queued = ret == 0;
+        }
+        if (!queued) {
+            mediaPool->ReleasePacket(&pkt);
+            break;
+        }
+    }
+
+    if (ret < 0)
+        abort_pipeline(ret);
+
+    // the stages drain what is queued and flush the codecs
+    enter_phase(PHASE_FLUSH);
+    for (TranscodeLane &lane : lanes) {
+        if (lane.packets)
+            lane.packets->Close();
+    }
+    producer_done();
+}
+
+// queue a copied packet for every output that keeps the stream, returns 1
+// once the queues are closed and the packet is still owned by the caller
+int TranscoderFFmpeg::push_copy(TranscodeLane *lane, AVPacket *pkt) {
+    for (TranscodeLane *rendition : lane->renditions) {
+        AVPacket *copy = mediaPool->GetPacket();
+        if (!copy)
             return AVERROR(ENOMEM);
+        int ret = av_packet_ref(copy, pkt);
+        if (ret < 0) {
+            mediaPool->ReleasePacket(&copy);
+            return ret;
         }
-        avcodec_parameters_to_context(decoder->videoCodecCtx,
-                                    decoder->videoStream->codecpar);
-        decoder->videoCodecCtx->framerate = av_guess_frame_rate(decoder->fmtCtx, decoder->videoStream, NULL);
-        // bind decoder and decoder context
-        if ((ret = avcodec_open2(decoder->videoCodecCtx, decoder->videoCodec, NULL)) < 0) {
-            print_error("Couldn't open the codec", ret);
+        MuxPacket mux_pkt = {copy, lane->in_stream->time_base,
+                             rendition->out_stream, lane->in_stream->index};
+        if (!outputs[rendition->output].muxQueue->Push(mux_pkt)) {
+            mediaPool->ReleasePacket(&copy);
+            return 1;
+        }
+    }
+    MuxPacket mux_pkt = {pkt, lane->in_stream->time_base, lane->out_stream,
+                         lane->in_stream->index};
+    return outputs[lane->output].muxQueue->Push(mux_pkt) ? 0 : 1;
+}
+
+void TranscoderFFmpeg::decode_loop(TranscodeLane *lane) {
+    AVPacket *pkt = NULL;
+    int ret = 0;
+
+    TraceRecorder::Instance().SetThreadName("decode", lane->in_stream->index);
+    while (lane->packets->Pop(pkt)) {
+        ret = transcode_packet(lane, pkt);
+        mediaPool->ReleasePacket(&pkt);
+        if (ret < 0)
+            break;
+    }
+    // drain the frames the decoder is still holding
+    if (ret >= 0 && !pipelineAborted)
+        ret = transcode_packet(lane, NULL);
+
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to decode %s stream\n",
+               av_get_media_type_string(lane->dec_ctx->codec_type));
+        abort_pipeline(ret);
+    }
+    lane->decoded->Close();
+}
+
+void TranscoderFFmpeg::filter_loop(TranscodeLane *lane) {
+    AVFrame *frame = NULL;
+    int ret = 0;
+
+    TraceRecorder::Instance().SetThreadName("filter", lane->in_stream->index);
+    while (lane->decoded->Pop(frame)) {
+        ret = encode_frame(lane, frame);
+        mediaPool->ReleaseFrame(&frame);
+        if (ret < 0)
+            break;
+    }
+    if (ret >= 0 && !pipelineAborted)
+        ret = encode_frame(lane, NULL);
+
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to filter %s stream\n",
+               av_get_media_type_string(lane->dec_ctx->codec_type));
+        abort_pipeline(ret);
+    }
+    lane->filtered->Close();
+    for (TranscodeLane *rendition : lane->renditions)
+        rendition->filtered->Close();
+}
+
+void TranscoderFFmpeg::encode_loop(TranscodeLane *lane) {
+    AVFrame *frame = NULL;
+    int ret = 0;
+
+    TraceRecorder::Instance().SetThreadName("encode", lane->in_stream->index);
+    while (lane->filtered->Pop(frame)) {
+        ret = encode_write_frame(lane, frame);
+        mediaPool->ReleaseFrame(&frame);
+        if (ret < 0)
+            break;
+    }
+    // write the buffered frames
+    if (ret >= 0 && !pipelineAborted)
+        ret = encode_write_frame(lane, NULL);
+
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to encode %s stream\n",
+               av_get_media_type_string(lane->enc_ctx->codec_type));
+        abort_pipeline(ret);
+    }
+    producer_done();
+}
+
+int TranscoderFFmpeg::mux_loop(OutputContext *output) {
+    MuxPacket mux_pkt;
+    int ret = 0;
+
+    TraceRecorder::Instance().SetThreadName("mux", (int)(output - outputs.data()));
+    while (output->muxQueue->Pop(mux_pkt)) {
+        AVPacket *pkt = mux_pkt.pkt;
+        // associate the avpacket with the target output avstream
+        pkt->stream_index = mux_pkt.out_stream->index;
+        av_packet_rescale_ts(pkt, mux_pkt.time_base,
+                             mux_pkt.out_stream->time_base);
+
+        if (mux_pkt.out_stream == progressStream && pkt->pts != AV_NOPTS_VALUE)
+            update_progress(pkt->pts, mux_pkt.out_stream->time_base);
+
+        int size = pkt->size;
+        int64_t since = TranscodeCounters::Now();
+        ret = av_interleaved_write_frame(output->encoder->fmtCtx, pkt);
+        stage_done(STAGE_MUX, "write", mux_pkt.stream_index, since);
+        counters->Add(mux_pkt.stream_index, COUNTER_PACKETS_WRITTEN, 1);
+        counters->Add(mux_pkt.stream_index, COUNTER_BYTES_WRITTEN, size);
+        mediaPool->ReleasePacket(&pkt);
+        if (ret < 0) {
+            print_error("Failed to write packet", ret);
             return ret;
         }
     }
+    return 0;
+}
+
+int TranscoderFFmpeg::transcode_packet(TranscodeLane *lane, AVPacket *pkt) {
+    int ret = -1;
+
+    if (pkt)
+        av_packet_rescale_ts(pkt, lane->in_stream->time_base,
+                             lane->dec_ctx->time_base);
+
+    // send packet to decoder
+    int64_t since = TranscodeCounters::Now();
+    ret = avcodec_send_packet(lane->dec_ctx.get(), pkt);
+    stage_done(STAGE_DECODE, "decode send", lane->in_stream->index, since);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to send packet to decoder!\n");
+        return ret;
+    }
+
+    while (ret >= 0) {
+        AVFrame *frame = mediaPool->GetFrame();
+        if (!frame)
+            return AVERROR(ENOMEM);
 
-    if (decoder->audioIdx != OC_INVALID_STREAM_IDX) {
-        decoder->audioCodec =
-            avcodec_find_decoder(decoder->audioStream->codecpar->codec_id);
-        if (!decoder->audioCodec) {
-            av_log(NULL, AV_LOG_ERROR, "Couldn't find codec: %s \n",
-                    avcodec_get_name(decoder->audioStream->codecpar->codec_id));
-            return AVERROR_DECODER_NOT_FOUND;
+        since = TranscodeCounters::Now();
+        ret = avcodec_receive_frame(lane->dec_ctx.get(), frame);
+        stage_done(STAGE_DECODE, "decode receive", lane->in_stream->index, since);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            mediaPool->ReleaseFrame(&frame);
+            return 0;
+        } else if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Failed to receive frame from decoder!\n");
+            mediaPool->ReleaseFrame(&frame);
+            return ret;
+        }
+        counters->Add(lane->in_stream->index, COUNTER_FRAMES_DECODED, 1);
+
+        // frame accurate trimming of the cut range
+        if (frame->best_effort_timestamp != AV_NOPTS_VALUE &&
+            (cutStart >= 0 || cutEnd >= 0)) {
+            double ts = frame->best_effort_timestamp * av_q2d(lane->dec_ctx->time_base);
+            if ((cutStart >= 0 && ts < cutStart) || (cutEnd >= 0 && ts >= cutEnd)) {
+                mediaPool->ReleaseFrame(&frame);
+                continue;
+            }
+        }
+
+        if (!lane->decoded->Push(frame)) {
+            mediaPool->ReleaseFrame(&frame);
+            return AVERROR_EXIT;
         }
-        decoder->audioCodecCtx = avcodec_alloc_context3(decoder->audioCodec);
-        if (!decoder->audioCodecCtx) {
-            av_log(NULL, AV_LOG_ERROR, "No Memory!");
+    }
+    return ret;
+}
+
+int TranscoderFFmpeg::encode_frame(TranscodeLane *lane, AVFrame *frame) {
+    int ret = -1;
+    FilteringContext *fc = lane->filter_ctx;
+
+    /* push the decoded frame into the filtergraph, NULL marks EOF */
+    int64_t since = TranscodeCounters::Now();
+    ret = av_buffersrc_add_frame_flags(fc->buffersrc_ctx, frame, 0);
+    stage_done(STAGE_FILTER, "filter push", lane->in_stream->index, since);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Error while feeding the filtergraph\n");
+        return ret;
+    }
+    /* pull filtered frames from the filtergraph, one sink per output */
+    if ((ret = drain_filter(lane)) < 0)
+        return ret;
+    for (TranscodeLane *rendition : lane->renditions) {
+        if ((ret = drain_filter(rendition)) < 0)
+            return ret;
+    }
+    return 0;
+}
+
+int TranscoderFFmpeg::drain_filter(TranscodeLane *lane) {
+    int ret;
+
+    while (1) {
+        AVFrame *filtered = mediaPool->GetFrame();
+        if (!filtered)
             return AVERROR(ENOMEM);
+
+        int64_t since = TranscodeCounters::Now();
+        ret = av_buffersink_get_frame(lane->filter_ctx->buffersink_ctx, filtered);
+        stage_done(STAGE_FILTER, "filter pull", lane->in_stream->index, since);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            mediaPool->ReleaseFrame(&filtered);
+            return 0;
+        }
+        if (ret < 0) {
+            mediaPool->ReleaseFrame(&filtered);
+            return ret;
         }
-        avcodec_parameters_to_context(decoder->audioCodecCtx,
-                                    decoder->audioStream->codecpar);
+        counters->Add(lane->in_stream->index, COUNTER_FRAMES_FILTERED, 1);
+
+        if (!lane->filtered->Push(filtered)) {
+            mediaPool->ReleaseFrame(&filtered);
+            return AVERROR_EXIT;
+        }
+    }
+}
 
+int TranscoderFFmpeg::encode_write_frame(TranscodeLane *lane, AVFrame *frame) {
+    int ret = -1;
 
-        if ((ret = avcodec_open2(decoder->audioCodecCtx, decoder->audioCodec, NULL)) < 0) {
-            print_error("Couldn't open the codec", ret);
+    if (lane->enc_ctx->codec_type == AVMEDIA_TYPE_VIDEO &&
+        encodeParameter->get_qscale() != -1 && frame) {
+        frame->quality = lane->enc_ctx->global_quality;
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+    }
+    // open every segment with a keyframe, counted from the first frame
+    if (frame && lane->key_interval > 0 && frame->pts != AV_NOPTS_VALUE) {
+        int64_t t = av_rescale_q(frame->pts,
+                                 av_buffersink_get_time_base(lane->filter_ctx->buffersink_ctx),
+                                 AV_TIME_BASE_Q);
+        if (lane->next_key == AV_NOPTS_VALUE || t >= lane->next_key) {
+            frame->pict_type = AV_PICTURE_TYPE_I;
+            if (lane->next_key == AV_NOPTS_VALUE)
+                lane->next_key = t;
+            while (lane->next_key <= t)
+                lane->next_key += lane->key_interval;
+        }
+    }
+    // send frame to encoder
+    int64_t since = TranscodeCounters::Now();
+    ret = avcodec_send_frame(lane->enc_ctx.get(), frame);
+    stage_done(STAGE_ENCODE, "encode send", lane->in_stream->index, since);
+    if (ret < 0) {
+        print_error("Failed to send frame to encoder", ret);
+        return ret;
+    }
+
+    while (ret >= 0) {
+        AVPacket *output_packet = mediaPool->GetPacket();
+        if (!output_packet)
+            return AVERROR(ENOMEM);
+
+        since = TranscodeCounters::Now();
+        ret = avcodec_receive_packet(lane->enc_ctx.get(), output_packet);
+        stage_done(STAGE_ENCODE, "encode receive", lane->in_stream->index, since);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            mediaPool->ReleasePacket(&output_packet);
+            return 0;
+        } else if (ret < 0) {
+            mediaPool->ReleasePacket(&output_packet);
             return ret;
         }
+
+        counters->Add(lane->in_stream->index, COUNTER_PACKETS_ENCODED, 1);
+        MuxPacket mux_pkt = {output_packet, lane->enc_ctx->time_base,
+                             lane->out_stream, lane->in_stream->index};
+        if (!outputs[lane->output].muxQueue->Push(mux_pkt)) {
+            mediaPool->ReleasePacket(&output_packet);
+            return AVERROR_EXIT;
+        }
     }
+    return ret;
+}
 
-    // create AVFrame
-    decoder->frame = av_frame_alloc();
-    if (!decoder->frame) {
-        av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
-        return AVERROR(ENOMEM);
+// best stream of the type among those that reach an output
+static int find_kept_stream(AVFormatContext *fmt_ctx, enum AVMediaType type) {
+    int idx = av_find_best_stream(fmt_ctx, type, -1, -1, NULL, 0);
+    if (idx >= 0 && fmt_ctx->streams[idx]->discard != AVDISCARD_ALL)
+        return idx;
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        AVStream *stream = fmt_ctx->streams[i];
+        if (stream->codecpar->codec_type == type && stream->discard != AVDISCARD_ALL &&
+            !(stream->disposition & AV_DISPOSITION_ATTACHED_PIC))
+            return (int)i;
     }
+    return AVERROR_STREAM_NOT_FOUND;
+}
 
-    // create AVPacket
-    decoder->pkt = av_packet_alloc();
-    if (!decoder->pkt) {
-        av_log(NULL, AV_LOG_ERROR, "NO Memory!\n");
-        return AVERROR(ENOMEM);
+int TranscoderFFmpeg::find_main_streams(StreamContext *decoder) {
+    int idx;
+
+    idx = find_kept_stream(decoder->fmtCtx, AVMEDIA_TYPE_VIDEO);
+    if (idx >= 0) {
+        decoder->videoIdx = idx;
+        decoder->videoStream = decoder->fmtCtx->streams[idx];
+    }
+    idx = find_kept_stream(decoder->fmtCtx, AVMEDIA_TYPE_AUDIO);
+    if (idx >= 0) {
+        decoder->audioIdx = idx;
+        decoder->audioStream = decoder->fmtCtx->streams[idx];
     }
 
+    if (decoder->videoIdx == OC_INVALID_STREAM_IDX &&
+        decoder->audioIdx == OC_INVALID_STREAM_IDX) {
+        av_log(NULL, AV_LOG_ERROR, "No audio or video stream found\n");
+        return AVERROR_STREAM_NOT_FOUND;
+    }
+    return 0;
+}
+
+int TranscoderFFmpeg::plan_streams(StreamContext *decoder) {
+    AVFormatContext *ifmtCtx = decoder->fmtCtx;
+    // the main output decides, the renditions keep the same streams
+    const AVOutputFormat *ofmt = outputs[0].encoder->fmtCtx->oformat;
+    unsigned int kept = 0;
+
+    streamPlan.assign(ifmtCtx->nb_streams, STREAM_ACTION_DROP);
+    for (unsigned int i = 0; i < ifmtCtx->nb_streams; i++) {
+        AVStream *stream = ifmtCtx->streams[i];
+        streamPlan[i] = resolve_stream_action(stream, ofmt);
+        if (streamPlan[i] == STREAM_ACTION_DROP) {
+            // the demuxer skips the packets instead of handing them over
+            stream->discard = AVDISCARD_ALL;
+            av_log(NULL, AV_LOG_INFO, "Stream #%u (%s): dropped\n", i,
+                   avcodec_get_name(stream->codecpar->codec_id));
+        } else {
+            stream->discard = AVDISCARD_DEFAULT;
+            kept++;
+        }
+    }
+
+    if (kept == 0) {
+        av_log(NULL, AV_LOG_ERROR, "No stream selected for output\n");
+        return AVERROR_STREAM_NOT_FOUND;
+    }
     return 0;
 }
 
-int TranscoderFFmpeg::prepare_encoder_video(StreamContext *decoder,
-                                            StreamContext *encoder) {
+AVStream *TranscoderFFmpeg::clock_stream(StreamContext *decoder) {
+    if (decoder->videoStream)
+        return decoder->videoStream;
+    return decoder->audioStream;
+}
+
+StreamAction TranscoderFFmpeg::resolve_stream_action(AVStream *stream,
+                                                     const AVOutputFormat *ofmt) {
+    enum AVMediaType type = stream->codecpar->codec_type;
+    const char *type_name = av_get_media_type_string(type);
+    AVDictionaryEntry *lang = av_dict_get(stream->metadata, "language", NULL, 0);
+    StreamAction action = STREAM_ACTION_AUTO;
+
+    if (onlyStreamIdx != OC_INVALID_STREAM_IDX && stream->index != onlyStreamIdx)
+        return STREAM_ACTION_DROP;
+    if (stream->index == skipStreamIdx)
+        return STREAM_ACTION_DROP;
+
+    for (const StreamRule &rule : encodeParameter->GetStreamRules()) {
+        if (rule.index >= 0 && rule.index != stream->index)
+            continue;
+        if (!rule.type.empty() && (!type_name || rule.type != type_name))
+            continue;
+        if (!rule.language.empty() && (!lang || rule.language != lang->value))
+            continue;
+        action = rule.action;
+        break;
+    }
+    if (action == STREAM_ACTION_DROP)
+        return STREAM_ACTION_DROP;
+
+    // skip streams the output format has no place for
+    if ((type == AVMEDIA_TYPE_VIDEO && ofmt->video_codec == AV_CODEC_ID_NONE) ||
+        (type == AVMEDIA_TYPE_AUDIO && ofmt->audio_codec == AV_CODEC_ID_NONE) ||
+        (type == AVMEDIA_TYPE_SUBTITLE && ofmt->subtitle_codec == AV_CODEC_ID_NONE)) {
+        if (action != STREAM_ACTION_AUTO)
+            av_log(NULL, AV_LOG_WARNING, "Stream #%d: %s can not hold %s streams, dropping\n",
+                   stream->index, ofmt->name, type_name ? type_name : "unknown");
+        return STREAM_ACTION_DROP;
+    }
+
+    if (action == STREAM_ACTION_AUTO) {
+        if (type == AVMEDIA_TYPE_VIDEO &&
+            !(stream->disposition & AV_DISPOSITION_ATTACHED_PIC))
+            action = encodeParameter->get_video_codec_name().empty()
+                         ? STREAM_ACTION_COPY : STREAM_ACTION_TRANSCODE;
+        else if (type == AVMEDIA_TYPE_AUDIO)
+            action = encodeParameter->get_audio_codec_name().empty()
+                         ? STREAM_ACTION_COPY : STREAM_ACTION_TRANSCODE;
+        else
+            action = STREAM_ACTION_COPY;
+    }
+
+    if (action == STREAM_ACTION_TRANSCODE && type != AVMEDIA_TYPE_VIDEO &&
+        type != AVMEDIA_TYPE_AUDIO) {
+        av_log(NULL, AV_LOG_WARNING, "Stream #%d: %s streams can't be transcoded, copying\n",
+               stream->index, type_name ? type_name : "unknown");
+        action = STREAM_ACTION_COPY;
+    }
+
+    // 0 means definitely unsupported, negative means the muxer doesn't know
+    if (action == STREAM_ACTION_COPY &&
+        avformat_query_codec(ofmt, stream->codecpar->codec_id, FF_COMPLIANCE_NORMAL) == 0) {
+        av_log(NULL, AV_LOG_WARNING, "Stream #%d: %s is not supported by %s, dropping\n",
+               stream->index, avcodec_get_name(stream->codecpar->codec_id), ofmt->name);
+        return STREAM_ACTION_DROP;
+    }
+    return action;
+}
+
+int TranscoderFFmpeg::prepare_streams(StreamContext *decoder) {
+    AVFormatContext *ifmtCtx = decoder->fmtCtx;
+    size_t nbOutputs = outputs.size();
+    int ret = 0;
+
+    // the pipeline threads keep pointers to the lanes and the filter
+    // contexts, never reallocate
+    filters.clear();
+    filters.resize(ifmtCtx->nb_streams * nbOutputs);
+    lanes.clear();
+    lanes.reserve(ifmtCtx->nb_streams * nbOutputs);
+
+    for (unsigned int i = 0; i < ifmtCtx->nb_streams; i++) {
+        AVStream *stream = ifmtCtx->streams[i];
+        StreamAction action = streamPlan[i];
+        if (action == STREAM_ACTION_DROP)
+            continue;
+
+        TranscodeLane *source = NULL;
+        for (size_t o = 0; o < nbOutputs; o++) {
+            lanes.push_back(TranscodeLane());
+            TranscodeLane *lane = &lanes.back();
+            lane->in_stream = stream;
+            lane->output = (int)o;
+            lane->source = source;
+            if (source)
+                source->renditions.push_back(lane);
+            else
+                source = lane;
+        }
+
+        for (size_t o = 0; o < nbOutputs; o++) {
+            TranscodeLane *lane = o == 0 ? source : source->renditions[o - 1];
+            AVFormatContext *ofmtCtx = outputs[o].encoder->fmtCtx;
+
+            if (action == STREAM_ACTION_COPY) {
+                if ((ret = prepare_copy(ofmtCtx, &lane->out_stream, stream->codecpar)) < 0)
+                    return ret;
+            } else {
+                // one decoder and one split filter graph serve every output
+                if (o == 0) {
+                    if ((ret = prepare_decoder(lane, ifmtCtx)) < 0)
+                        return ret;
+                    for (size_t k = 0; k < nbOutputs; k++) {
+                        TranscodeLane *target = k == 0 ? lane : lane->renditions[k - 1];
+                        target->filter_ctx = &filters[k * ifmtCtx->nb_streams + i];
+                    }
+                    if ((ret = init_filters_wrapper(lane)) < 0)
+                        return ret;
+                }
+                if (stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+                    if (stream == decoder->videoStream)
+                        frameTotalNumber = stream->nb_frames;
+                    ret = prepare_encoder_video(lane, ofmtCtx);
+                } else {
+                    ret = prepare_encoder_audio(lane, ofmtCtx);
+                }
+                if (ret < 0)
+                    return ret;
+            }
+
+            // keep language and title of every track
+            av_dict_copy(&lane->out_stream->metadata, stream->metadata, 0);
+            lane->out_stream->disposition = stream->disposition;
+
+            av_log(NULL, AV_LOG_INFO, "Stream #%u -> %s#%d (%s %s)\n", i,
+                   nbOutputs > 1 ? outputs[o].path.c_str() : "",
+                   lane->out_stream->index,
+                   avcodec_get_name(stream->codecpar->codec_id),
+                   lane->enc_ctx ? lane->enc_ctx->codec->name : "copy");
+        }
+    }
+
+    if (lanes.empty()) {
+        av_log(NULL, AV_LOG_ERROR, "No stream selected for output\n");
+        return AVERROR_STREAM_NOT_FOUND;
+    }
+    return 0;
+}
+
+void TranscoderFFmpeg::close_streams() {
+    // the lanes own their codec contexts and the filter contexts the graphs
+    lanes.clear();
+    filters.clear();
+}
+
+int TranscoderFFmpeg::prepare_decoder(TranscodeLane *lane, AVFormatContext *ifmtCtx) {
+    AVStream *stream = lane->in_stream;
+    const AVCodec *codec = NULL;
+    int ret = -1;
+
+    // find the decoder by ID
+    codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        av_log(NULL, AV_LOG_ERROR, "Couldn't find codec: %s \n",
+               avcodec_get_name(stream->codecpar->codec_id));
+        return AVERROR_DECODER_NOT_FOUND;
+    }
+    // init decoder context
+    lane->dec_ctx.reset(avcodec_alloc_context3(codec));
+    if (!lane->dec_ctx) {
+        av_log(NULL, AV_LOG_ERROR, "No memory!\n");
+        return AVERROR(ENOMEM);
+    }
+    if ((ret = avcodec_parameters_to_context(lane->dec_ctx.get(), stream->codecpar)) < 0)
+        return ret;
+    lane->dec_ctx->pkt_timebase = stream->time_base;
+    if (lane->dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO)
+        lane->dec_ctx->framerate = av_guess_frame_rate(ifmtCtx, stream, NULL);
+    set_codec_threads(lane->dec_ctx.get(), encodeParameter->GetDecoderThreads(),
+                      encodeParameter->GetDecoderThreadType());
+
+    // bind decoder and decoder context
+    if ((ret = avcodec_open2(lane->dec_ctx.get(), codec, NULL)) < 0) {
+        print_error("Couldn't open the codec", ret);
+        return ret;
+    }
+    log_codec_threads(lane->dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO
+                          ? "video decoder" : "audio decoder",
+                      lane->dec_ctx.get());
+    return 0;
+}
+
+int TranscoderFFmpeg::prepare_encoder_video(TranscodeLane *lane,
+                                            AVFormatContext *ofmtCtx) {
+    AVCodecContext *dec_ctx = (lane->source ? lane->source : lane)->dec_ctx.get();
+    OutputContext *output = &outputs[lane->output];
+    AVCodecContext *enc_ctx = NULL;
+    const AVCodec *videoCodec = NULL;
     int ret = -1;
 
-    /* set the total numbers of frame */
-    frameTotalNumber = decoder->videoStream->nb_frames;
     /**
      * set the output file parameters
      */
-    // find the encodec by Name
-    //  QByteArray ba = encodeParamter->get_video_codec_name().toLocal8Bit();
+    // find the encodec by Name, a stream mapped for transcoding without a
+    // codec gets the default one of the output format
     std::string codec = encodeParameter->get_video_codec_name();
-    encoder->videoCodec = avcodec_find_encoder_by_name(codec.c_str());
-
-    // find the encodec by ID
-    // encoder->videoCodec =
-    // avcodec_find_encoder(decoder->videoCodecCtx->codec_id);
-    if (!encoder->videoCodec) {
+    if (!codec.empty())
+        videoCodec = avcodec_find_encoder_by_name(codec.c_str());
+    else if (matchSource)
+        videoCodec = avcodec_find_encoder(lane->in_stream->codecpar->codec_id);
+    else
+        videoCodec = avcodec_find_encoder(ofmtCtx->oformat->video_codec);
+    if (!videoCodec) {
         av_log(NULL, AV_LOG_ERROR, "Couldn't find video codec: %s\n",
                codec.c_str());
         return AVERROR_ENCODER_NOT_FOUND;
     }
 
     // init codec context
-    encoder->videoCodecCtx = avcodec_alloc_context3(encoder->videoCodec);
-    if (!encoder->videoCodecCtx) {
+    lane->enc_ctx.reset(avcodec_alloc_context3(videoCodec));
+    enc_ctx = lane->enc_ctx.get();
+    if (!enc_ctx) {
         av_log(NULL, AV_LOG_ERROR, "No memory!\n");
         return AVERROR(ENOMEM);
     }
 
     std::string preset = encodeParameter->get_preset();
     if (!preset.empty())
-        av_opt_set(encoder->videoCodecCtx->priv_data, "preset", preset.c_str(), 0);
+        av_opt_set(enc_ctx->priv_data, "preset", preset.c_str(), 0);
 
-    if (decoder->videoCodecCtx->codec_type == AVMEDIA_TYPE_VIDEO) {
-        uint16_t width = encodeParameter->get_width();
-        uint16_t height = encodeParameter->get_height();
+    if (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        uint16_t width = output->width;
+        uint16_t height = output->height;
         std::string pixelFormat = encodeParameter->get_pixel_format();
-        AVRational tpf = {decoder->videoCodecCtx->ticks_per_frame, 1};
+        AVRational tpf = {dec_ctx->ticks_per_frame, 1};
         if (width > 0)
-            encoder->videoCodecCtx->width = width;
+            enc_ctx->width = width;
         else
-            encoder->videoCodecCtx->width = decoder->videoCodecCtx->width;
+            enc_ctx->width = dec_ctx->width;
         if (height > 0)
-            encoder->videoCodecCtx->height = height;
+            enc_ctx->height = height;
         else
-            encoder->videoCodecCtx->height = decoder->videoCodecCtx->height;
+            enc_ctx->height = dec_ctx->height;
 
-        if (encodeParameter->get_video_bit_rate())
-            encoder->videoCodecCtx->bit_rate = encodeParameter->get_video_bit_rate();
+        if (output->videoBitRate)
+            enc_ctx->bit_rate = output->videoBitRate;
         else
-            encoder->videoCodecCtx->bit_rate = 0; // use default rate control(crf)
-        encoder->videoCodecCtx->sample_aspect_ratio =
-            decoder->videoCodecCtx->sample_aspect_ratio;
+            enc_ctx->bit_rate = 0; // use default rate control(crf)
+        enc_ctx->sample_aspect_ratio =
+            dec_ctx->sample_aspect_ratio;
         // the AVCodecContext don't have framerate
         // outCodecCtx->time_base = av_inv_q(inCodecCtx->framerate);
         if (!pixelFormat.empty())
-            encoder->videoCodecCtx->pix_fmt = av_get_pix_fmt(pixelFormat.c_str());
-        else if (decoder->videoCodecCtx->pix_fmt != AV_PIX_FMT_NONE)
-            encoder->videoCodecCtx->pix_fmt = decoder->videoCodecCtx->pix_fmt;
-        else if (encoder->videoCodec->pix_fmts)
-            encoder->videoCodecCtx->pix_fmt = encoder->videoCodec->pix_fmts[0];
+            enc_ctx->pix_fmt = av_get_pix_fmt(pixelFormat.c_str());
+        else if (dec_ctx->pix_fmt != AV_PIX_FMT_NONE)
+            enc_ctx->pix_fmt = dec_ctx->pix_fmt;
+        else if (videoCodec->pix_fmts)
+            enc_ctx->pix_fmt = videoCodec->pix_fmts[0];
         else
-            encoder->videoCodecCtx->pix_fmt = AV_PIX_FMT_NONE;
+            enc_ctx->pix_fmt = AV_PIX_FMT_NONE;
 
-        // encoder->videoCodecCtx->max_b_frames = 0;
-        encoder->videoCodecCtx->time_base = av_inv_q(av_mul_q(decoder->videoCodecCtx->framerate, tpf));
+        // enc_ctx->max_b_frames = 0;
+        enc_ctx->time_base = av_inv_q(av_mul_q(dec_ctx->framerate, tpf));
         int qscale = encodeParameter->get_qscale();
         if (qscale != -1) {
-            encoder->videoCodecCtx->flags |= AV_CODEC_FLAG_QSCALE;
-            encoder->videoCodecCtx->global_quality = qscale * FF_QP2LAMBDA;
+            enc_ctx->flags |= AV_CODEC_FLAG_QSCALE;
+            enc_ctx->global_quality = qscale * FF_QP2LAMBDA;
+        }
+
+        // HLS and DASH cut segments at keyframes, force an IDR frame at each
+        // boundary and keep the GOPs from straddling them
+        double segment = segment_duration(ofmtCtx->oformat);
+        if (segment > 0) {
+            if (dec_ctx->framerate.num > 0)
+                enc_ctx->gop_size =
+                    std::max(1, (int)lrint(segment * av_q2d(dec_ctx->framerate)));
+            if (enc_ctx->priv_data)
+                av_opt_set(enc_ctx->priv_data, "forced-idr", "1", 0);
+            lane->key_interval = llrint(segment * AV_TIME_BASE);
+            lane->next_key = AV_NOPTS_VALUE;
         }
     }
 
-    if (encoder->fmtCtx->oformat->flags & AVFMT_GLOBALHEADER)
-        encoder->videoCodecCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    // the re-encoded ends of a smart cut are spliced into the copied stream,
+    // keep everything a decoder configures itself from
+    if (matchSource) {
+        AVCodecParameters *par = lane->in_stream->codecpar;
+        enc_ctx->profile = par->profile;
+        enc_ctx->level = par->level;
+        enc_ctx->color_range = par->color_range;
+        enc_ctx->color_primaries = par->color_primaries;
+        enc_ctx->color_trc = par->color_trc;
+        enc_ctx->colorspace = par->color_space;
+        enc_ctx->chroma_sample_location = par->chroma_location;
+        enc_ctx->field_order = par->field_order;
+        if (!enc_ctx->bit_rate)
+            enc_ctx->bit_rate = par->bit_rate;
+    }
+
+    // smart cut segments carry their parameter sets in band so the stitcher
+    // can switch between copied and re-encoded packets at any keyframe
+    if ((ofmtCtx->oformat->flags & AVFMT_GLOBALHEADER) && !matchSource)
+        enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    mediaPool->AttachEncoder(enc_ctx);
 
+    set_codec_threads(enc_ctx, encodeParameter->GetEncoderThreads(),
+                      encodeParameter->GetEncoderThreadType());
     // bind codec and codec context
-    if ((ret = avcodec_open2(encoder->videoCodecCtx, encoder->videoCodec, NULL)) < 0) {
+    if ((ret = avcodec_open2(enc_ctx, videoCodec, NULL)) < 0) {
         print_error("Couldn't open the codec", ret);
         return ret;
     }
+    log_codec_threads("video encoder", enc_ctx);
 
-    encoder->videoStream = avformat_new_stream(encoder->fmtCtx, NULL);
-    if (!encoder->videoStream) {
+    lane->out_stream = avformat_new_stream(ofmtCtx, NULL);
+    if (!lane->out_stream) {
         av_log(NULL, AV_LOG_ERROR, "Failed allocating output stream\n");
         return AVERROR(ENOMEM);
     }
 
-    ret = avcodec_parameters_from_context(encoder->videoStream->codecpar,
-                                          encoder->videoCodecCtx);
+    ret = avcodec_parameters_from_context(lane->out_stream->codecpar,
+                                          enc_ctx);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR,
                "Failed to copy encoder parameters to output stream #\n");
         return ret;
     }
-    encoder->videoStream->time_base = encoder->videoCodecCtx->time_base;
-
-    // oFmtCtx->oformat = av_guess_format(NULL, dst, NULL);
-    // if(!oFmtCtx->oformat)
-    // {
-    //     av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
-    // }
+    lane->out_stream->time_base = enc_ctx->time_base;
 
     return 0;
 }
 
-int TranscoderFFmpeg::prepare_encoder_audio(StreamContext *decoder,
-                                            StreamContext *encoder) {
+int TranscoderFFmpeg::prepare_encoder_audio(TranscodeLane *lane,
+                                            AVFormatContext *ofmtCtx) {
+    AVCodecContext *dec_ctx = (lane->source ? lane->source : lane)->dec_ctx.get();
+    AVCodecContext *enc_ctx = NULL;
+    const AVCodec *audioCodec = NULL;
     int ret = -1;
     /**
      * set the output file parameters
      */
-    // find the encodec by name
+    // find the encodec by name, or the default one of the output format
     std::string codec = encodeParameter->get_audio_codec_name();
-    encoder->audioCodec = avcodec_find_encoder_by_name(codec.c_str());
-    if (!encoder->audioCodec) {
+    if (!codec.empty())
+        audioCodec = avcodec_find_encoder_by_name(codec.c_str());
+    else
+        audioCodec = avcodec_find_encoder(ofmtCtx->oformat->audio_codec);
+    if (!audioCodec) {
         av_log(NULL, AV_LOG_ERROR, "Couldn't find audio codec: %s\n",
                codec.c_str());
         return AVERROR_ENCODER_NOT_FOUND;
     }
     // init codec context
-    encoder->audioCodecCtx = avcodec_alloc_context3(encoder->audioCodec);
-    if (!encoder->audioCodecCtx) {
+    lane->enc_ctx.reset(avcodec_alloc_context3(audioCodec));
+    enc_ctx = lane->enc_ctx.get();
+    if (!enc_ctx) {
         av_log(NULL, AV_LOG_ERROR, "No memory!\n");
         return AVERROR(ENOMEM);
     }
-    if (decoder->audioCodecCtx->codec_type == AVMEDIA_TYPE_AUDIO) {
+    if (dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
         if ((ret = av_channel_layout_copy(
-            &encoder->audioCodecCtx->ch_layout, &decoder->audioCodecCtx->ch_layout)) < 0)
+            &enc_ctx->ch_layout, &dec_ctx->ch_layout)) < 0)
             return ret;
-        encoder->audioCodecCtx->sample_rate =
-            decoder->audioCodecCtx->sample_rate;
-        encoder->audioCodecCtx->sample_fmt =
-            encoder->audioCodec->sample_fmts[0];
+        enc_ctx->sample_rate =
+            dec_ctx->sample_rate;
+        enc_ctx->sample_fmt =
+            audioCodec->sample_fmts[0];
         if (encodeParameter->get_audio_bit_rate())
-            encoder->audioCodecCtx->bit_rate = encodeParameter->get_audio_bit_rate();
+            enc_ctx->bit_rate = encodeParameter->get_audio_bit_rate();
         else
-            encoder->audioCodecCtx->bit_rate = decoder->audioCodecCtx->bit_rate;
-        encoder->audioCodecCtx->time_base =
-            av_make_q(1, decoder->audioCodecCtx->sample_rate);
-        encoder->audioCodecCtx->strict_std_compliance =
+            enc_ctx->bit_rate = dec_ctx->bit_rate;
+        enc_ctx->time_base =
+            av_make_q(1, dec_ctx->sample_rate);
+        enc_ctx->strict_std_compliance =
             FF_COMPLIANCE_EXPERIMENTAL;
     }
+    mediaPool->AttachEncoder(enc_ctx);
+    set_codec_threads(enc_ctx, encodeParameter->GetEncoderThreads(),
+                      encodeParameter->GetEncoderThreadType());
     // bind codec and codec context
-    if ((ret = avcodec_open2(encoder->audioCodecCtx, encoder->audioCodec, NULL)) < 0) {
+    if ((ret = avcodec_open2(enc_ctx, audioCodec, NULL)) < 0) {
         print_error("Couldn't open the codec", ret);
         goto end;
     }
-    if (!(encoder->audioCodec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE))
-        av_buffersink_set_frame_size(filters_ctx[decoder->audioIdx].buffersink_ctx, encoder->audioCodecCtx->frame_size);
-    encoder->audioStream = avformat_new_stream(encoder->fmtCtx, NULL);
-    if (!encoder->audioStream) {
+    log_codec_threads("audio encoder", enc_ctx);
+    if (!(audioCodec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE))
+        av_buffersink_set_frame_size(lane->filter_ctx->buffersink_ctx, enc_ctx->frame_size);
+    lane->out_stream = avformat_new_stream(ofmtCtx, NULL);
+    if (!lane->out_stream) {
         av_log(NULL, AV_LOG_ERROR, "Failed allocating output stream\n");
         ret = AVERROR(ENOMEM);
         goto end;
     }
-    encoder->audioStream->time_base = encoder->audioCodecCtx->time_base;
-    ret = avcodec_parameters_from_context(encoder->audioStream->codecpar,
-                                          encoder->audioCodecCtx);
+    lane->out_stream->time_base = enc_ctx->time_base;
+    ret = avcodec_parameters_from_context(lane->out_stream->codecpar,
+                                          enc_ctx);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR,
                "Failed to copy encoder parameters to output stream #\n");
@@ -967,9 +2431,14 @@ int TranscoderFFmpeg::prepare_copy(AVFormatContext *avCtx, AVStream **stream,
 
 int TranscoderFFmpeg::remux(AVPacket *pkt, AVFormatContext *avCtx,
                             AVStream *inStream, AVStream *outStream) {
+    return remux(pkt, avCtx, outStream, inStream->time_base);
+}
+
+int TranscoderFFmpeg::remux(AVPacket *pkt, AVFormatContext *avCtx,
+                            AVStream *outStream, AVRational inTimeBase) {
     // associate the avpacket with the target output avstream
     pkt->stream_index = outStream->index;
-    av_packet_rescale_ts(pkt, inStream->time_base, outStream->time_base);
+    av_packet_rescale_ts(pkt, inTimeBase, outStream->time_base);
     int ret = av_interleaved_write_frame(avCtx, pkt);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR, "write frame error!\n");